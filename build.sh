@@ -5,5 +5,7 @@ make
 
 echo -e "\n=== Creating ISO ==="
 cp kernel.elf iso/boot/
+# everything in disk/ becomes the RAM disk (a grub.cfg module)
+tar --format=ustar -cf iso/boot/lazydos.tar -C disk .
 rm -f betterdos.iso
 grub2-mkrescue -o betterdos.iso iso/ 2>/dev/null
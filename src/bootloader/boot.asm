@@ -13,11 +13,18 @@ multiboot_header:
     dd 0x1BADB002          ; Magic number
     dd 0x00000003          ; Flags: align + meminfo
     dd -(0x1BADB002 + 0x00000003)  ; Checksum
-section .bss
-align 16
+section .bss align=4096
+; the stack sits between two unmapped pages once paging_init() runs:
+; running off either end faults instead of scribbling over .bss
+alignb 4096
+global stack_guard_low, stack_guard_high, stack_bottom, stack_top
+stack_guard_low:
+    resb 4096
 stack_bottom:
     resb 16384          ; 16 KiB
 stack_top:
+stack_guard_high:
+    resb 4096
 
 section .text
 global _start
@@ -26,6 +33,8 @@ extern _init          ; your kernel entry (C)
 _start:
     cli
     mov esp, stack_top
+    push ebx            ; multiboot info (physical address)
+    push eax            ; 0x2BADB002 if a multiboot loader started us
     call _init          ; kernel main
 
     cli
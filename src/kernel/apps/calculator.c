@@ -4,9 +4,15 @@
 #include "../io/keyboard.h"
 #include "../lib/string.h"
 #include "../lib/int.h"
+#include "../core/cpu.h"
+#include "../core/taskpool.h"
 #include <stdbool.h>
 
-#define BUF_SZ 256
+#define BUF_SZ      256
+#define MAX_RPN     64          /* instructions per expression */
+#define EVAL_DEPTH  32          /* value stack */
+#define BATCH_MAX   16          /* expressions per batch */
+#define BATCH_RUNS  16          /* timed runs per expression, best kept */
 
 static void print(const char *s)  { terminal_writestring(s); }
 static void println(const char *s){ terminal_writestring(s); terminal_putchar('\n'); }
@@ -16,128 +22,405 @@ static void pr_ok(const char *s) {
     terminal_setcolor(VGA_COLOR_LIGHT_GREY);
 }
 
-/* ---- read one integer, advance pointer ---- */
-static bool read_int(const char **p, int32 *out)
+/* ---- compiled form: RPN over a small value stack ---- */
+enum calc_op {
+    OP_NUM, OP_ANS,                     /* push val / last result */
+    OP_NEG, OP_NOT,                     /* unary - ~ */
+    OP_MUL, OP_DIV, OP_MOD,
+    OP_ADD, OP_SUB,
+    OP_SHL, OP_SHR,
+    OP_AND, OP_XOR, OP_OR,
+};
+
+struct calc_insn {
+    uint8 op;
+    int32 val;
+};
+
+struct calc_prog {
+    struct calc_insn code[MAX_RPN];
+    int len;
+};
+
+enum calc_err {
+    CALC_OK, ERR_SYNTAX, ERR_COMPLEX, ERR_BIG_NUMBER,
+    ERR_DIV_ZERO, ERR_OVERFLOW, ERR_SHIFT,
+};
+
+static const char *const err_msg[] = {
+    [CALC_OK]        = "ok",
+    [ERR_SYNTAX]     = "invalid expression",
+    [ERR_COMPLEX]    = "expression too complex",
+    [ERR_BIG_NUMBER] = "number too large",
+    [ERR_DIV_ZERO]   = "divide by zero",
+    [ERR_OVERFLOW]   = "overflow",
+    [ERR_SHIFT]      = "shift count must be 0..31",
+};
+
+static int32 ans;               /* result of the last good expression */
+
+/* ---- compiler: precedence climbing, C operator levels ---- */
+struct parser {
+    const char *s;
+    struct calc_prog *prog;
+    int depth;                  /* values on the stack at this point */
+    enum calc_err err;
+};
+
+static void skip_ws(struct parser *p) { while (*p->s == ' ') p->s++; }
+
+static void emit(struct parser *p, uint8 op, int32 val)
 {
-    bool neg = false;
-    int32 v = 0;
+    if (p->err) return;
+    if (p->prog->len >= MAX_RPN) { p->err = ERR_COMPLEX; return; }
 
-    while (**p == ' ') (*p)++;
+    if (op == OP_NUM || op == OP_ANS) p->depth++;
+    else if (op != OP_NEG && op != OP_NOT) p->depth--;
+    if (p->depth > EVAL_DEPTH) { p->err = ERR_COMPLEX; return; }
 
-    if (**p == '-') { neg = true; (*p)++; }
+    p->prog->code[p->prog->len].op  = op;
+    p->prog->code[p->prog->len].val = val;
+    p->prog->len++;
+}
 
-    if (**p < '0' || **p > '9') return false;
+/* decimal up to limit, or 0x hex up to 32 bits (taken as a bit pattern) */
+static bool read_number(struct parser *p, uint32 limit, uint32 *out)
+{
+    const char *s = p->s;
+    uint32 v = 0;
 
-    while (**p >= '0' && **p <= '9') {
-        v = v * 10 + (**p - '0');
-        (*p)++;
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        s += 2;
+        int digits = 0;
+        for (;; ++s, ++digits) {
+            uint32 d;
+            if (*s >= '0' && *s <= '9')      d = *s - '0';
+            else if (*s >= 'a' && *s <= 'f') d = *s - 'a' + 10;
+            else if (*s >= 'A' && *s <= 'F') d = *s - 'A' + 10;
+            else break;
+            if (v >> 28) { p->err = ERR_BIG_NUMBER; return false; }
+            v = (v << 4) | d;
+        }
+        if (!digits) { p->err = ERR_SYNTAX; return false; }
+    } else {
+        if (*s < '0' || *s > '9') { p->err = ERR_SYNTAX; return false; }
+        for (; *s >= '0' && *s <= '9'; ++s) {
+            uint32 d = *s - '0';
+            if (v > (limit - d) / 10) { p->err = ERR_BIG_NUMBER; return false; }
+            v = v * 10 + d;
+        }
     }
-
-    *out = neg ? -v : v;
+    p->s = s;
+    *out = v;
     return true;
 }
 
-/* ---- evaluate left-to-right expression ---- */
-static bool eval_expr(const char *s, int32 *result)
+static void parse_expr(struct parser *p, int min_prec);
+
+static void parse_unary(struct parser *p)
 {
-    int32 acc;
-    if (!read_int(&s, &acc)) return false;
+    uint32 v;
 
-    for (;;) {
-        while (*s == ' ') s++;
-        char op = *s++;
-        if (op == '\0') break;
-
-        int32 rhs;
-        if (!read_int(&s, &rhs)) return false;
-
-        switch (op) {
-        case '+': acc += rhs; break;
-        case '-': acc -= rhs; break;
-        case '*': acc *= rhs; break;
-        case '/':
-            if (rhs == 0) {
-                print("ERROR: divide by zero\n");
-                return false;
+    skip_ws(p);
+    char c = *p->s;
+
+    if (c == '-' || c == '~') {
+        p->s++;
+        skip_ws(p);
+        /* -2147483648 is a literal, not the negation of an overflow */
+        if (c == '-' && *p->s >= '0' && *p->s <= '9' && p->s[1] != 'x' && p->s[1] != 'X') {
+            if (read_number(p, 0x80000000U, &v)) emit(p, OP_NUM, (int32)(0U - v));
+            return;
+        }
+        parse_unary(p);
+        emit(p, c == '-' ? OP_NEG : OP_NOT, 0);
+    } else if (c == '+') {
+        p->s++;
+        parse_unary(p);
+    } else if (c == '(') {
+        p->s++;
+        parse_expr(p, 1);
+        skip_ws(p);
+        if (*p->s != ')') { if (!p->err) p->err = ERR_SYNTAX; return; }
+        p->s++;
+    } else if (!strncmp(p->s, "ans", 3)) {
+        p->s += 3;
+        emit(p, OP_ANS, 0);
+    } else if (read_number(p, 0x7FFFFFFFU, &v)) {
+        emit(p, OP_NUM, (int32)v);
+    }
+}
+
+/* binary operator at p->s: its precedence (0 = none) and length */
+static int binop(const char *s, uint8 *op, int *len)
+{
+    *len = 1;
+    switch (s[0]) {
+    case '*': *op = OP_MUL; return 6;
+    case '/': *op = OP_DIV; return 6;
+    case '%': *op = OP_MOD; return 6;
+    case '+': *op = OP_ADD; return 5;
+    case '-': *op = OP_SUB; return 5;
+    case '<': if (s[1] != '<') return 0; *len = 2; *op = OP_SHL; return 4;
+    case '>': if (s[1] != '>') return 0; *len = 2; *op = OP_SHR; return 4;
+    case '&': *op = OP_AND; return 3;
+    case '^': *op = OP_XOR; return 2;
+    case '|': *op = OP_OR;  return 1;
+    }
+    return 0;
+}
+
+static void parse_expr(struct parser *p, int min_prec)
+{
+    parse_unary(p);
+    while (!p->err) {
+        uint8 op;
+        int len;
+        skip_ws(p);
+        int prec = binop(p->s, &op, &len);
+        if (prec == 0 || prec < min_prec) break;
+        p->s += len;
+        parse_expr(p, prec + 1);        /* left associative */
+        emit(p, op, 0);
+    }
+}
+
+static enum calc_err calc_compile(const char *s, struct calc_prog *prog)
+{
+    struct parser p = { s, prog, 0, CALC_OK };
+    prog->len = 0;
+    parse_expr(&p, 1);
+    skip_ws(&p);
+    if (!p.err && *p.s) p.err = ERR_SYNTAX;
+    return p.err;
+}
+
+/* ---- evaluator: no parsing, checked 32-bit arithmetic ---- */
+static enum calc_err calc_eval(const struct calc_prog *prog, int32 last, int32 *out)
+{
+    int32 st[EVAL_DEPTH];
+    int sp = 0;
+    const struct calc_insn *in  = prog->code;
+    const struct calc_insn *end = in + prog->len;
+
+    for (; in < end; ++in) {
+        switch (in->op) {
+        case OP_NUM: st[sp++] = in->val; continue;
+        case OP_ANS: st[sp++] = last;    continue;
+        case OP_NEG:
+            if (__builtin_sub_overflow(0, st[sp - 1], &st[sp - 1])) return ERR_OVERFLOW;
+            continue;
+        case OP_NOT: st[sp - 1] = ~st[sp - 1]; continue;
+        }
+
+        int32 b = st[--sp];
+        int32 a = st[sp - 1];
+        switch (in->op) {
+        case OP_ADD: if (__builtin_add_overflow(a, b, &a)) return ERR_OVERFLOW; break;
+        case OP_SUB: if (__builtin_sub_overflow(a, b, &a)) return ERR_OVERFLOW; break;
+        case OP_MUL: if (__builtin_mul_overflow(a, b, &a)) return ERR_OVERFLOW; break;
+        case OP_DIV:
+            if (b == 0) return ERR_DIV_ZERO;
+            if (b == -1) {
+                if (__builtin_sub_overflow(0, a, &a)) return ERR_OVERFLOW;
+            } else {
+                a /= b;
             }
-            acc = int32_div(acc, rhs);
             break;
-        default:
-            return false;
+        case OP_MOD:
+            if (b == 0) return ERR_DIV_ZERO;
+            a = (b == -1) ? 0 : a % b;
+            break;
+        /* shifts and bit ops work on the bit pattern: no overflow */
+        case OP_SHL:
+            if ((uint32)b > 31) return ERR_SHIFT;
+            a = (int32)((uint32)a << b);
+            break;
+        case OP_SHR:
+            if ((uint32)b > 31) return ERR_SHIFT;
+            a >>= b;                    /* arithmetic, like the CPU's sar */
+            break;
+        case OP_AND: a &= b; break;
+        case OP_XOR: a ^= b; break;
+        case OP_OR:  a |= b; break;
         }
+        st[sp - 1] = a;
     }
 
-    *result = acc;
-    return true;
+    *out = st[0];
+    return CALC_OK;
 }
 
 /* ---- int to string ---- */
-static void itoa(int32 v, char *buf)
+static void utoa(uint32 v, char *buf)
 {
     char tmp[12];
     int i = 0;
-    bool neg = false;
-
-    if (v == 0) { buf[0] = '0'; buf[1] = '\0'; return; }
-
-    if (v < 0) { neg = true; v = -v; }
 
-    while (v) {
+    do {
         tmp[i++] = '0' + (v % 10);
         v /= 10;
-    }
-
-    if (neg) tmp[i++] = '-';
+    } while (v);
 
     int j = 0;
     while (i--) buf[j++] = tmp[i];
     buf[j] = '\0';
 }
 
+static void itoa(int32 v, char *buf)
+{
+    if (v < 0) {
+        *buf++ = '-';
+        utoa(0U - (uint32)v, buf);
+    } else {
+        utoa((uint32)v, buf);
+    }
+}
+
+static void print_error(enum calc_err err)
+{
+    print("ERROR: ");
+    println(err_msg[err]);
+}
+
+/* ---- one line of input, echoed, with backspace ---- */
+static void read_line(char *line)
+{
+    int i = 0;
+    for (;;) {
+        char c = lazy_getchar();
+        if (c == '\n' || c == '\r') {
+            terminal_putchar('\n');
+            line[i] = '\0';
+            return;
+        }
+        if ((c == '\b' || c == 0x7F) && i > 0) {
+            i--;
+            terminal_putchar('\b');
+            terminal_putchar(' ');
+            terminal_putchar('\b');
+            continue;
+        }
+        if (c >= 32 && c <= 126 && i < BUF_SZ - 1) {
+            line[i++] = c;
+            terminal_putchar(c);
+        }
+    }
+}
+
+/* ---- batch: compile a list first, then evaluate back to back ---- */
+struct batch_job {
+    const struct calc_prog *prog;
+    int32  last;                /* ans as this expression sees it */
+    uint32 best;                /* cycles */
+};
+
+/* best of BATCH_RUNS: the first run also warms the caches.  One task
+   per expression, so the timing spreads over every CPU in the pool. */
+static void time_job(void *arg)
+{
+    struct batch_job *j = arg;
+    j->best = 0xFFFFFFFF;
+    for (int r = 0; r < BATCH_RUNS; ++r) {
+        int32 tmp;
+        uint64_t t0 = rdtsc();
+        calc_eval(j->prog, j->last, &tmp);
+        uint64_t t = rdtsc() - t0;
+        if (t < j->best) j->best = (uint32)t;
+    }
+}
+
+static void run_batch(void)
+{
+    static char text[BATCH_MAX][BUF_SZ];
+    static struct calc_prog progs[BATCH_MAX];
+    static struct batch_job jobs[BATCH_MAX];
+    static int32 results[BATCH_MAX];
+    static enum calc_err errs[BATCH_MAX];
+    static char out[16];
+    int n = 0;
+
+    println("One expression per line, empty line to run.");
+    while (n < BATCH_MAX) {
+        print("batch> ");
+        read_line(text[n]);
+        if (!text[n][0]) break;
+        enum calc_err err = calc_compile(text[n], &progs[n]);
+        if (err) { print_error(err); continue; }
+        n++;
+    }
+
+    /* results first, in order: each one may use the previous ans */
+    for (int i = 0; i < n; ++i) {
+        jobs[i].prog = &progs[i];
+        jobs[i].last = ans;
+        errs[i] = calc_eval(&progs[i], ans, &results[i]);
+        if (!errs[i]) ans = results[i];
+    }
+
+    /* then the timing, which needs nothing from its neighbours */
+    if (cpu_features.tsc) {
+        struct task_group g = { 0 };
+        for (int i = 0; i < n; ++i)
+            task_spawn(&g, time_job, &jobs[i]);
+        task_wait(&g);
+    }
+
+    for (int i = 0; i < n; ++i) {
+        print(text[i]);
+        print(" = ");
+        if (errs[i]) {
+            print("ERROR: ");
+            print(err_msg[errs[i]]);
+        } else {
+            itoa(results[i], out);
+            print(out);
+        }
+        if (cpu_features.tsc) {
+            print("  (");
+            utoa(jobs[i].best, out);
+            print(out);
+            print(" cycles)");
+        }
+        println("");
+    }
+}
+
 /* ---- interactive shell ---- */
 void calculator_run(void)
 {
     static char line[BUF_SZ];
-    static char out[32];
+    static char out[16];
+    static struct calc_prog prog;
 
     println("");
     pr_ok("=== LazyDOS Calculator (int-only) ===");
     println("");
-    println("Left-to-right evaluation. Type 'exit' to quit.");
+    println("C precedence: ( ) - ~  * / %  + -  << >>  &  ^  |   'ans' = last result");
+    println("Type 'batch' to time a list, 'exit' to quit.");
 
     for (;;) {
         print("calc> ");
-
-        int i = 0;
-        for (;;) {
-            char c = lazy_getchar();
-            if (c == '\n' || c == '\r') {
-                terminal_putchar('\n');
-                line[i] = '\0';
-                break;
-            }
-            if ((c == '\b' || c == 0x7F) && i > 0) {
-                i--;
-                terminal_putchar('\b');
-                terminal_putchar(' ');
-                terminal_putchar('\b');
-                continue;
-            }
-            if (c >= 32 && c <= 126 && i < BUF_SZ - 1) {
-                line[i++] = c;
-                terminal_putchar(c);
-            }
-        }
+        read_line(line);
 
         if (!strcmp(line, "exit") || !strcmp(line, "quit"))
             break;
+        if (!strcmp(line, "batch")) {
+            run_batch();
+            continue;
+        }
+        if (!line[0])
+            continue;
 
         int32 res;
-        if (eval_expr(line, &res)) {
+        enum calc_err err = calc_compile(line, &prog);
+        if (!err) err = calc_eval(&prog, ans, &res);
+        if (err) {
+            print_error(err);
+        } else {
+            ans = res;
             itoa(res, out);
             println(out);
-        } else {
-            print("ERROR: invalid expression\n");
         }
     }
 
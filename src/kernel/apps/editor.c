@@ -0,0 +1,486 @@
+/* editor.c  –  gap-buffer editor: arrows, scrolling, partial redraw */
+#include "editor.h"
+#include "../io/vga.h"
+#include "../io/keyboard.h"
+#include "../lib/string.h"
+#include "../core/heap.h"
+#include "../fs/ramdisk.h"
+
+#define TITLE_ROW   0
+#define TEXT_ROW    1
+#define TEXT_ROWS   (VGA_HEIGHT - 2)
+#define STATUS_ROW  (VGA_HEIGHT - 1)
+
+#define NO_LINE     ((size_t)-1)
+
+/* what the next render() has to repaint, cheapest first */
+enum { ED_NONE, ED_LINE, ED_BELOW, ED_ALL };
+
+static const uint8_t TEXT_COLOR   = VGA_COLOR_LIGHT_GREY;
+static const uint8_t TITLE_COLOR  = VGA_COLOR_CYAN;
+static const uint8_t STATUS_COLOR = VGA_COLOR_DARK_GREY;
+
+/* ---------- gap buffer ---------- */
+static size_t gap_len(const struct editor *ed)  { return ed->gap_end - ed->gap_start; }
+static size_t text_len(const struct editor *ed) { return ed->cap - gap_len(ed); }
+
+static char at(const struct editor *ed, size_t i)
+{
+    return i < ed->gap_start ? ed->buf[i] : ed->buf[i + gap_len(ed)];
+}
+
+/* move the gap (the cursor) to text position pos, keeping line in step */
+static void goto_pos(struct editor *ed, size_t pos)
+{
+    if (pos < ed->gap_start) {
+        size_t n = ed->gap_start - pos;
+        for (size_t i = pos; i < ed->gap_start; ++i)
+            if (ed->buf[i] == '\n') ed->line--;
+        memmove(ed->buf + ed->gap_end - n, ed->buf + pos, n);
+        ed->gap_start -= n;
+        ed->gap_end   -= n;
+    } else if (pos > ed->gap_start) {
+        size_t n = pos - ed->gap_start;
+        for (size_t i = 0; i < n; ++i)
+            if (ed->buf[ed->gap_end + i] == '\n') ed->line++;
+        memmove(ed->buf + ed->gap_start, ed->buf + ed->gap_end, n);
+        ed->gap_start += n;
+        ed->gap_end   += n;
+    }
+}
+
+static size_t line_start(const struct editor *ed, size_t pos)
+{
+    while (pos > 0 && at(ed, pos - 1) != '\n') pos--;
+    return pos;
+}
+
+static size_t line_end(const struct editor *ed, size_t pos)
+{
+    size_t len = text_len(ed);
+    while (pos < len && at(ed, pos) != '\n') pos++;
+    return pos;
+}
+
+static size_t cursor_col(const struct editor *ed)
+{
+    return ed->gap_start - line_start(ed, ed->gap_start);
+}
+
+/* ---------- drawing ---------- */
+static void mark(struct editor *ed, int what, size_t from_line)
+{
+    if (what == ED_BELOW && ed->redraw == ED_BELOW) {
+        if (from_line < ed->redraw_from) ed->redraw_from = from_line;
+    } else if (what > ed->redraw) {
+        ed->redraw = what;
+        ed->redraw_from = from_line;
+    }
+}
+
+/* paint the line starting at p on screen row y; returns the start of
+   the following line or NO_LINE past the end of the text */
+static size_t draw_line(const struct editor *ed, size_t y, size_t p)
+{
+    size_t len = text_len(ed);
+    size_t x = 0, col = 0;
+
+    if (p != NO_LINE) {
+        for (; p < len; ++p, ++col) {
+            char c = at(ed, p);
+            if (c == '\n') break;
+            if (col >= ed->left && x < VGA_WIDTH)
+                terminal_putentryat(c, TEXT_COLOR, x++, y);
+        }
+    }
+    while (x < VGA_WIDTH)
+        terminal_putentryat(' ', TEXT_COLOR, x++, y);
+
+    return (p != NO_LINE && p < len) ? p + 1 : NO_LINE;
+}
+
+static void draw_text(const struct editor *ed, size_t from_line)
+{
+    /* walk back from the cursor's line to from_line */
+    size_t p = line_start(ed, ed->gap_start);
+    for (size_t l = ed->line; l > from_line; --l)
+        p = line_start(ed, p - 1);
+
+    for (size_t y = from_line - ed->top; y < TEXT_ROWS; ++y)
+        p = draw_line(ed, TEXT_ROW + y, p);
+}
+
+static size_t put_text(const char *s, size_t x, size_t y, uint8_t color)
+{
+    while (*s && x < VGA_WIDTH)
+        terminal_putentryat(*s++, color, x++, y);
+    return x;
+}
+
+static size_t put_num(size_t n, size_t x, size_t y, uint8_t color)
+{
+    char tmp[12];
+    int i = 0;
+    do { tmp[i++] = '0' + n % 10; n /= 10; } while (n);
+    while (i > 0 && x < VGA_WIDTH)
+        terminal_putentryat(tmp[--i], color, x++, y);
+    return x;
+}
+
+static void draw_status(const struct editor *ed)
+{
+    if (ed->message) {
+        size_t x = put_text(ed->message, 0, STATUS_ROW, TITLE_COLOR);
+        while (x < VGA_WIDTH)
+            terminal_putentryat(' ', STATUS_COLOR, x++, STATUS_ROW);
+        return;
+    }
+    size_t x = put_text("Ln ", 0, STATUS_ROW, STATUS_COLOR);
+    x = put_num(ed->line + 1, x, STATUS_ROW, STATUS_COLOR);
+    x = put_text("/", x, STATUS_ROW, STATUS_COLOR);
+    x = put_num(ed->nlines, x, STATUS_ROW, STATUS_COLOR);
+    x = put_text("  Col ", x, STATUS_ROW, STATUS_COLOR);
+    x = put_num(cursor_col(ed) + 1, x, STATUS_ROW, STATUS_COLOR);
+    x = put_text("  Bytes ", x, STATUS_ROW, STATUS_COLOR);
+    x = put_num(text_len(ed), x, STATUS_ROW, STATUS_COLOR);
+    if (ed->file[0]) {
+        x = put_text("  ", x, STATUS_ROW, STATUS_COLOR);
+        x = put_text(ed->file, x, STATUS_ROW, STATUS_COLOR);
+    }
+    while (x < VGA_WIDTH)
+        terminal_putentryat(' ', STATUS_COLOR, x++, STATUS_ROW);
+}
+
+static void render(struct editor *ed)
+{
+    /* keep the cursor on screen; a moved window repaints everything */
+    size_t col = cursor_col(ed);
+    if (ed->line < ed->top) {
+        ed->top = ed->line;
+        ed->redraw = ED_ALL;
+    } else if (ed->line >= ed->top + TEXT_ROWS) {
+        ed->top = ed->line - TEXT_ROWS + 1;
+        ed->redraw = ED_ALL;
+    }
+    if (col < ed->left) {
+        ed->left = col;
+        ed->redraw = ED_ALL;
+    } else if (col >= ed->left + VGA_WIDTH) {
+        ed->left = col - VGA_WIDTH + 1;
+        ed->redraw = ED_ALL;
+    }
+
+    switch (ed->redraw) {
+    case ED_ALL:
+        put_text(ed->title, 0, TITLE_ROW, TITLE_COLOR);
+        draw_text(ed, ed->top);
+        break;
+    case ED_BELOW:
+        draw_text(ed, ed->redraw_from < ed->top ? ed->top : ed->redraw_from);
+        break;
+    case ED_LINE:
+        draw_line(ed, TEXT_ROW + ed->line - ed->top, line_start(ed, ed->gap_start));
+        break;
+    }
+    ed->redraw = ED_NONE;
+
+    draw_status(ed);
+    terminal_setcursor(col - ed->left, TEXT_ROW + ed->line - ed->top);
+    terminal_flush();
+}
+
+/* ---------- editing ---------- */
+/* double the buffer: the text after the gap moves to the new end */
+static bool grow(struct editor *ed)
+{
+    size_t cap = ed->cap * 2;
+    char *buf = krealloc(ed->buf, cap);
+    if (!buf) return false;
+
+    size_t tail = ed->cap - ed->gap_end;
+    memmove(buf + cap - tail, buf + ed->gap_end, tail);
+    ed->buf = buf;
+    ed->gap_end = cap - tail;
+    ed->cap = cap;
+    return true;
+}
+
+static void insert(struct editor *ed, char c)
+{
+    /* one byte stays free for the NUL */
+    if (gap_len(ed) <= 1 && !grow(ed)) return;
+    ed->buf[ed->gap_start++] = c;
+    if (c == '\n') {
+        mark(ed, ED_BELOW, ed->line);
+        ed->line++;
+        ed->nlines++;
+    } else {
+        mark(ed, ED_LINE, 0);
+    }
+}
+
+static void erase_back(struct editor *ed)
+{
+    if (ed->gap_start == 0) return;
+    if (ed->buf[--ed->gap_start] == '\n') {
+        ed->line--;
+        ed->nlines--;
+        mark(ed, ED_BELOW, ed->line);
+    } else {
+        mark(ed, ED_LINE, 0);
+    }
+}
+
+static void erase_fwd(struct editor *ed)
+{
+    if (ed->gap_end == ed->cap) return;
+    if (ed->buf[ed->gap_end++] == '\n') {
+        ed->nlines--;
+        mark(ed, ED_BELOW, ed->line);
+    } else {
+        mark(ed, ED_LINE, 0);
+    }
+}
+
+static void line_up(struct editor *ed)
+{
+    size_t s = line_start(ed, ed->gap_start);
+    if (s == 0) return;
+    size_t ps = line_start(ed, s - 1);
+    size_t n = s - 1 - ps;
+    goto_pos(ed, ps + (ed->goal_col < n ? ed->goal_col : n));
+}
+
+static void line_down(struct editor *ed)
+{
+    size_t e = line_end(ed, ed->gap_start);
+    if (e == text_len(ed)) return;
+    size_t n = line_end(ed, e + 1) - (e + 1);
+    goto_pos(ed, e + 1 + (ed->goal_col < n ? ed->goal_col : n));
+}
+
+static void handle_key(struct editor *ed, char c)
+{
+    bool vertical = false;
+
+    switch (c) {
+    case KEY_LEFT:
+        if (ed->gap_start > 0) goto_pos(ed, ed->gap_start - 1);
+        break;
+    case KEY_RIGHT:
+        if (ed->gap_start < text_len(ed)) goto_pos(ed, ed->gap_start + 1);
+        break;
+    case KEY_UP:
+        line_up(ed);
+        vertical = true;
+        break;
+    case KEY_DOWN:
+        line_down(ed);
+        vertical = true;
+        break;
+    case KEY_PGUP:
+        for (int i = 0; i < TEXT_ROWS; ++i) line_up(ed);
+        vertical = true;
+        break;
+    case KEY_PGDN:
+        for (int i = 0; i < TEXT_ROWS; ++i) line_down(ed);
+        vertical = true;
+        break;
+    case KEY_HOME:
+        goto_pos(ed, line_start(ed, ed->gap_start));
+        break;
+    case KEY_END:
+        goto_pos(ed, line_end(ed, ed->gap_start));
+        break;
+    case KEY_DELETE:
+        erase_fwd(ed);
+        break;
+    case '\b':
+    case 0x7F:
+        erase_back(ed);
+        break;
+    case '\r':
+    case '\n':
+        insert(ed, '\n');
+        break;
+    default:
+        if (c >= 32 && c <= 126) insert(ed, c);
+        break;
+    }
+
+    if (!vertical) ed->goal_col = cursor_col(ed);
+}
+
+/* ---------- files ---------- */
+/* a file name typed on the status row, starting from the current one,
+   with ext added if it has none; false for Ctrl+X or an empty name */
+static bool ask_name(const struct editor *ed, const char *label, char *name)
+{
+    size_t n = strlen(ed->file);
+    memcpy(name, ed->file, n + 1);
+    for (;;) {
+        size_t x = put_text(label, 0, STATUS_ROW, TITLE_COLOR);
+        x = put_text(name, x, STATUS_ROW, TEXT_COLOR);
+        terminal_setcursor(x, STATUS_ROW);
+        while (x < VGA_WIDTH)
+            terminal_putentryat(' ', STATUS_COLOR, x++, STATUS_ROW);
+        terminal_flush();
+
+        char c = lazy_getchar();
+        if (c == '\n' || c == '\r') break;
+        if (c == EDITOR_EXIT) return false;
+        if ((c == '\b' || c == 0x7F) && n > 0) name[--n] = '\0';
+        else if (c > ' ' && c <= 126 && n + 1 < FAT_NAME_LEN) {
+            name[n++] = c;
+            name[n] = '\0';
+        }
+    }
+    if (!n) return false;
+
+    bool dot = false;
+    for (size_t i = 0; i < n; ++i) dot |= name[i] == '.';
+    size_t e = strlen(ed->ext);
+    if (!dot && n + 1 + e < FAT_NAME_LEN) {
+        name[n] = '.';
+        memcpy(name + n + 1, ed->ext, e + 1);
+    }
+    return true;
+}
+
+static void save_file(struct editor *ed)
+{
+    char name[FAT_NAME_LEN];
+    if (!ask_name(ed, "Save as: ", name)) return;
+
+    size_t len;
+    const char *text = editor_text(ed, &len);
+    enum fat_err e = fat_save(name, text, len);
+    goto_pos(ed, ed->saved_pos);        /* editor_text() moved the cursor */
+    ed->saved_pos = NO_LINE;
+
+    if (e) {
+        ed->message = fat_strerror(e);
+        return;
+    }
+    strcpy(ed->file, name);
+    ed->message = "Saved";
+}
+
+static void open_file(struct editor *ed)
+{
+    char name[FAT_NAME_LEN];
+    if (!ask_name(ed, "Open: ", name)) return;
+
+    char *data;
+    size_t len;
+    bool ok;
+    enum fat_err e = fat_load(name, &data, &len);
+    const struct rd_file *f;
+    if (!e) {
+        ok = editor_load(ed, data, len);
+        kfree(data);
+    } else if ((f = ramdisk_find(name))) {
+        ok = editor_load(ed, f->data, f->size);
+    } else {
+        ed->message = fat_strerror(e == FAT_NO_VOLUME ? FAT_NOT_FOUND : e);
+        return;
+    }
+
+    if (!ok) {
+        ed->message = fat_strerror(FAT_NO_MEMORY);
+        return;
+    }
+    strcpy(ed->file, name);
+    ed->message = "Opened";
+}
+
+/* ---------- public API ---------- */
+bool editor_init(struct editor *ed, const char *title, const char *ext)
+{
+    ed->buf = kmalloc(EDITOR_INITIAL_CAP);
+    ed->cap = ed->buf ? EDITOR_INITIAL_CAP : 0;
+    ed->gap_start = 0;
+    ed->gap_end = ed->cap;
+    ed->title = title;
+    ed->ext = ext;
+    ed->file[0] = '\0';
+    ed->message = NULL;
+    ed->line = 0;
+    ed->nlines = 1;
+    ed->goal_col = 0;
+    ed->top = ed->left = 0;
+    ed->saved_pos = NO_LINE;
+    ed->redraw = ED_ALL;
+    return ed->buf != NULL;
+}
+
+void editor_free(struct editor *ed)
+{
+    kfree(ed->buf);
+    ed->buf = NULL;
+    ed->cap = ed->gap_start = ed->gap_end = 0;
+}
+
+bool editor_load(struct editor *ed, const char *text, size_t len)
+{
+    if (!ed->buf) return false;
+    ed->gap_start = 0;
+    ed->gap_end = ed->cap;              /* empty: grow() has no tail to move */
+    while (ed->cap < len + 1)           /* the gap keeps a byte for the NUL */
+        if (!grow(ed)) return false;
+
+    /* the text goes after the gap, so the cursor starts at the top */
+    size_t keep = len;
+    for (size_t i = 0; i < len; ++i)
+        if (text[i] == '\r') keep--;
+    ed->gap_end = ed->cap - keep;
+    ed->nlines = 1;
+    char *out = ed->buf + ed->gap_end;
+    for (size_t i = 0; i < len; ++i) {
+        if (text[i] == '\r') continue;
+        if (text[i] == '\n') ed->nlines++;
+        *out++ = text[i];
+    }
+    ed->line = 0;
+    ed->goal_col = 0;
+    ed->top = ed->left = 0;
+    ed->saved_pos = NO_LINE;
+    ed->redraw = ED_ALL;
+    return true;
+}
+
+int editor_run(struct editor *ed)
+{
+    /* editor_text() parked the gap at the end: put the cursor back */
+    if (ed->saved_pos != NO_LINE) {
+        goto_pos(ed, ed->saved_pos);
+        ed->saved_pos = NO_LINE;
+    }
+
+    terminal_initialize();
+    terminal_set_autoflush(false);
+    ed->redraw = ED_ALL;
+
+    for (;;) {
+        render(ed);
+        char c = lazy_getchar();
+        ed->message = NULL;
+        if (c == EDITOR_RUN || c == EDITOR_EXIT) {
+            terminal_set_autoflush(true);
+            return c;
+        }
+        if (c == EDITOR_SAVE) save_file(ed);
+        else if (c == EDITOR_OPEN) open_file(ed);
+        else handle_key(ed, c);
+    }
+}
+
+const char *editor_text(struct editor *ed, size_t *len)
+{
+    if (ed->saved_pos == NO_LINE)
+        ed->saved_pos = ed->gap_start;
+    goto_pos(ed, text_len(ed));
+    ed->buf[ed->gap_start] = '\0';      /* the gap always keeps a byte */
+    *len = ed->gap_start;
+    return ed->buf;
+}
@@ -0,0 +1,53 @@
+/* editor.h  –  full-screen gap-buffer editor shared by QBASIC and WOG */
+#ifndef EDITOR_H
+#define EDITOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../fs/fat.h"
+
+#define EDITOR_RUN   0x12       /* Ctrl+R */
+#define EDITOR_EXIT  0x18       /* Ctrl+X */
+#define EDITOR_SAVE  0x13       /* Ctrl+S: to the FAT disk */
+#define EDITOR_OPEN  0x0F       /* Ctrl+O: from the FAT disk or the RAM disk */
+
+#define EDITOR_INITIAL_CAP 4096 /* doubles whenever the gap runs out */
+
+/* text is buf[0, gap_start) followed by buf[gap_end, cap); the cursor
+   sits at the gap, so typing and deleting there move no other bytes.
+   buf comes from kmalloc and grows on demand. */
+struct editor {
+    char  *buf;
+    size_t cap;
+    size_t gap_start, gap_end;
+    const char *title;
+    const char *ext;            /* added to a file name typed without one */
+    char file[FAT_NAME_LEN];    /* last opened or saved, "" for none */
+    const char *message;        /* on the status row until the next key */
+
+    size_t line, nlines;        /* cursor line, total lines (0-based / count) */
+    size_t goal_col;            /* column up/down try to return to */
+    size_t top, left;           /* first visible line and column */
+    size_t saved_pos;           /* cursor while editor_text() holds the gap */
+
+    size_t redraw_from;         /* first text line to repaint */
+    int    redraw;              /* ED_* below */
+};
+
+/* empty buffer; false if the first allocation fails */
+bool editor_init(struct editor *ed, const char *title, const char *ext);
+void editor_free(struct editor *ed);
+
+/* replace the text, cursor on the first line; CRs are dropped, so DOS
+   files read like ours.  False if out of memory. */
+bool editor_load(struct editor *ed, const char *text, size_t len);
+
+/* edit until Ctrl+R or Ctrl+X, returns EDITOR_RUN / EDITOR_EXIT; Ctrl+S
+   and Ctrl+O ask for a file name and are handled here */
+int editor_run(struct editor *ed);
+
+/* close the gap and NUL-terminate: the text is buf[0, *len) */
+const char *editor_text(struct editor *ed, size_t *len);
+
+#endif /* EDITOR_H */
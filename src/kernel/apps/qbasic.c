@@ -1,98 +1,500 @@
 #include "../io/vga.h"
-#include "../io/keyboard.h"
+#include "../core/syscall.h"
 #include "../lib/string.h"
 #include "../apps/qbasic.h"
+#include "../apps/editor.h"
+#include "../lib/arena.h"
+#include "../core/heap.h"
 #include <stdbool.h>
 
-#define MAX_LINES 100
-#define MAX_LINE_LEN 128
-#define MAX_VARS 50
-#define MAX_CODE_LEN 5000
-#define MAX_FOR_STACK 10
+/* tables below grow in the run arena; these only bound the encoding */
+#define ARENA_CHUNK 16000       /* fits a 4-page kmalloc block */
+#define MAX_VARS 0x7FFF         /* slot numbers are int16 in sym_hash */
+#define MIN_SLOTS 16            /* smallest table, hashes stay powers of two */
+#define MAX_INPUT_LEN 128       /* one INPUT line */
+#define MAX_BLOCKS 16          /* FOR/WHILE nesting */
+#define EVAL_STACK 32
+#define MAX_NEST   64           /* ( and unary -/+ in one expression */
 
-typedef enum { VAR_INT, VAR_STR } var_type;
+typedef enum { VAR_NONE, VAR_INT, VAR_STR } var_type;
 
+/* Compile-time name of a slot; the run loop only sees slot numbers */
 typedef struct {
     char name[32];
-    var_type type;
-    union {
-        int32_t int_val;
-        char str_val[128];
-    } val;
-} variable;
-
-/* Line entry: maps line number to code position */
+} symbol;
+
+/* Line entry: maps line number to code position and compiled code */
 typedef struct {
     int line_num;
     size_t code_pos;
+    int pc;                     /* first instruction of the line */
 } line_entry;
 
-/* FOR loop state */
+/* Sorted by line_num for binary search; idx points into qb.lines */
+typedef struct {
+    int line_num;
+    int idx;
+} line_ref;
+
+/* Open-addressed label hash, idx < 0 marks an empty slot */
+typedef struct {
+    char name[32];
+    int idx;
+} label_entry;
+
+/* ========== Bytecode ==========
+   A stack machine for integer expressions plus statement-level ops.
+   Variables are resolved to slot numbers and every jump to an
+   instruction index while compiling, so the run loop never looks at
+   source text. */
+enum {
+    OP_END,
+    OP_PUSH_INT,        /* push imm */
+    OP_PUSH_VAR,        /* push ints[a] (0 unless VAR_INT) */
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD,
+    OP_NEG,
+    OP_CMP,             /* arg = relop, pushes -1 / 0 */
+    OP_STR_CMP,         /* vars[a] arg= string at pool+imm, pushes -1 / 0 */
+    OP_VAR_CMP,         /* vars[a] arg= vars[b] by type and value, pushes -1 / 0 */
+    OP_STORE,           /* vars[a] = pop */
+    OP_LET_STR,         /* vars[a] = string at pool+imm */
+    OP_COPY,            /* vars[a] = vars[b], keeps the type */
+    OP_PRINT_STR,       /* string at pool+imm */
+    OP_PRINT_VAR,       /* vars[a] by its type, "?" if never set */
+    OP_PRINT_INT,       /* pop */
+    OP_PRINT_TAB,
+    OP_PRINT_NL,
+    OP_INPUT,           /* vars[a], arg = INPUT_* flags */
+    OP_JMP,             /* pc = imm */
+    OP_JZ,              /* if (pop == 0) pc = imm */
+    OP_GOTO,            /* unresolved JMP: arg = GOTO_*, b = source line */
+    OP_FOR_CHECK,       /* a = loop var, b = limit (b+1 step), exit to imm */
+    OP_NEXT,            /* a += step, loop back to imm while in range */
+};
+
+enum { REL_EQ, REL_NE, REL_LT, REL_GT, REL_LE, REL_GE };
+
+#define INPUT_PROMPT   1        /* print "? " first */
+#define INPUT_STRING   2        /* name$: always a string */
+#define GOTO_LINE      0        /* imm = line number */
+#define GOTO_LABEL     1        /* imm = label name in the string pool */
+#define LOOP_UNIT_STEP 1        /* FOR without STEP: step is 1 */
+
 typedef struct {
-    char var_name[32];
-    int32_t to_val;
-    size_t loop_start_pos;
-    int depth;
-} for_loop_state;
+    uint8_t  op;
+    uint8_t  arg;               /* relop / flags */
+    uint16_t a;                 /* variable index */
+    uint16_t b;                 /* second variable index / source line */
+    int32_t  imm;               /* constant, pool offset or jump target */
+} qb_insn;
 
 typedef struct {
-    char code[MAX_CODE_LEN];
+    const char *code;           /* NUL-terminated, owned by the caller */
     size_t code_len;
-    variable vars[MAX_VARS];
-    int var_count;
-    
-    line_entry lines[MAX_LINES];
-    int line_count;
-    
-    for_loop_state for_stack[MAX_FOR_STACK];
-    int for_depth;
-    
-    size_t exec_pos;  /* current execution position */
+
+    /* symbols: names hashed to slot numbers, used only while compiling */
+    symbol *syms;
+    int16_t *sym_hash;                  /* slot number, -1 = empty */
+    int var_count, var_cap, sym_slots;
+
+    /* values by slot: ints[] stays dense and hot, strings live apart.
+       ints[v] is 0 whenever types[v] != VAR_INT. */
+    int32_t *ints;
+    uint8_t *types;
+    char **strs;
+    uint32_t *str_caps;                 /* strs[v] only ever grows */
+
+    line_entry *lines;
+    int line_count, line_cap;
+    line_ref *line_order;
+    label_entry *labels;
+    int label_slots;
+
+    qb_insn *prog;
+    int prog_len, prog_cap;
+    char *strpool;
+    int strpool_len, strpool_cap;
 } qbasic_state;
 
+/* everything in qb except code lives here and goes with one reset */
 static qbasic_state qb;
-static char editor_buf[MAX_CODE_LEN];
-static size_t editor_pos = 0;
+static struct arena arena;
+static struct editor editor;
+static char *saved;             /* the program from the last editor session */
+static bool busy;               /* qb and the arena serve one run at a time */
+
+/* programs run in ring 3: all I/O is a system call */
+static void print_str(const char *s) { sys_write(s, strlen(s)); }
+static void print_char(char c) { sys_write(&c, 1); }
+static void print_nl(void) { print_char('\n'); }
+
+static void set_color(uint8_t color) { sys_setcolor(color); }
+
+/* ========== Parsing utilities ========== */
+static int32_t parse_int(const char *s)
+{
+    int32_t val = 0;
+    bool neg = false;
+    if (*s == '-') { neg = true; s++; }
+    while (*s >= '0' && *s <= '9') {
+        val = val * 10 + (*s - '0');
+        s++;
+    }
+    return neg ? -val : val;
+}
+
+static void int_to_str(int32_t num, char *buf)
+{
+    if (num == 0) { strcpy(buf, "0"); return; }
+    bool neg = num < 0;
+    uint32_t u = neg ? -(uint32_t)num : (uint32_t)num;
+    char tmp[32];
+    int i = 0;
+    while (u > 0) {
+        tmp[i++] = '0' + (u % 10);
+        u /= 10;
+    }
+    if (neg) tmp[i++] = '-';
+    tmp[i] = '\0';
+    for (int j = 0; j < i; j++) buf[j] = tmp[i - 1 - j];
+    buf[i] = '\0';
+}
+
+static char* trim_start(char *s)
+{
+    while (*s == ' ' || *s == '\t') s++;
+    return s;
+}
+
+static bool is_number(const char *s)
+{
+    char *t = trim_start((char*)s);
+    if (*t == '-') t++;
+    int digits = 0;
+    while (*t >= '0' && *t <= '9') { digits++; t++; }
+    return digits > 0;
+}
+
+static void error_line(int line, const char *msg, const char *detail)
+{
+    char buf[16];
+    set_color(VGA_COLOR_RED);
+    print_str("QBASIC ERROR");
+    if (line >= 0) {
+        print_str(" (line ");
+        int_to_str(line + 1, buf);
+        print_str(buf);
+        print_str(")");
+    }
+    print_str(": ");
+    print_str(msg);
+    if (detail) print_str(detail);
+    print_nl();
+    set_color(VGA_COLOR_LIGHT_GREY);
+}
+
+/* ========== Lexer ========== */
+static const struct { const char *name; Keyword kw; } keywords[] = {
+    {"PRINT", KW_PRINT}, {"INPUT", KW_INPUT}, {"IF", KW_IF},
+    {"THEN", KW_THEN},   {"ELSE", KW_ELSE},   {"FOR", KW_FOR},
+    {"TO", KW_TO},       {"NEXT", KW_NEXT},   {"WHILE", KW_WHILE},
+    {"WEND", KW_WEND},   {"DIM", KW_DIM},     {"END", KW_END},
+    {"LET", KW_LET},     {"GOTO", KW_GOTO},   {"STEP", KW_STEP},
+    {"MOD", KW_MOD},     {"REM", KW_REM},
+};
+
+static bool is_alpha(char c) { return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_'; }
+static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+static bool keyword_eq(const char *kw, const char *word)
+{
+    for (; *kw; ++kw, ++word) {
+        char c = *word;
+        if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+        if (c != *kw) return false;
+    }
+    return *word == '\0';
+}
+
+/* One token starting at code[*pos].  Lines end at '\n', '\0' or a
+   ' comment, all of which come back as TOKEN_EOF without being consumed. */
+Token qbasic_next_token(const char* code, int* pos)
+{
+    Token t;
+    t.type = TOKEN_EOF;
+    t.keyword = KW_PRINT;
+    t.value[0] = '\0';
+    t.numValue = 0;
+
+    int p = *pos;
+    while (code[p] == ' ' || code[p] == '\t' || code[p] == '\r') p++;
+    char c = code[p];
+
+    if (c == '\0' || c == '\n' || c == '\'') {
+        *pos = p;
+        return t;
+    }
+
+    size_t n = 0;
+    if (is_digit(c)) {
+        t.type = TOKEN_NUMBER;
+        while (is_digit(code[p])) {
+            t.numValue = t.numValue * 10 + (code[p] - '0');
+            if (n < sizeof(t.value) - 1) t.value[n++] = code[p];
+            p++;
+        }
+    } else if (is_alpha(c)) {
+        t.type = TOKEN_IDENTIFIER;
+        while (is_alpha(code[p]) || is_digit(code[p])) {
+            if (n < 31) t.value[n++] = code[p];
+            p++;
+        }
+        if (code[p] == '$') { if (n < 31) t.value[n++] = '$'; p++; }
+        t.value[n] = '\0';
+        for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); ++i) {
+            if (keyword_eq(keywords[i].name, t.value)) {
+                t.type = TOKEN_KEYWORD;
+                t.keyword = keywords[i].kw;
+                break;
+            }
+        }
+    } else if (c == '"') {
+        t.type = TOKEN_STRING;
+        p++;
+        while (code[p] && code[p] != '"' && code[p] != '\n') {
+            if (n < sizeof(t.value) - 1) t.value[n++] = code[p];
+            p++;
+        }
+        if (code[p] == '"') p++;
+    } else {
+        p++;
+        switch (c) {
+        case '(': t.type = TOKEN_LPAREN;    break;
+        case ')': t.type = TOKEN_RPAREN;    break;
+        case ',': t.type = TOKEN_COMMA;     break;
+        case ':': t.type = TOKEN_COLON;     break;
+        case ';': t.type = TOKEN_SEMICOLON; break;
+        default:
+            t.type = TOKEN_OPERATOR;
+            t.value[n++] = c;
+            if ((c == '<' && (code[p] == '=' || code[p] == '>')) ||
+                (c == '>' && code[p] == '='))
+                t.value[n++] = code[p++];
+            break;
+        }
+    }
+    t.value[n] = '\0';
+    *pos = p;
+    return t;
+}
+
+/* ========== Growable tables ========== */
+/* capacity for need elements: doubling from MIN_SLOTS, a power of two */
+static int next_cap(int cap, int need)
+{
+    if (!cap) cap = MIN_SLOTS;
+    while (cap < need) cap *= 2;
+    return cap;
+}
+
+/* arr resized from old to n elements, the new ones zeroed;
+   NULL (arr untouched) when out of memory */
+static void *resize(void *arr, int old, int n, size_t elem)
+{
+    char *p = arena_realloc(&arena, arr, (size_t)old * elem, (size_t)n * elem);
+    if (p && n > old)
+        memset(p + (size_t)old * elem, 0, (size_t)(n - old) * elem);
+    return p;
+}
+
+/* drop the previous run's tables in O(1); the chunks stay for this one */
+static void reset_tables(void)
+{
+    const char *code = qb.code;
+    size_t code_len = qb.code_len;
+    arena_reset(&arena);
+    memset(&qb, 0, sizeof(qb));
+    qb.code = code;
+    qb.code_len = code_len;
+}
+
+/* ========== Variable management (compile time) ========== */
+/* FNV-1a */
+static uint32_t hash_name(const char *s)
+{
+    uint32_t h = 2166136261U;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+static int16_t *sym_bucket(const char *name)
+{
+    uint32_t mask = qb.sym_slots - 1;
+    uint32_t i = hash_name(name) & mask;
+    while (qb.sym_hash[i] >= 0 && strcmp(qb.syms[qb.sym_hash[i]].name, name))
+        i = (i + 1) & mask;
+    return &qb.sym_hash[i];
+}
+
+static int find_var(const char *name)
+{
+    return *sym_bucket(name);
+}
+
+/* the per-slot arrays grow together; var_cap only moves once all did */
+static bool grow_vars(void)
+{
+    int cap = next_cap(qb.var_cap, qb.var_count + 1);
+    symbol *syms = resize(qb.syms, qb.var_cap, cap, sizeof(*syms));
+    if (syms) qb.syms = syms;
+    int32_t *ints = resize(qb.ints, qb.var_cap, cap, sizeof(*ints));
+    if (ints) qb.ints = ints;
+    uint8_t *types = resize(qb.types, qb.var_cap, cap, sizeof(*types));
+    if (types) qb.types = types;
+    char **strs = resize(qb.strs, qb.var_cap, cap, sizeof(*strs));
+    if (strs) qb.strs = strs;
+    uint32_t *str_caps = resize(qb.str_caps, qb.var_cap, cap, sizeof(*str_caps));
+    if (str_caps) qb.str_caps = str_caps;
+
+    if (!syms || !ints || !types || !strs || !str_caps) return false;
+    qb.var_cap = cap;
+    return true;
+}
+
+/* keep the hash at most half full: double it and reinsert
+   (the old table stays in the arena until the next reset) */
+static bool grow_sym_hash(void)
+{
+    int slots = qb.sym_slots * 2;
+    int16_t *h = arena_alloc(&arena, slots * sizeof(*h));
+    if (!h) return false;
+    qb.sym_hash = h;
+    qb.sym_slots = slots;
+    for (int i = 0; i < slots; i++)
+        h[i] = -1;
+    for (int v = 0; v < qb.var_count; v++)
+        *sym_bucket(qb.syms[v].name) = (int16_t)v;
+    return true;
+}
 
-static void print_str(const char *s) { terminal_writestring(s); }
-static void print_char(char c) { terminal_putchar(c); }
-static void print_nl(void) { terminal_putchar('\n'); }
+static int create_var(const char *name)
+{
+    if (qb.var_count >= MAX_VARS) return -1;
+    if (qb.var_count == qb.var_cap && !grow_vars()) return -1;
+    if ((qb.var_count + 1) * 2 > qb.sym_slots && !grow_sym_hash()) return -1;
+    int16_t *b = sym_bucket(name);
+    strcpy(qb.syms[qb.var_count].name, name);
+    *b = (int16_t)qb.var_count;
+    return qb.var_count++;
+}
+
+static bool clear_symbols(void)
+{
+    qb.var_count = 0;
+    if (!qb.sym_hash) {
+        qb.sym_hash = arena_alloc(&arena, MIN_SLOTS * sizeof(*qb.sym_hash));
+        if (!qb.sym_hash) return false;
+        qb.sym_slots = MIN_SLOTS;
+    }
+    for (int i = 0; i < qb.sym_slots; i++)
+        qb.sym_hash[i] = -1;
+    return true;
+}
 
-static void set_color(uint8_t color) { terminal_setcolor(color); }
+/* ========== Line parsing (scan for line numbers) ========== */
+/* slot holding name, or the empty slot where it would go */
+static label_entry *label_slot(const char *name)
+{
+    uint32_t mask = qb.label_slots - 1;
+    uint32_t i = hash_name(name) & mask;
+    while (qb.labels[i].idx >= 0 && strcmp(qb.labels[i].name, name))
+        i = (i + 1) & mask;
+    return &qb.labels[i];
+}
 
-/* ========== Variable management ========== */
-static variable* find_var(const char *name)
+/* keep line_order sorted; equal numbers stay in source order so the
+   first such line wins, as it always did */
+static void index_line_number(int idx)
 {
-    for (int i = 0; i < qb.var_count; i++) {
-        if (!strcmp(qb.vars[i].name, name)) return &qb.vars[i];
+    int num = qb.lines[idx].line_num;
+    int i = idx;
+    while (i > 0 && qb.line_order[i - 1].line_num > num) {
+        qb.line_order[i] = qb.line_order[i - 1];
+        i--;
     }
-    return NULL;
+    qb.line_order[i].line_num = num;
+    qb.line_order[i].idx = idx;
+}
+
+/* "label:" at the start of a line, after an optional line number */
+static void index_label(int idx)
+{
+    int pos = (int)qb.lines[idx].code_pos;
+    Token t = qbasic_next_token(qb.code, &pos);
+    if (t.type == TOKEN_NUMBER) t = qbasic_next_token(qb.code, &pos);
+    if (t.type != TOKEN_IDENTIFIER) return;
+    if (qbasic_next_token(qb.code, &pos).type != TOKEN_COLON) return;
+
+    label_entry *e = label_slot(t.value);
+    if (e->idx >= 0) return;            /* first definition wins */
+    strcpy(e->name, t.value);
+    e->idx = idx;
 }
 
-static variable* create_var(const char *name, var_type type)
+/* one entry per '\n' plus the last line: size the tables up front.
+   Only a line with a ':' can hold a label, so those size the hash. */
+static bool size_line_tables(void)
 {
-    if (qb.var_count >= MAX_VARS) return NULL;
-    variable *v = &qb.vars[qb.var_count++];
-    strcpy(v->name, name);
-    v->type = type;
-    if (type == VAR_INT) v->val.int_val = 0;
-    else v->val.str_val[0] = '\0';
-    return v;
+    int n = 1, colons = 0;
+    bool colon = false;
+    for (size_t i = 0; i < qb.code_len; i++) {
+        if (qb.code[i] == ':') colon = true;
+        if (qb.code[i] == '\n') {
+            n++;
+            colons += colon;
+            colon = false;
+        }
+    }
+    colons += colon;
+
+    if (n > qb.line_cap) {
+        int cap = next_cap(qb.line_cap, n);
+        line_entry *lines = resize(qb.lines, qb.line_cap, cap, sizeof(*lines));
+        if (lines) qb.lines = lines;
+        line_ref *order = resize(qb.line_order, qb.line_cap, cap, sizeof(*order));
+        if (order) qb.line_order = order;
+        if (!lines || !order) return false;
+        qb.line_cap = cap;
+    }
+    if (2 * colons > qb.label_slots || !qb.labels) {
+        int slots = next_cap(qb.label_slots, 2 * colons);
+        label_entry *labels = resize(qb.labels, qb.label_slots, slots, sizeof(*labels));
+        if (!labels) return false;
+        qb.labels = labels;
+        qb.label_slots = slots;
+    }
+    return true;
 }
 
-/* ========== Line parsing (scan for line numbers and labels) ========== */
-static void parse_line_map(void)
+static bool parse_line_map(void)
 {
     qb.line_count = 0;
     size_t pos = 0;
-    
-    while (pos < qb.code_len && qb.line_count < MAX_LINES) {
+
+    if (!size_line_tables()) return false;
+    for (int i = 0; i < qb.label_slots; i++)
+        qb.labels[i].idx = -1;
+
+    while (pos < qb.code_len) {
         /* Skip leading whitespace */
         while (pos < qb.code_len && (qb.code[pos] == ' ' || qb.code[pos] == '\t')) pos++;
-        
+
         /* Record this position */
         size_t line_start = pos;
-        
+
         /* Check if it starts with a number (line number) */
         int line_num = 0;
         if (pos < qb.code_len && qb.code[pos] >= '0' && qb.code[pos] <= '9') {
@@ -103,126 +505,634 @@ static void parse_line_map(void)
         } else {
             line_num = qb.line_count;  /* auto-assign */
         }
-        
+
         qb.lines[qb.line_count].line_num = line_num;
         qb.lines[qb.line_count].code_pos = line_start;
+        qb.lines[qb.line_count].pc = 0;
+        index_line_number(qb.line_count);
+        index_label(qb.line_count);
         qb.line_count++;
-        
+
         /* Skip to end of line */
         while (pos < qb.code_len && qb.code[pos] != '\n') pos++;
         if (pos < qb.code_len && qb.code[pos] == '\n') pos++;
     }
+    return true;
+}
+
+static int find_line_by_number(int line_num)
+{
+    int lo = 0, hi = qb.line_count;     /* first entry >= line_num */
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (qb.line_order[mid].line_num < line_num) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo < qb.line_count && qb.line_order[lo].line_num == line_num)
+        return qb.line_order[lo].idx;
+    return -1;
+}
+
+/* Find the line that starts with "label:" */
+static int find_label(const char *label_name)
+{
+    return label_slot(label_name)->idx;
+}
+
+/* ========== Compiler ========== */
+typedef struct {
+    bool is_for;
+    int var, limit;             /* FOR: loop var, limit slot (+1 = step) */
+    bool unit_step;
+    int head;                   /* FOR: its FOR_CHECK, WHILE: loop top */
+    int exit_jump;              /* WHILE: its JZ */
+} block;
+
+typedef struct {
+    int pos;                    /* lexer position in qb.code */
+    Token tok;                  /* current token */
+    int line;                   /* source line being compiled */
+    bool failed;
+    int depth, max_depth;       /* eval stack use */
+    int nest;                   /* parse_unary recursion */
+    block blocks[MAX_BLOCKS];
+    int nblocks;
+} parser;
+
+static void next(parser *p) { p->tok = qbasic_next_token(qb.code, &p->pos); }
+
+static Token peek(parser *p)
+{
+    int pos = p->pos;
+    return qbasic_next_token(qb.code, &pos);
+}
+
+static bool is_kw(parser *p, Keyword k) { return p->tok.type == TOKEN_KEYWORD && p->tok.keyword == k; }
+static bool is_op(parser *p, const char *op) { return p->tok.type == TOKEN_OPERATOR && !strcmp(p->tok.value, op); }
+
+static bool at_stmt_end(parser *p)
+{
+    return p->tok.type == TOKEN_EOF || p->tok.type == TOKEN_COLON || is_kw(p, KW_ELSE);
+}
+
+static void syntax_error(parser *p, const char *msg, const char *detail)
+{
+    if (p->failed) return;
+    p->failed = true;
+    error_line(p->line, msg, detail);
+}
+
+static int emit(parser *p, uint8_t op, uint8_t arg, int a, int b, int32_t imm)
+{
+    if (p->failed) return 0;
+    if (qb.prog_len == qb.prog_cap) {
+        int cap = next_cap(qb.prog_cap, qb.prog_len + 1);
+        qb_insn *prog = resize(qb.prog, qb.prog_cap, cap, sizeof(*prog));
+        if (!prog) {
+            syntax_error(p, "Out of memory", NULL);
+            return 0;
+        }
+        qb.prog = prog;
+        qb.prog_cap = cap;
+    }
+
+    /* track eval stack depth */
+    switch (op) {
+    case OP_PUSH_INT: case OP_PUSH_VAR: case OP_STR_CMP: case OP_VAR_CMP: p->depth++; break;
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_MOD:
+    case OP_CMP: case OP_STORE: case OP_PRINT_INT: case OP_JZ: p->depth--; break;
+    }
+    if (p->depth > p->max_depth) p->max_depth = p->depth;
+    if (p->depth > EVAL_STACK) syntax_error(p, "Expression too complex", NULL);
+
+    qb_insn *in = &qb.prog[qb.prog_len];
+    in->op  = op;
+    in->arg = arg;
+    in->a   = (uint16_t)a;
+    in->b   = (uint16_t)b;
+    in->imm = imm;
+    return qb.prog_len++;
+}
+
+static int32_t pool_add(parser *p, const char *s)
+{
+    int n = (int)strlen(s) + 1;
+    if (qb.strpool_len + n > qb.strpool_cap) {
+        int cap = next_cap(qb.strpool_cap, qb.strpool_len + n);
+        char *pool = resize(qb.strpool, qb.strpool_cap, cap, 1);
+        if (!pool) {
+            syntax_error(p, "Out of memory", NULL);
+            return 0;
+        }
+        qb.strpool = pool;
+        qb.strpool_cap = cap;
+    }
+    memcpy(qb.strpool + qb.strpool_len, s, n);
+    qb.strpool_len += n;
+    return (int32_t)(qb.strpool_len - n);
+}
+
+static int var_index(parser *p, const char *name)
+{
+    int v = find_var(name);
+    if (v < 0) v = create_var(name);
+    if (v < 0) syntax_error(p, "Out of memory for variables", NULL);
+    return v < 0 ? 0 : v;
+}
+
+/* name$ only ever holds text */
+static bool is_str_name(const char *name)
+{
+    return name[strlen(name) - 1] == '$';
+}
+
+/* ---- expressions: precedence climbing over int values ---- */
+static void parse_expr(parser *p, int min_prec);
+
+static void parse_primary(parser *p)
+{
+    if (p->tok.type == TOKEN_NUMBER) {
+        emit(p, OP_PUSH_INT, 0, 0, 0, p->tok.numValue);
+        next(p);
+    } else if (p->tok.type == TOKEN_IDENTIFIER) {
+        /* ints[] reads a string as 0, so A$ + 1 or A$ < B$ are errors */
+        if (is_str_name(p->tok.value)) {
+            syntax_error(p, "Type mismatch: ", p->tok.value);
+            return;
+        }
+        emit(p, OP_PUSH_VAR, 0, var_index(p, p->tok.value), 0, 0);
+        next(p);
+    } else if (p->tok.type == TOKEN_LPAREN) {
+        next(p);
+        parse_expr(p, 1);
+        if (p->tok.type != TOKEN_RPAREN) syntax_error(p, "Expected )", NULL);
+        next(p);
+    } else {
+        syntax_error(p, "Expected expression", NULL);
+    }
 }
 
-static size_t find_line_by_number(int line_num)
+/* every ( and every prefix sign recurses through here, and neither
+   uses the eval stack, so the C stack is what nest keeps bounded */
+static void parse_unary(parser *p)
 {
-    for (int i = 0; i < qb.line_count; i++) {
-        if (qb.lines[i].line_num == line_num) {
-            return qb.lines[i].code_pos;
+    if (p->nest >= MAX_NEST) {
+        syntax_error(p, "Expression too complex", NULL);
+        return;
+    }
+    p->nest++;
+    if (is_op(p, "-")) {
+        next(p);
+        parse_unary(p);
+        /* fold -constant */
+        if (!p->failed && qb.prog_len > 0 && qb.prog[qb.prog_len - 1].op == OP_PUSH_INT)
+            qb.prog[qb.prog_len - 1].imm = -qb.prog[qb.prog_len - 1].imm;
+        else
+            emit(p, OP_NEG, 0, 0, 0, 0);
+    } else if (is_op(p, "+")) {
+        next(p);
+        parse_unary(p);
+    } else {
+        parse_primary(p);
+    }
+    p->nest--;
+}
+
+/* 0 = not a binary operator */
+static int binop(parser *p, uint8_t *op, uint8_t *arg)
+{
+    static const struct { const char *s; uint8_t op, arg; int prec; } ops[] = {
+        {"=",  OP_CMP, REL_EQ, 1}, {"<>", OP_CMP, REL_NE, 1},
+        {"<",  OP_CMP, REL_LT, 1}, {">",  OP_CMP, REL_GT, 1},
+        {"<=", OP_CMP, REL_LE, 1}, {">=", OP_CMP, REL_GE, 1},
+        {"+",  OP_ADD, 0, 2},      {"-",  OP_SUB, 0, 2},
+        {"*",  OP_MUL, 0, 3},      {"/",  OP_DIV, 0, 3},
+    };
+    if (is_kw(p, KW_MOD)) { *op = OP_MOD; *arg = 0; return 3; }
+    if (p->tok.type != TOKEN_OPERATOR) return 0;
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); ++i) {
+        if (!strcmp(p->tok.value, ops[i].s)) {
+            *op = ops[i].op; *arg = ops[i].arg;
+            return ops[i].prec;
         }
     }
     return 0;
 }
 
-/* Find label in code */
-static size_t find_label(const char *label_name)
+static void parse_expr(parser *p, int min_prec)
 {
-    size_t pos = 0;
-    while (pos < qb.code_len) {
-        /* Skip whitespace and line numbers */
-        while (pos < qb.code_len && (qb.code[pos] == ' ' || qb.code[pos] == '\t')) pos++;
-        while (pos < qb.code_len && qb.code[pos] >= '0' && qb.code[pos] <= '9') pos++;
-        while (pos < qb.code_len && (qb.code[pos] == ' ' || qb.code[pos] == '\t')) pos++;
-        
-        /* Check for label: (must be followed by ':') */
-        if (pos < qb.code_len && qb.code[pos] >= 'A' && qb.code[pos] <= 'Z') {
-            char potential_label[32];
-            size_t lpos = 0;
-            size_t check_pos = pos;
-            while (check_pos < qb.code_len && lpos < 31 && 
-                   ((qb.code[check_pos] >= 'A' && qb.code[check_pos] <= 'Z') ||
-                    (qb.code[check_pos] >= '0' && qb.code[check_pos] <= '9'))) {
-                potential_label[lpos++] = qb.code[check_pos++];
+    parse_unary(p);
+    while (!p->failed) {
+        uint8_t op, arg;
+        int prec = binop(p, &op, &arg);
+        if (prec == 0 || prec < min_prec) break;
+        next(p);
+        parse_expr(p, prec + 1);
+        emit(p, op, arg, 0, 0, 0);
+    }
+}
+
+/* IF/WHILE condition: int expression, or  name$ = "text" / name$ = other$
+   (also <>) */
+static void parse_condition(parser *p)
+{
+    if (p->tok.type == TOKEN_IDENTIFIER) {
+        int pos = p->pos;
+        Token rel = qbasic_next_token(qb.code, &pos);
+        Token rhs = qbasic_next_token(qb.code, &pos);
+        if (rel.type == TOKEN_OPERATOR &&
+            (!strcmp(rel.value, "=") || !strcmp(rel.value, "<>"))) {
+            uint8_t relop = rel.value[0] == '=' ? REL_EQ : REL_NE;
+            if (rhs.type == TOKEN_STRING) {
+                int v = var_index(p, p->tok.value);
+                emit(p, OP_STR_CMP, relop, v, 0, pool_add(p, rhs.value));
+                next(p); next(p); next(p);
+                return;
             }
-            potential_label[lpos] = '\0';
-            
-            check_pos = pos + lpos;
-            while (check_pos < qb.code_len && (qb.code[check_pos] == ' ' || qb.code[check_pos] == '\t')) check_pos++;
-            
-            if (check_pos < qb.code_len && qb.code[check_pos] == ':' && !strcmp(potential_label, label_name)) {
-                return pos;
+            if (rhs.type == TOKEN_IDENTIFIER &&
+                (is_str_name(p->tok.value) || is_str_name(rhs.value))) {
+                int v = var_index(p, p->tok.value);
+                emit(p, OP_VAR_CMP, relop, v, var_index(p, rhs.value), 0);
+                next(p); next(p); next(p);
+                return;
             }
         }
-        
-        /* Skip to next line */
-        while (pos < qb.code_len && qb.code[pos] != '\n') pos++;
-        if (pos < qb.code_len && qb.code[pos] == '\n') pos++;
     }
-    return 0;
+    parse_expr(p, 1);
 }
 
-/* ========== Parsing utilities ========== */
-static int32_t parse_int(const char *s)
+/* ---- statements ---- */
+static void compile_statements(parser *p);
+
+static void compile_print(parser *p)
 {
-    int32_t val = 0;
-    bool neg = false;
-    if (*s == '-') { neg = true; s++; }
-    while (*s >= '0' && *s <= '9') {
-        val = val * 10 + (*s - '0');
-        s++;
+    bool newline = true;
+    while (!at_stmt_end(p) && !p->failed) {
+        newline = true;
+        if (p->tok.type == TOKEN_COMMA) {
+            emit(p, OP_PRINT_TAB, 0, 0, 0, 0);
+            next(p);
+            continue;
+        }
+        if (p->tok.type == TOKEN_SEMICOLON) {
+            newline = false;
+            next(p);
+            continue;
+        }
+        if (p->tok.type == TOKEN_STRING) {
+            emit(p, OP_PRINT_STR, 0, 0, 0, pool_add(p, p->tok.value));
+            next(p);
+        } else if (p->tok.type == TOKEN_IDENTIFIER) {
+            Token t = peek(p);
+            if (t.type == TOKEN_EOF || t.type == TOKEN_COMMA ||
+                t.type == TOKEN_SEMICOLON || t.type == TOKEN_COLON ||
+                (t.type == TOKEN_KEYWORD && t.keyword == KW_ELSE)) {
+                emit(p, OP_PRINT_VAR, 0, var_index(p, p->tok.value), 0, 0);
+                next(p);
+            } else {
+                parse_expr(p, 1);
+                emit(p, OP_PRINT_INT, 0, 0, 0, 0);
+            }
+        } else {
+            parse_expr(p, 1);
+            emit(p, OP_PRINT_INT, 0, 0, 0, 0);
+        }
+        /* a trailing ';' keeps the cursor on the line */
+        if (p->tok.type == TOKEN_SEMICOLON) {
+            Token t = peek(p);
+            newline = !(t.type == TOKEN_EOF || t.type == TOKEN_COLON);
+        }
     }
-    return neg ? -val : val;
+    if (newline) emit(p, OP_PRINT_NL, 0, 0, 0, 0);
 }
 
-static void int_to_str(int32_t num, char *buf)
+static void compile_let(parser *p)
 {
-    if (num == 0) { strcpy(buf, "0"); return; }
-    bool neg = num < 0;
-    if (neg) num = -num;
-    char tmp[32];
-    int i = 0;
-    while (num > 0) {
-        tmp[i++] = '0' + (num % 10);
-        num /= 10;
+    if (p->tok.type != TOKEN_IDENTIFIER) {
+        syntax_error(p, "Expected variable", NULL);
+        return;
     }
-    if (neg) tmp[i++] = '-';
-    tmp[i] = '\0';
-    for (int j = 0; j < i; j++) buf[j] = tmp[i - 1 - j];
-    buf[i] = '\0';
+    int v = var_index(p, p->tok.value);
+    next(p);
+    if (!is_op(p, "=")) {
+        syntax_error(p, "Expected =", NULL);
+        return;
+    }
+    next(p);
+
+    if (p->tok.type == TOKEN_STRING) {
+        emit(p, OP_LET_STR, 0, v, 0, pool_add(p, p->tok.value));
+        next(p);
+        return;
+    }
+    if (p->tok.type == TOKEN_IDENTIFIER) {
+        Token t = peek(p);
+        if (t.type == TOKEN_EOF || t.type == TOKEN_COLON ||
+            (t.type == TOKEN_KEYWORD && t.keyword == KW_ELSE)) {
+            emit(p, OP_COPY, 0, v, var_index(p, p->tok.value), 0);
+            next(p);
+            return;
+        }
+    }
+    parse_expr(p, 1);
+    emit(p, OP_STORE, 0, v, 0, 0);
 }
 
-static char* trim_start(char *s)
+static void compile_input(parser *p)
 {
-    while (*s == ' ' || *s == '\t') s++;
-    return s;
+    uint8_t prompt = INPUT_PROMPT;
+    if (p->tok.type == TOKEN_STRING) {
+        emit(p, OP_PRINT_STR, 0, 0, 0, pool_add(p, p->tok.value));
+        next(p);
+        /* INPUT "x"; v adds "? ", INPUT "x", v does not */
+        if (p->tok.type == TOKEN_COMMA) prompt = 0;
+        else if (p->tok.type != TOKEN_SEMICOLON) {
+            syntax_error(p, "Expected , or ; after prompt", NULL);
+            return;
+        }
+        next(p);
+    }
+    for (;;) {
+        if (p->tok.type != TOKEN_IDENTIFIER) {
+            syntax_error(p, "Expected variable", NULL);
+            return;
+        }
+        uint8_t flags = prompt | (is_str_name(p->tok.value) ? INPUT_STRING : 0);
+        emit(p, OP_INPUT, flags, var_index(p, p->tok.value), 0, 0);
+        next(p);
+        if (p->tok.type != TOKEN_COMMA) break;
+        next(p);
+    }
 }
 
-static char* extract_token(char *line, char *token, size_t max)
+/* GOTO target or the line number after THEN / ELSE */
+static void compile_goto(parser *p)
 {
-    line = trim_start(line);
-    size_t i = 0;
-    while (i < max - 1 && *line && *line != ' ' && *line != '\t' && *line != '=' && 
-           *line != '"' && *line != ',' && *line != ':') {
-        token[i++] = *line++;
+    if (p->tok.type == TOKEN_NUMBER) {
+        emit(p, OP_GOTO, GOTO_LINE, 0, p->line, p->tok.numValue);
+    } else if (p->tok.type == TOKEN_IDENTIFIER) {
+        emit(p, OP_GOTO, GOTO_LABEL, 0, p->line, pool_add(p, p->tok.value));
+    } else {
+        syntax_error(p, "Expected line number or label", NULL);
+        return;
     }
-    token[i] = '\0';
-    return line;
+    next(p);
 }
 
-static bool is_number(const char *s)
+static void compile_if(parser *p)
 {
-    char *t = trim_start((char*)s);
-    if (*t == '-') t++;
-    int digits = 0;
-    while (*t >= '0' && *t <= '9') { digits++; t++; }
-    return digits > 0;
+    parse_condition(p);
+    if (!is_kw(p, KW_THEN)) {
+        syntax_error(p, "IF without THEN", NULL);
+        return;
+    }
+    next(p);
+    int jz = emit(p, OP_JZ, 0, 0, 0, 0);
+    if (p->tok.type == TOKEN_NUMBER) compile_goto(p);
+    else compile_statements(p);
+
+    if (is_kw(p, KW_ELSE)) {
+        next(p);
+        int jmp = emit(p, OP_JMP, 0, 0, 0, 0);
+        qb.prog[jz].imm = qb.prog_len;
+        if (p->tok.type == TOKEN_NUMBER) compile_goto(p);
+        else compile_statements(p);
+        qb.prog[jmp].imm = qb.prog_len;
+    } else {
+        qb.prog[jz].imm = qb.prog_len;
+    }
+}
+
+/* hidden limit/step slots, one pair per nesting depth */
+static int loop_slots(parser *p, int depth)
+{
+    char name[4] = { '\x01', 'L', (char)('A' + depth), '\0' };
+    int lim = find_var(name);
+    if (lim >= 0) return lim;
+    lim = var_index(p, name);
+    name[1] = 'S';
+    var_index(p, name);         /* created right after: index lim + 1 */
+    return lim;
+}
+
+static block *push_block(parser *p)
+{
+    if (p->nblocks >= MAX_BLOCKS) {
+        syntax_error(p, "Loops nested too deep", NULL);
+        return NULL;
+    }
+    return &p->blocks[p->nblocks++];
+}
+
+static void compile_for(parser *p)
+{
+    if (p->tok.type != TOKEN_IDENTIFIER) {
+        syntax_error(p, "Expected variable", NULL);
+        return;
+    }
+    int v = var_index(p, p->tok.value);
+    next(p);
+    if (!is_op(p, "=")) { syntax_error(p, "Expected =", NULL); return; }
+    next(p);
+    parse_expr(p, 1);
+    emit(p, OP_STORE, 0, v, 0, 0);
+
+    if (!is_kw(p, KW_TO)) { syntax_error(p, "FOR without TO", NULL); return; }
+    next(p);
+    int lim = loop_slots(p, p->nblocks);
+    parse_expr(p, 1);
+    emit(p, OP_STORE, 0, lim, 0, 0);
+
+    bool unit = true;
+    if (is_kw(p, KW_STEP)) {
+        next(p);
+        parse_expr(p, 1);
+        emit(p, OP_STORE, 0, lim + 1, 0, 0);
+        unit = false;
+    }
+
+    block *b = push_block(p);
+    if (!b) return;
+    b->is_for = true;
+    b->var = v;
+    b->limit = lim;
+    b->unit_step = unit;
+    b->head = emit(p, OP_FOR_CHECK, unit ? LOOP_UNIT_STEP : 0, v, lim, 0);
+}
+
+static void compile_next(parser *p)
+{
+    block *b = p->nblocks ? &p->blocks[p->nblocks - 1] : NULL;
+    if (!b || !b->is_for) {
+        syntax_error(p, "NEXT without FOR", NULL);
+        return;
+    }
+    if (p->tok.type == TOKEN_IDENTIFIER) {
+        if (find_var(p->tok.value) != b->var) {
+            syntax_error(p, "NEXT does not match FOR: ", p->tok.value);
+            return;
+        }
+        next(p);
+    }
+    p->nblocks--;
+    emit(p, OP_NEXT, b->unit_step ? LOOP_UNIT_STEP : 0, b->var, b->limit, b->head + 1);
+    qb.prog[b->head].imm = qb.prog_len;
+}
+
+static void compile_while(parser *p)
+{
+    int top = qb.prog_len;
+    parse_condition(p);
+    int jz = emit(p, OP_JZ, 0, 0, 0, 0);
+    block *b = push_block(p);
+    if (!b) return;
+    b->is_for = false;
+    b->head = top;
+    b->exit_jump = jz;
+}
+
+static void compile_wend(parser *p)
+{
+    block *b = p->nblocks ? &p->blocks[p->nblocks - 1] : NULL;
+    if (!b || b->is_for) {
+        syntax_error(p, "WEND without WHILE", NULL);
+        return;
+    }
+    p->nblocks--;
+    emit(p, OP_JMP, 0, 0, 0, b->head);
+    qb.prog[b->exit_jump].imm = qb.prog_len;
+}
+
+static void compile_statement(parser *p)
+{
+    if (p->tok.type == TOKEN_IDENTIFIER) {      /* implicit LET */
+        compile_let(p);
+        return;
+    }
+    if (p->tok.type != TOKEN_KEYWORD) {
+        syntax_error(p, "Syntax error", NULL);
+        return;
+    }
+
+    Keyword kw = p->tok.keyword;
+    next(p);
+    switch (kw) {
+    case KW_PRINT: compile_print(p); break;
+    case KW_LET:   compile_let(p);   break;
+    case KW_INPUT: compile_input(p); break;
+    case KW_IF:    compile_if(p);    break;
+    case KW_GOTO:  compile_goto(p);  break;
+    case KW_FOR:   compile_for(p);   break;
+    case KW_NEXT:  compile_next(p);  break;
+    case KW_WHILE: compile_while(p); break;
+    case KW_WEND:  compile_wend(p);  break;
+    case KW_END:   emit(p, OP_END, 0, 0, 0, 0); break;
+    case KW_REM:
+        while (p->tok.type != TOKEN_EOF) next(p);
+        break;
+    default:
+        syntax_error(p, "Unexpected keyword", NULL);
+        break;
+    }
+}
+
+static void compile_statements(parser *p)
+{
+    while (!p->failed) {
+        if (p->tok.type == TOKEN_EOF || is_kw(p, KW_ELSE)) return;
+        compile_statement(p);
+        if (p->tok.type != TOKEN_COLON) return;
+        next(p);
+    }
+}
+
+static void compile_line(parser *p, int idx)
+{
+    p->line = idx;
+    p->pos  = (int)qb.lines[idx].code_pos;
+    qb.lines[idx].pc = qb.prog_len;
+    next(p);
+
+    if (p->tok.type == TOKEN_NUMBER) next(p);           /* line number */
+    if (p->tok.type == TOKEN_IDENTIFIER && peek(p).type == TOKEN_COLON) {
+        next(p);                                        /* label: */
+        next(p);
+    }
+    compile_statements(p);
+    if (!p->failed && p->tok.type != TOKEN_EOF)
+        syntax_error(p, "Unexpected text: ", p->tok.value);
+}
+
+/* turn OP_GOTO placeholders into plain jumps */
+static bool resolve_gotos(void)
+{
+    for (int pc = 0; pc < qb.prog_len; ++pc) {
+        qb_insn *in = &qb.prog[pc];
+        if (in->op != OP_GOTO) continue;
+
+        int line;
+        if (in->arg == GOTO_LABEL) {
+            line = find_label(qb.strpool + in->imm);
+            if (line < 0) {
+                error_line(in->b, "Label not found: ", qb.strpool + in->imm);
+                return false;
+            }
+        } else {
+            line = find_line_by_number(in->imm);
+            if (line < 0) {
+                char buf[16];
+                int_to_str(in->imm, buf);
+                error_line(in->b, "Line not found: ", buf);
+                return false;
+            }
+        }
+        in->op  = OP_JMP;
+        in->imm = qb.lines[line].pc;
+    }
+    return true;
+}
+
+static bool compile_program(void)
+{
+    parser ps;
+    memset(&ps, 0, sizeof(ps));
+
+    reset_tables();
+    if (!clear_symbols() || !parse_line_map()) {
+        error_line(-1, "Out of memory", NULL);
+        return false;
+    }
+
+    for (int i = 0; i < qb.line_count && !ps.failed; ++i)
+        compile_line(&ps, i);
+    if (ps.failed) return false;
+
+    if (ps.nblocks) {
+        block *b = &ps.blocks[ps.nblocks - 1];
+        ps.line = -1;
+        syntax_error(&ps, b->is_for ? "FOR without NEXT" : "WHILE without WEND", NULL);
+        return false;
+    }
+    emit(&ps, OP_END, 0, 0, 0, 0);
+    if (ps.failed) return false;
+    return resolve_gotos();
+}
+
+/* ========== Runtime ========== */
+/* source line an instruction was compiled from, for runtime errors */
+static int line_of_pc(int pc)
+{
+    int line = -1;
+    for (int i = 0; i < qb.line_count && qb.lines[i].pc <= pc; i++)
+        line = i;
+    return line;
 }
 
 static void read_input_line(char *buf, size_t max)
 {
     size_t i = 0;
     while (1) {
-        char c = lazy_getchar();
+        char c = sys_getkey();      /* flushes the prompt and the echo */
         if (c == '\r' || c == '\n') {
             print_nl();
             break;
@@ -230,470 +1140,351 @@ static void read_input_line(char *buf, size_t max)
         if (c == '\b' || c == 0x7F) {
             if (i > 0) {
                 i--;
-                terminal_putchar('\b');
-                terminal_putchar(' ');
-                terminal_putchar('\b');
+                print_str("\b \b");
             }
             continue;
         }
         if (c >= 32 && c <= 126 && i < max - 1) {
             buf[i++] = c;
-            terminal_putchar(c);
+            print_char(c);
         }
     }
     buf[i] = '\0';
 }
 
-/* ========== Statement execution ========== */
-static void execute_print(char *args)
+static void set_int(int v, int32_t val)
 {
-    args = trim_start(args);
-    while (*args) {
-        if (*args == '"') {
-            args++;
-            while (*args && *args != '"') {
-                print_char(*args++);
-            }
-            if (*args == '"') args++;
-        } else if (*args == ',') {
-            print_str("    ");
-            args++;
-        } else {
-            char var_name[32];
-            args = extract_token(args, var_name, sizeof(var_name));
-            args = trim_start(args);
-            variable *v = find_var(var_name);
-            if (v) {
-                if (v->type == VAR_INT) {
-                    char buf[32];
-                    int_to_str(v->val.int_val, buf);
-                    print_str(buf);
-                } else {
-                    print_str(v->val.str_val);
-                }
-            } else {
-                if((var_name[0]>='0')&&(var_name[0]<='9')||((var_name[0]=='-')&&(var_name[1]>='0')&&(var_name[1]<='9'))) {
-                    char buf[32];
-                    int_to_str(parse_int(var_name), buf);
-                    print_str(buf);
-                } else {
-                    print_str("?");
-                }
-            }
-        }
-    }
-    print_nl();
+    qb.ints[v] = val;
+    qb.types[v] = VAR_INT;
 }
 
-static void execute_let(char *args)
-{
-    args = trim_start(args);
-    char var_name[32];
-    args = extract_token(args, var_name, sizeof(var_name));
-    args = trim_start(args);
-    
-    if (*args == '=') args++;
-    args = trim_start(args);
-    
-    variable *v = find_var(var_name);
-    if (!v) {
-        if (*args == '"') {
-            v = create_var(var_name, VAR_STR);
-        } else {
-            v = create_var(var_name, VAR_INT);
-        }
-    }
-    
-    if (v->type == VAR_INT) {
-        v->val.int_val = parse_int(args);
-    } else {
-        if (*args == '"') args++;
-        size_t i = 0;
-        while (*args && *args != '"' && i < 127) {
-            v->val.str_val[i++] = *args++;
-        }
-        v->val.str_val[i] = '\0';
+/* a slot's buffer only ever grows, so loops that reassign it settle
+   into plain copies; false when the arena is out of memory */
+static bool set_str(int v, const char *s)
+{
+    size_t n = strlen(s) + 1;
+    if (qb.str_caps[v] < n) {
+        char *p = arena_alloc(&arena, n);
+        if (!p) return false;
+        qb.strs[v] = p;
+        qb.str_caps[v] = n;
     }
+    memcpy(qb.strs[v], s, n);
+    qb.ints[v] = 0;
+    qb.types[v] = VAR_STR;
+    return true;
 }
 
-static void execute_input(char *args)
+static bool input_var(const qb_insn *in)
 {
-    args = trim_start(args);
-    char *p = args;
-    while (*p) {
-        char var_name[32];
-        p = extract_token(p, var_name, sizeof(var_name));
-        p = trim_start(p);
-        if (var_name[0] == '\0') break;
-        if (*p == ',') { p++; p = trim_start(p); }
+    char buf[MAX_INPUT_LEN];
+    if (in->arg & INPUT_PROMPT) print_str("? ");
+    read_input_line(buf, sizeof(buf));
 
-        print_str("? ");
-        char buf[128];
-        read_input_line(buf, sizeof(buf));
-        variable *v = find_var(var_name);
-        if (!v) {
-            if (is_number(buf)) {
-                v = create_var(var_name, VAR_INT);
-            } else {
-                v = create_var(var_name, VAR_STR);
+    var_type t = qb.types[in->a];
+    if (in->arg & INPUT_STRING) t = VAR_STR;
+    if (t == VAR_NONE) t = is_number(buf) ? VAR_INT : VAR_STR;
+    if (t != VAR_INT) return set_str(in->a, buf);
+    set_int(in->a, parse_int(trim_start(buf)));
+    return true;
+}
+
+static void execute(void)
+{
+    int32_t stack[EVAL_STACK];
+    int sp = 0;
+    int pc = 0;
+    char buf[16];
+
+    for (;;) {
+        const qb_insn *in = &qb.prog[pc++];
+        switch (in->op) {
+        case OP_END:
+            return;
+        case OP_PUSH_INT:
+            stack[sp++] = in->imm;
+            break;
+        case OP_PUSH_VAR:
+            stack[sp++] = qb.ints[in->a];
+            break;
+        case OP_ADD: sp--; stack[sp - 1] = (int32_t)((uint32_t)stack[sp - 1] + (uint32_t)stack[sp]); break;
+        case OP_SUB: sp--; stack[sp - 1] = (int32_t)((uint32_t)stack[sp - 1] - (uint32_t)stack[sp]); break;
+        case OP_MUL: sp--; stack[sp - 1] = (int32_t)((uint32_t)stack[sp - 1] * (uint32_t)stack[sp]); break;
+        case OP_DIV:
+        case OP_MOD: {
+            int32_t b = stack[--sp], a = stack[sp - 1];
+            if (b == 0) {
+                error_line(line_of_pc(pc - 1), "Division by zero", NULL);
+                return;
             }
+            if (b == -1) stack[sp - 1] = (in->op == OP_DIV) ? (int32_t)(0U - (uint32_t)a) : 0;
+            else stack[sp - 1] = (in->op == OP_DIV) ? a / b : a % b;
+            break;
         }
-        if (v->type == VAR_INT) {
-            v->val.int_val = parse_int(buf);
-        } else {
-            size_t i = 0;
-            char *s = buf;
-            while (*s && i < sizeof(v->val.str_val) - 1) {
-                v->val.str_val[i++] = *s++;
+        case OP_NEG:
+            stack[sp - 1] = (int32_t)(0U - (uint32_t)stack[sp - 1]);
+            break;
+        case OP_CMP: {
+            int32_t b = stack[--sp], a = stack[sp - 1];
+            bool r = false;
+            switch (in->arg) {
+            case REL_EQ: r = a == b; break;
+            case REL_NE: r = a != b; break;
+            case REL_LT: r = a <  b; break;
+            case REL_GT: r = a >  b; break;
+            case REL_LE: r = a <= b; break;
+            case REL_GE: r = a >= b; break;
             }
-            v->val.str_val[i] = '\0';
-        }
-    }
-}
-
-static bool eval_condition(char *cond)
-{
-    cond = trim_start(cond);
-    char var_name[32];
-    cond = extract_token(cond, var_name, sizeof(var_name));
-    cond = trim_start(cond);
-    
-    variable *v = find_var(var_name);
-    if (!v || v->type != VAR_INT) return false;
-    
-    int32_t val = v->val.int_val;
-    if (*cond == '=' && *(cond + 1) != '=') {
-        cond++;
-        return val == parse_int(trim_start(cond));
-    } else if (*cond == '<' && *(cond + 1) == '=') {
-        cond += 2;
-        return val <= parse_int(trim_start(cond));
-    } else if (*cond == '>' && *(cond + 1) == '=') {
-        cond += 2;
-        return val >= parse_int(trim_start(cond));
-    } else if (*cond == '<' && *(cond + 1) == '>') {
-        cond += 2;
-        return val != parse_int(trim_start(cond));
-    } else if (*cond == '<') {
-        cond++;
-        return val < parse_int(trim_start(cond));
-    } else if (*cond == '>') {
-        cond++;
-        return val > parse_int(trim_start(cond));
-    }
-    return false;
-}
-
-/* ========== Control flow: GOTO, FOR, NEXT ========== */
-static int execute_line(char *line);
-
-static void execute_goto(char *target)
-{
-    target = trim_start(target);
-    char label_or_num[32];
-    extract_token(target, label_or_num, sizeof(label_or_num));
-    
-    /* Try as line number first */
-    if (is_number(label_or_num)) {
-        int line_num = parse_int(label_or_num);
-        size_t pos = find_line_by_number(line_num);
-        if (pos > 0) {
-            qb.exec_pos = pos;
+            stack[sp - 1] = r ? -1 : 0;
+            break;
         }
-    } else {
-        /* Try as label */
-        size_t pos = find_label(label_or_num);
-        if (pos > 0) {
-            qb.exec_pos = pos;
-        }
-    }
-}
-
-static void execute_for(char *args)
-{
-    args = trim_start(args);
-    char var_name[32];
-    args = extract_token(args, var_name, sizeof(var_name));
-    args = trim_start(args);
-    
-    if (*args == '=') args++;
-    args = trim_start(args);
-    
-    /* Parse initial value */
-    char init_str[32];
-    args = extract_token(args, init_str, sizeof(init_str));
-    args = trim_start(args);
-    int32_t init_val = parse_int(init_str);
-    
-    /* Expect TO */
-    char to_kw[32];
-    args = extract_token(args, to_kw, sizeof(to_kw));
-    args = trim_start(args);
-    
-    /* Parse end value */
-    char to_str[32];
-    args = extract_token(args, to_str, sizeof(to_str));
-    int32_t to_val = parse_int(to_str);
-    
-    /* Create/update loop variable */
-    variable *v = find_var(var_name);
-    if (!v) v = create_var(var_name, VAR_INT);
-    v->val.int_val = init_val;
-    
-    /* Push FOR state - store position AFTER the FOR statement */
-    if (qb.for_depth < MAX_FOR_STACK) {
-        for_loop_state *fs = &qb.for_stack[qb.for_depth];
-        strcpy(fs->var_name, var_name);
-        fs->to_val = to_val;
-        fs->loop_start_pos = qb.exec_pos;  /* Position to jump back to (first statement in loop) */
-        fs->depth = qb.for_depth;
-        qb.for_depth++;
-    }
-}
-
-static void execute_next(char *var_name_arg)
-{
-    if (qb.for_depth == 0) return;
-    
-    for_loop_state *fs = &qb.for_stack[qb.for_depth - 1];
-    variable *v = find_var(fs->var_name);
-    
-    if (v) {
-        /* Increment the loop variable */
-        v->val.int_val++;
-        
-        if (v->val.int_val <= fs->to_val) {
-            /* Loop condition still true: jump back to start of loop body */
-            qb.exec_pos = fs->loop_start_pos;
-        } else {
-            /* Loop is done: pop the FOR stack and continue past NEXT */
-            qb.for_depth--;
-        }
-    }
-}
-
-/* ========== Main line executor ========== */
-static int execute_line(char *line)
-{
-    line = trim_start(line);
-    if (!*line || *line == '\'') return 1;  /* skip empty/comment lines */
-    
-    /* Skip line number if present */
-    while (*line >= '0' && *line <= '9') line++;
-    line = trim_start(line);
-    
-    /* Check for label (label:) */
-    char *colon = line;
-    while (*colon && *colon != ':' && *colon != '\n') colon++;
-    if (*colon == ':' && (colon[1] == '\n' || colon[1] == '\0' || colon[1] == ' ')) {
-        /* This is a label-only line, skip it */
-        return 1;
-    }
-    
-    /* Parse command */
-    char cmd[32];
-    line = extract_token(line, cmd, sizeof(cmd));
-    line = trim_start(line);
-    
-    if (!strcmp(cmd, "PRINT")) {
-        execute_print(line);
-    } else if (!strcmp(cmd, "LET")) {
-        execute_let(line);
-    } else if (!strcmp(cmd, "INPUT")) {
-        execute_input(line);
-    } else if (!strcmp(cmd, "GOTO")) {
-        execute_goto(line);
-        return 0;  /* Signal to restart from exec_pos */
-    } else if (!strcmp(cmd, "FOR")) {
-        execute_for(line);
-    } else if (!strcmp(cmd, "NEXT")) {
-        execute_next(line);
-        return 0;  /* Signal to jump or continue */
-    } else if (!strcmp(cmd, "IF")) {
-        char buf[256];
-        strcpy(buf, line);
-        char *then_pos = NULL;
-        
-        /* Find THEN */
-        for (char *p = buf; *p; p++) {
-            if (p[0] == 'T' && p[1] == 'H' && p[2] == 'E' && p[3] == 'N') {
-                then_pos = p;
-                break;
-            }
+        case OP_STR_CMP: {
+            bool eq = qb.types[in->a] == VAR_STR && !strcmp(qb.strs[in->a], qb.strpool + in->imm);
+            stack[sp++] = (eq == (in->arg == REL_EQ)) ? -1 : 0;
+            break;
+        }
+        case OP_VAR_CMP: {
+            var_type t = qb.types[in->a];
+            bool eq = t == qb.types[in->b] &&
+                      (t == VAR_STR ? !strcmp(qb.strs[in->a], qb.strs[in->b])
+                                    : qb.ints[in->a] == qb.ints[in->b]);
+            stack[sp++] = (eq == (in->arg == REL_EQ)) ? -1 : 0;
+            break;
         }
-        
-        if (then_pos) {
-            *then_pos = '\0';
-            char *action = trim_start(then_pos + 4);
-            char *else_pos = NULL;
-            for (char *p = action; *p; p++) {
-                if (p[0] == 'E' && p[1] == 'L' && p[2] == 'S' && p[3] == 'E') {
-                    else_pos = p;
-                    break;
-                }
+        case OP_STORE:
+            set_int(in->a, stack[--sp]);
+            break;
+        case OP_LET_STR:
+            if (!set_str(in->a, qb.strpool + in->imm)) goto out_of_memory;
+            break;
+        case OP_COPY:
+            if (qb.types[in->b] == VAR_STR) {
+                if (in->a != in->b && !set_str(in->a, qb.strs[in->b])) goto out_of_memory;
+            } else {
+                qb.ints[in->a]  = qb.ints[in->b];
+                qb.types[in->a] = qb.types[in->b];
             }
-            
-            if (eval_condition(buf)) {
-                if (else_pos) {
-                    *else_pos = '\0';
-                    execute_line(action);
-                } else {
-                    execute_line(action);
-                }
+            break;
+        case OP_PRINT_STR:
+            print_str(qb.strpool + in->imm);
+            break;
+        case OP_PRINT_VAR: {
+            if (qb.types[in->a] == VAR_INT) {
+                int_to_str(qb.ints[in->a], buf);
+                print_str(buf);
+            } else if (qb.types[in->a] == VAR_STR) {
+                print_str(qb.strs[in->a]);
             } else {
-                if (else_pos) {
-                    execute_line(trim_start(else_pos + 4));
-                }
+                print_str("?");
             }
+            break;
+        }
+        case OP_PRINT_INT:
+            int_to_str(stack[--sp], buf);
+            print_str(buf);
+            break;
+        case OP_PRINT_TAB:
+            print_str("    ");
+            break;
+        case OP_PRINT_NL:
+            print_nl();
+            break;
+        case OP_INPUT:
+            if (!input_var(in)) goto out_of_memory;
+            break;
+        case OP_JMP:
+            pc = in->imm;
+            break;
+        case OP_JZ:
+            if (stack[--sp] == 0) pc = in->imm;
+            break;
+        case OP_FOR_CHECK: {
+            int32_t v = qb.ints[in->a];
+            int32_t lim = qb.ints[in->b];
+            int32_t step = (in->arg & LOOP_UNIT_STEP) ? 1 : qb.ints[in->b + 1];
+            if (step >= 0 ? v > lim : v < lim) pc = in->imm;
+            break;
+        }
+        case OP_NEXT: {
+            int32_t *v = &qb.ints[in->a];
+            int32_t lim = qb.ints[in->b];
+            /* test before stepping: FOR I = 1 TO 2147483647 has to end,
+               and the variable still finishes one step past the limit */
+            if (in->arg & LOOP_UNIT_STEP) {
+                if (*v < lim) pc = in->imm;
+                *v = (int32_t)((uint32_t)*v + 1);
+            } else {
+                int32_t step = qb.ints[in->b + 1];
+                int64_t n = (int64_t)*v + step;
+                if (step >= 0 ? n <= lim : n >= lim) pc = in->imm;
+                *v = (int32_t)n;
+            }
+            qb.types[in->a] = VAR_INT;
+            break;
+        }
+        default:
+            return;
         }
     }
-    
-    return 1;  /* Normal progression */
+
+out_of_memory:
+    error_line(line_of_pc(pc - 1), "Out of memory", NULL);
 }
 
 /* ========== Program execution ========== */
 static void run_program(void)
 {
-    qb.var_count = 0;
-    qb.for_depth = 0;
-    qb.exec_pos = 0;
-    
-    parse_line_map();
-    
-    while (qb.exec_pos < qb.code_len) {
-        /* Extract current line */
-        char line_buf[MAX_LINE_LEN];
-        size_t pos = qb.exec_pos;
-        size_t i = 0;
-        
-        while (pos < qb.code_len && qb.code[pos] != '\n' && i < MAX_LINE_LEN - 1) {
-            line_buf[i++] = qb.code[pos++];
-        }
-        line_buf[i] = '\0';
-        
-        /* Calculate next line position before executing */
-        size_t next_line_pos = pos;
-        if (pos < qb.code_len && qb.code[pos] == '\n') next_line_pos = pos + 1;
-        
-        /* Check if this is a FOR statement - update loop_start_pos to next line */
-        char test_cmd[32];
-        char *test_line = trim_start(line_buf);
-        while (*test_line >= '0' && *test_line <= '9') test_line++;
-        test_line = trim_start(test_line);
-        extract_token(test_line, test_cmd, sizeof(test_cmd));
-        
-        if (!strcmp(test_cmd, "FOR")) {
-            /* Will be set by execute_for, but we need next line position */
-            size_t saved_exec_pos = qb.exec_pos;
-            qb.exec_pos = next_line_pos;  /* Temporarily move to next line */
-            execute_line(line_buf);
-            if (qb.for_depth > 0) {
-                /* Update the for stack's loop_start_pos to the line after FOR */
-                qb.for_stack[qb.for_depth - 1].loop_start_pos = next_line_pos;
-            }
-            continue;
-        }
-        
-        int should_advance = execute_line(line_buf);
-        if (should_advance) {
-            qb.exec_pos = next_line_pos;
-        }
-    }
+    if (!compile_program()) return;
+    memset(qb.ints, 0, qb.var_count * sizeof(*qb.ints));
+    memset(qb.types, VAR_NONE, qb.var_count * sizeof(*qb.types));
+    execute();                  /* output is batched until SYS_GETKEY/exit */
 }
 
 /* ========== Editor ========== */
-static void editor_display(void)
+static void load_code(const char *text, size_t len)
 {
-    terminal_initialize();
-    set_color(VGA_COLOR_CYAN);
-    print_str("=== QBASIC EDITOR (Ctrl+R: Run, Ctrl+X: Exit) ===");
+    qb.code = text;             /* compiled in place, never copied */
+    qb.code_len = len;
+}
+
+/* high-water mark of the run that just ended */
+static void report_arena(void)
+{
+    char buf[16];
+    set_color(VGA_COLOR_DARK_GREY);
+    print_str("[arena: ");
+    int_to_str((int32_t)arena.peak, buf);
+    print_str(buf);
+    print_str(" bytes peak of ");
+    int_to_str((int32_t)arena_capacity(&arena), buf);
+    print_str(buf);
+    print_str("]");
     print_nl();
     set_color(VGA_COLOR_LIGHT_GREY);
-    
-    size_t line = 1;
-    size_t pos = 0;
-    while (pos < editor_pos && line < 20) {
-        char tmp[MAX_LINE_LEN];
-        size_t i = 0;
-        while (pos < editor_pos && editor_buf[pos] != '\n' && i < MAX_LINE_LEN - 1) {
-            tmp[i++] = editor_buf[pos++];
-        }
-        tmp[i] = '\0';
-        if (editor_buf[pos] == '\n') pos++;
-        print_str(tmp);
-        print_nl();
-        line++;
+}
+
+/* user_run() target: compiling and running happen in ring 3 */
+static int show_output(void *banner)
+{
+    set_color(VGA_COLOR_GREEN);
+    print_str(banner);
+    print_nl();
+    set_color(VGA_COLOR_LIGHT_GREY);
+    run_program();
+    print_nl();
+    report_arena();
+    print_str("Press any key...");
+    sys_getkey();
+    return 0;
+}
+
+static void show_run(const char *banner)
+{
+    terminal_initialize();
+    if (user_run(show_output, (void *)banner) < 0) {
+        print_str("Press any key...");      /* after the fault report */
+        sys_getkey();
     }
 }
 
+/* background jobs: just the program's own output */
+static int batch_output(void *unused)
+{
+    (void)unused;
+    run_program();
+    return 0;
+}
+
+/* a copy outlives the editor buffer, like QBASIC's program in memory */
+static void keep_program(const char *text, size_t len)
+{
+    char *copy = kmalloc(len + 1);
+    if (!copy) return;
+    memcpy(copy, text, len);
+    copy[len] = '\0';
+    kfree(saved);
+    saved = copy;
+}
+
 static void editor_loop(void)
 {
-    editor_pos = 0;
-    editor_buf[0] = '\0';
-    
-    while (1) {
-        editor_display();
-        char c = lazy_getchar();
-        
-        if (c == 0x12) {   /* Ctrl+R - RUN */
-            qb.code_len = editor_pos;
-            memcpy(qb.code, editor_buf, editor_pos);
-            
-            terminal_initialize();
-            set_color(VGA_COLOR_GREEN);
-            print_str("=== OUTPUT ===");
-            print_nl();
-            set_color(VGA_COLOR_LIGHT_GREY);
-            run_program();
-            print_nl();
-            print_str("Press any key...");
-            lazy_getchar();
-            continue;
-        }
+    if (!editor_init(&editor, "=== QBASIC EDITOR (Ctrl+R: Run, Ctrl+S: Save, Ctrl+O: Open, Ctrl+X: Exit) ===", "BAS")) {
+        error_line(-1, "Out of memory", NULL);
+        return;
+    }
+    if (saved) editor_load(&editor, saved, strlen(saved));
 
-        if (c == 0x18) {   /* Ctrl+X - EXIT */
-            return;
-        }
-        
-        if (c == '\b' || c == 0x7F) {
-            if (editor_pos > 0) editor_pos--;
-        } else if (c == '\n' || c == '\r') {
-            if (editor_pos < MAX_CODE_LEN - 1) {
-                editor_buf[editor_pos++] = '\n';
-            }
-        } else if (c >= 32 && c <= 126) {
-            if (editor_pos < MAX_CODE_LEN - 1) {
-                editor_buf[editor_pos++] = c;
-            }
-        }
-        editor_buf[editor_pos] = '\0';
+    size_t len;
+    const char *text;
+    while (editor_run(&editor) == EDITOR_RUN) {
+        text = editor_text(&editor, &len);
+        keep_program(text, len);
+        load_code(text, len);
+        show_run("=== OUTPUT ===");
     }
+    text = editor_text(&editor, &len);
+    keep_program(text, len);
+    editor_free(&editor);
+}
+
+static bool begin_session(void)
+{
+    /* test and set in one go: a job may be preempted right here */
+    if (__atomic_exchange_n(&busy, true, __ATOMIC_ACQUIRE)) {
+        print_str("QBASIC is busy with a background program\n");
+        return false;
+    }
+    arena_init(&arena, ARENA_CHUNK);
+    return true;
+}
+
+static void end_session(void)
+{
+    arena_free(&arena);         /* nothing stays on the heap between sessions */
+    memset(&qb, 0, sizeof(qb));
+    __atomic_store_n(&busy, false, __ATOMIC_RELEASE);
 }
 
 void qbasic_run(const char* code)
 {
+    if (!begin_session()) return;
     if (code && *code) {
-        size_t i = 0;
-        while (i < MAX_CODE_LEN - 1 && code[i]) {
-            editor_buf[i] = code[i];
-            i++;
-        }
-        editor_pos = i;
-        editor_buf[editor_pos] = '\0';
-
-        qb.code_len = editor_pos;
-        memcpy(qb.code, editor_buf, editor_pos);
-
-        terminal_initialize();
-        set_color(VGA_COLOR_GREEN);
-        print_str("=== QBASIC: running code ===");
-        print_nl();
-        set_color(VGA_COLOR_LIGHT_GREY);
-        run_program();
-        print_nl();
-        print_str("Press any key...");
-        lazy_getchar();
+        load_code(code, strlen(code));
+        show_run("=== QBASIC: running code ===");
     } else {
         editor_loop();
     }
+    end_session();
+}
+
+/* inside a session */
+static void run_text(const char *text, size_t len, bool background)
+{
+    load_code(text, len);
+    if (background)
+        user_run(batch_output, NULL);
+    else
+        show_run("=== QBASIC: running program ===");
+}
+
+bool qbasic_run_text(const char *text, size_t len, bool background)
+{
+    if (!begin_session()) return false;
+    run_text(text, len, background);
+    end_session();
+    return true;
+}
+
+bool qbasic_run_saved(bool background)
+{
+    /* saved belongs to whoever holds the session: an editor session
+       may replace (and free) it until this one has begun */
+    if (!begin_session()) return false;
+    bool ok = saved != NULL;
+    if (ok)
+        run_text(saved, strlen(saved), background);
+    else
+        print_str("No program in memory: write one in the editor first\n");
+    end_session();
+    return ok;
 }
\ No newline at end of file
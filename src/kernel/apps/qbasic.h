@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 // QBASIC Token Types
 typedef enum {
@@ -16,6 +17,7 @@ typedef enum {
     TOKEN_RPAREN,
     TOKEN_COMMA,
     TOKEN_COLON,
+    TOKEN_SEMICOLON,
 } TokenType;
 
 // QBASIC Keywords
@@ -32,6 +34,11 @@ typedef enum {
     KW_WEND,
     KW_DIM,
     KW_END,
+    KW_LET,
+    KW_GOTO,
+    KW_STEP,
+    KW_MOD,
+    KW_REM,
 } Keyword;
 
 // Token Structure
@@ -45,6 +52,13 @@ typedef struct {
 // Function Declarations
 void qbasic_init(void);
 void qbasic_run(const char* code);
+/* run the program kept from the last editor session; in the background
+   the screen is neither cleared nor held afterwards.  false (and a
+   message) when there is none or QBASIC is already running one. */
+bool qbasic_run_saved(bool background);
+/* run len bytes of text in place, never copied: the last line must end
+   in a newline or be followed by a NUL.  background as above. */
+bool qbasic_run_text(const char *text, size_t len, bool background);
 Token qbasic_next_token(const char* code, int* pos);
 bool qbasic_execute_line(const char* line);
 void qbasic_print(const char* str);
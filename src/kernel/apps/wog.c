@@ -1,42 +1,50 @@
 #include "../io/vga.h"
-#include "../io/keyboard.h"
+#include "../core/syscall.h"
 #include "../lib/string.h"
+#include "editor.h"
+#include "../lib/arena.h"
+#include "../core/heap.h"
 #include <stdbool.h>
 #include <stdint.h>
 
-#define MAX_VARS 128
+#define MIN_VARS 16             /* first table; doubles when full */
+#define ARENA_CHUNK 4000        /* fits a one-page kmalloc block */
 #define MAX_LINE_LEN 256
-#define MAX_CODE_LEN 8192
 #define MAX_VAR_NAME 32
 #define MAX_STR_VAL 256
 
 typedef enum { VAR_INT, VAR_STR } var_type;
 
+/* WOG has no string assignment yet, so a string is always "" */
 typedef struct {
     char name[MAX_VAR_NAME];
     var_type type;
     union {
         int32_t int_val;
-        char str_val[MAX_STR_VAL];
+        const char *str_val;
     } val;
 } variable;
 
 typedef struct {
-    variable vars[MAX_VARS];
-    int var_count;
+    variable *vars;             /* in the run arena, var_cap entries */
+    int var_count, var_cap;
     bool error_flag;
     char error_msg[128];
 } wog_state;
 
 static wog_state wog;
-static char editor_buf[MAX_CODE_LEN];
-static size_t editor_pos = 0;
+static struct arena arena;              /* everything one run allocates */
+static const char *code;                /* editor text for run_program */
+static size_t code_len;
+static struct editor editor;
+static char *saved;                     /* the program from the last session */
+static bool busy;                       /* wog and the arena: one run at a time */
 
-/* Terminal I/O */
-static void print_str(const char *s) { terminal_writestring(s); }
-static void print_char(char c) { terminal_putchar(c); }
-static void print_nl(void) { terminal_putchar('\n'); }
-static void set_color(uint8_t color) { terminal_setcolor(color); }
+/* Terminal I/O: programs run in ring 3, so all of it is system calls */
+static void print_str(const char *s) { sys_write(s, strlen(s)); }
+static void print_char(char c) { sys_write(&c, 1); }
+static void print_nl(void) { print_char('\n'); }
+static void set_color(uint8_t color) { sys_setcolor(color); }
 
 static void wog_error(const char *msg)
 {
@@ -59,11 +67,19 @@ static variable* find_var(const char *name)
     return NULL;
 }
 
+/* may move the table: pointers from find_var() are stale afterwards */
 static variable* create_var(const char *name, var_type type)
 {
-    if (wog.var_count >= MAX_VARS) {
-        wog_error("Variable table full");
-        return NULL;
+    if (wog.var_count == wog.var_cap) {
+        int cap = wog.var_cap ? wog.var_cap * 2 : MIN_VARS;
+        variable *vars = arena_realloc(&arena, wog.vars,
+                                       wog.var_cap * sizeof(*vars), cap * sizeof(*vars));
+        if (!vars) {
+            wog_error("Out of memory for variables");
+            return NULL;
+        }
+        wog.vars = vars;
+        wog.var_cap = cap;
     }
     variable *v = &wog.vars[wog.var_count++];
     strcpy(v->name, name);
@@ -71,7 +87,7 @@ static variable* create_var(const char *name, var_type type)
     if (type == VAR_INT) {
         v->val.int_val = 0;
     } else {
-        v->val.str_val[0] = '\0';
+        v->val.str_val = "";
     }
     return v;
 }
@@ -386,20 +402,22 @@ static void execute_line(char *line)
 
 static void run_program(void)
 {
-    wog.var_count = 0;
+    arena_reset(&arena);        /* drops the last run's table in O(1) */
+    wog.vars = NULL;
+    wog.var_count = wog.var_cap = 0;
     wog.error_flag = false;
     
     char line_buf[MAX_LINE_LEN];
     size_t pos = 0;
     bool in_program = false;
     
-    while (pos < editor_pos && !wog.error_flag) {
+    while (pos < code_len && !wog.error_flag) {
         size_t i = 0;
-        while (pos < editor_pos && editor_buf[pos] != '\n' && i < MAX_LINE_LEN - 1) {
-            line_buf[i++] = editor_buf[pos++];
+        while (pos < code_len && code[pos] != '\n' && i < MAX_LINE_LEN - 1) {
+            line_buf[i++] = code[pos++];
         }
         line_buf[i] = '\0';
-        if (editor_buf[pos] == '\n') pos++;
+        if (code[pos] == '\n') pos++;
         
         char *trimmed = trim_start(line_buf);
         
@@ -421,80 +439,135 @@ static void run_program(void)
     }
 }
 
-static void editor_display(void)
+static void report_arena(void)
 {
-    terminal_initialize();
-    set_color(VGA_COLOR_CYAN);
-    print_str("=== WOG INTERPRETER (Ctrl+R: Run, Ctrl+X: Exit) ===");
+    char buf[16];
+    set_color(VGA_COLOR_DARK_GREY);
+    print_str("[arena: ");
+    int_to_str((int32_t)arena.peak, buf, sizeof(buf));
+    print_str(buf);
+    print_str(" bytes peak]");
     print_nl();
     set_color(VGA_COLOR_LIGHT_GREY);
-    
-    size_t line = 1;
-    size_t pos = 0;
-    while (pos < editor_pos && line < 20) {
-        char tmp[MAX_LINE_LEN];
-        size_t i = 0;
-        while (pos < editor_pos && editor_buf[pos] != '\n' && i < MAX_LINE_LEN - 1) {
-            tmp[i++] = editor_buf[pos++];
-        }
-        tmp[i] = '\0';
-        if (editor_buf[pos] == '\n') pos++;
-        print_str(tmp);
-        print_nl();
-        line++;
+}
+
+/* user_run() target: output is batched until SYS_GETKEY or exit */
+static int show_output(void *unused)
+{
+    (void)unused;
+    set_color(VGA_COLOR_GREEN);
+    print_str("=== OUTPUT ===");
+    print_nl();
+    set_color(VGA_COLOR_LIGHT_GREY);
+    run_program();
+    print_nl();
+    report_arena();
+    print_str("Press any key...");
+    sys_getkey();
+    return 0;
+}
+
+static void show_run(void)
+{
+    terminal_initialize();
+    if (user_run(show_output, NULL) < 0) {
+        print_str("Press any key...");      /* after the fault report */
+        sys_getkey();
     }
 }
 
+/* background jobs: just the program's own output */
+static int batch_output(void *unused)
+{
+    (void)unused;
+    run_program();
+    return 0;
+}
+
+static void keep_program(const char *text, size_t len)
+{
+    char *copy = kmalloc(len + 1);
+    if (!copy) return;
+    memcpy(copy, text, len);
+    copy[len] = '\0';
+    kfree(saved);
+    saved = copy;
+}
+
 static void editor_loop(void)
 {
-    editor_pos = 0;
-    editor_buf[0] = '\0';
-    
-    while (1) {
-        editor_display();
-        char c = lazy_getchar();
-        
-        /* Ctrl+R: Run */
-        if (c == 0x12) {
-            terminal_initialize();
-            set_color(VGA_COLOR_GREEN);
-            print_str("=== OUTPUT ===");
-            print_nl();
-            set_color(VGA_COLOR_LIGHT_GREY);
-            run_program();
-            print_nl();
-            print_str("Press any key...");
-            lazy_getchar();
-            continue;
-        }
-        
-        /* Ctrl+X: Exit */
-        if (c == 0x18) {
-            return;
-        }
-        
-        /* Backspace */
-        if (c == '\b' || c == 0x7F) {
-            if (editor_pos > 0) editor_pos--;
-        } 
-        /* Newline */
-        else if (c == '\n' || c == '\r') {
-            if (editor_pos < MAX_CODE_LEN - 1) {
-                editor_buf[editor_pos++] = '\n';
-            }
-        } 
-        /* Printable */
-        else if (c >= 32 && c <= 126) {
-            if (editor_pos < MAX_CODE_LEN - 1) {
-                editor_buf[editor_pos++] = c;
-            }
-        }
-        editor_buf[editor_pos] = '\0';
+    if (!editor_init(&editor, "=== WOG INTERPRETER (Ctrl+R: Run, Ctrl+S: Save, Ctrl+O: Open, Ctrl+X: Exit) ===", "WOG")) {
+        wog_error("Out of memory");
+        return;
+    }
+    if (saved) editor_load(&editor, saved, strlen(saved));
+
+    /* Ctrl+R: Run, Ctrl+X: Exit; Ctrl+S and Ctrl+O stay in the editor */
+    while (editor_run(&editor) == EDITOR_RUN) {
+        code = editor_text(&editor, &code_len);
+        keep_program(code, code_len);
+        show_run();
     }
+    code = editor_text(&editor, &code_len);
+    keep_program(code, code_len);
+    editor_free(&editor);
+}
+
+static bool begin_session(void)
+{
+    /* test and set in one go: a job may be preempted right here */
+    if (__atomic_exchange_n(&busy, true, __ATOMIC_ACQUIRE)) {
+        print_str("WOG is busy with a background program\n");
+        return false;
+    }
+    arena_init(&arena, ARENA_CHUNK);
+    return true;
+}
+
+static void end_session(void)
+{
+    arena_free(&arena);
+    wog.vars = NULL;
+    wog.var_count = wog.var_cap = 0;
+    __atomic_store_n(&busy, false, __ATOMIC_RELEASE);
 }
 
 void wog_run(void)
 {
-    /* Interactive editor - WOG always runs interactively */
+    if (!begin_session()) return;
     editor_loop();
+    end_session();
+}
+
+/* inside a session */
+static void run_text(const char *text, size_t len, bool background)
+{
+    code = text;
+    code_len = len;
+    if (background)
+        user_run(batch_output, NULL);
+    else
+        show_run();
+}
+
+bool wog_run_text(const char *text, size_t len, bool background)
+{
+    if (!begin_session()) return false;
+    run_text(text, len, background);
+    end_session();
+    return true;
+}
+
+bool wog_run_saved(bool background)
+{
+    /* saved belongs to whoever holds the session: an editor session
+       may replace (and free) it until this one has begun */
+    if (!begin_session()) return false;
+    bool ok = saved != NULL;
+    if (ok)
+        run_text(saved, strlen(saved), background);
+    else
+        print_str("No program in memory: write one in the editor first\n");
+    end_session();
+    return ok;
 }
\ No newline at end of file
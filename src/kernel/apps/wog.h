@@ -2,6 +2,13 @@
 #ifndef WOG_H
 #define WOG_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 void wog_run(void);
+/* the program from the last editor session, as qbasic_run_saved() */
+bool wog_run_saved(bool background);
+/* run len bytes of text in place, as qbasic_run_text() */
+bool wog_run_text(const char *text, size_t len, bool background);
 
 #endif /* WOG_H */
\ No newline at end of file
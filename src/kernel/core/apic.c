@@ -0,0 +1,89 @@
+/* apic.c  –  local APIC registers, EOI and IPIs */
+#include "apic.h"
+#include "idt.h"
+#include "paging.h"
+
+/* register offsets */
+#define APIC_TPR        0x080
+#define APIC_EOI        0x0B0
+#define APIC_SVR        0x0F0
+#define APIC_ICR_LO     0x300
+#define APIC_ICR_HI     0x310
+#define APIC_LINT0      0x350
+#define APIC_LINT1      0x360
+
+#define SVR_ENABLE      0x100
+#define ICR_FIXED       0x00000
+#define ICR_INIT        0x00500
+#define ICR_STARTUP     0x00600
+#define ICR_PENDING     0x01000     /* delivery status */
+#define ICR_ASSERT      0x04000
+#define ICR_OTHERS      0xC0000     /* shorthand: all excluding self */
+#define LVT_EXTINT      0x00700
+#define LVT_NMI         0x00400
+
+static volatile uint32_t *regs;
+
+static uint32_t rd(uint32_t reg) { return regs[reg / 4]; }
+static void wr(uint32_t reg, uint32_t v) { regs[reg / 4] = v; }
+
+/* the ICR is two registers: no interrupt between the halves */
+static void send_ipi(uint8_t dest, uint32_t cmd)
+{
+    uint32_t flags;
+    asm volatile ("pushf\n pop %0\n cli" : "=r"(flags) : : "memory");
+    wr(APIC_ICR_HI, (uint32_t)dest << 24);
+    wr(APIC_ICR_LO, cmd);
+    while (rd(APIC_ICR_LO) & ICR_PENDING)
+        asm volatile ("pause");
+    if (flags & 0x200) asm volatile ("sti");
+}
+
+/* the wake-up IPI has done its job by arriving */
+static void wake_irq(struct regs *r)
+{
+    (void)r;
+    apic_eoi();
+}
+
+bool apic_init(uint32_t base)
+{
+    if (!map_pages(base, base, 1, PAGE_WRITE | PAGE_NOCACHE))
+        return false;
+    regs = (volatile uint32_t *)base;
+
+    /* left off by the firmware: the LVTs are all masked then */
+    if (!(rd(APIC_SVR) & SVR_ENABLE)) {
+        wr(APIC_LINT0, LVT_EXTINT);
+        wr(APIC_LINT1, LVT_NMI);
+    }
+    isr_install(APIC_WAKE_VECTOR, wake_irq);
+    apic_enable();
+    return true;
+}
+
+void apic_enable(void)
+{
+    wr(APIC_TPR, 0);                /* accept every vector */
+    wr(APIC_SVR, SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+}
+
+void apic_eoi(void)
+{
+    wr(APIC_EOI, 0);
+}
+
+void apic_send_init(uint8_t apic_id)
+{
+    send_ipi(apic_id, ICR_INIT | ICR_ASSERT);
+}
+
+void apic_send_startup(uint8_t apic_id, uint32_t addr)
+{
+    send_ipi(apic_id, ICR_STARTUP | ICR_ASSERT | (addr >> 12));
+}
+
+void apic_wake_others(void)
+{
+    send_ipi(0, ICR_FIXED | ICR_ASSERT | ICR_OTHERS | APIC_WAKE_VECTOR);
+}
@@ -0,0 +1,24 @@
+/* apic.h  –  local APIC: enable, EOI and inter-processor interrupts */
+#ifndef APIC_H
+#define APIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define APIC_WAKE_VECTOR     0xF0   /* "there is work": ends an AP's hlt */
+#define APIC_SPURIOUS_VECTOR 0xFF
+
+/* map the registers at base and enable the BSP's APIC in virtual-wire
+   mode, so the 8259 keeps delivering IRQs through LINT0.  false if the
+   registers cannot be mapped.  After paging_init. */
+bool apic_init(uint32_t base);
+void apic_enable(void);             /* on each AP, after apic_init */
+void apic_eoi(void);
+
+/* INIT and STARTUP (SIPI) for AP bring-up; addr is the 4 KB aligned
+   real-mode entry point below 1 MB */
+void apic_send_init(uint8_t apic_id);
+void apic_send_startup(uint8_t apic_id, uint32_t addr);
+void apic_wake_others(void);        /* APIC_WAKE_VECTOR to every other CPU */
+
+#endif /* APIC_H */
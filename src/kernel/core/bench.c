@@ -0,0 +1,173 @@
+/* bench.c  –  the benchmarks, and how each one is timed
+ *
+ * Every sample is one call of the benchmark function between two
+ * cycles() reads.  A few untimed calls first warm the caches, the heap
+ * and the branch predictors.  Min is the best case, the median what to
+ * expect; max mostly counts the timer interrupts that hit a sample.
+ */
+#include "bench.h"
+#include "heap.h"
+#include "timer.h"
+#include "../io/vga.h"
+#include "../io/serial.h"
+#include "../lib/string.h"
+#include "../lib/float.h"
+#include "../lib/int.h"
+#include "../apps/qbasic.h"
+
+#define BUF_SIZE    (64 * 1024)
+
+struct bench {
+    const char *name;
+    bool (*fn)(uint32_t arg);       /* false: could not run, no sample */
+    uint32_t arg;
+    uint32_t iters;                 /* default sample count */
+    void (*done)(void);             /* tidy up after the samples, or NULL */
+};
+
+/* buffers for the copies; volatile operands keep the maths honest */
+static uint8_t *buf_a, *buf_b;
+static volatile float32 fa = { 0x3F9E0419 }, fb = { 0x3F7CAC08 }, fr;   /* 1.2345, 0.987 */
+static volatile uint32_t ua = 0xDEADBEEF, ub = 12345, ur;
+
+static const char qb_loop[] =
+    "LET S = 0\n"
+    "FOR I = 1 TO 1000\n"
+    "LET S = S + I\n"
+    "NEXT I\n";
+
+static bool b_memcpy(uint32_t n)   { memcpy(buf_b, buf_a, n); return true; }
+static bool b_memmove(uint32_t n)  { memmove(buf_a + 1, buf_a, n); return true; }  /* overlaps: copies backwards */
+static bool b_fmul(uint32_t n)     { (void)n; fr = float32_mul(fa, fb); return true; }
+static bool b_fdiv(uint32_t n)     { (void)n; fr = float32_div(fa, fb); return true; }
+static bool b_fsqrt(uint32_t n)    { (void)n; fr = float32_sqrt(fa); return true; }
+static bool b_udiv(uint32_t n)     { (void)n; ur = uint32_div(ua, ub); return true; }
+static bool b_putchar(uint32_t n)  { (void)n; terminal_putchar(' '); return true; }
+static bool b_scroll(uint32_t n)   { (void)n; terminal_scroll(); return true; }
+/* false while a background job has QBASIC: it only says it is busy */
+static bool b_qbasic(uint32_t n)   { (void)n; return qbasic_run_text(qb_loop, sizeof(qb_loop) - 1, true); }
+
+static void end_line(void)         { terminal_putchar('\n'); }
+
+static const struct bench benches[] = {
+    {"memcpy/64",      b_memcpy,   64,       1000, NULL},
+    {"memcpy/512",     b_memcpy,   512,      1000, NULL},
+    {"memcpy/4K",      b_memcpy,   4096,     1000, NULL},
+    {"memcpy/64K",     b_memcpy,   BUF_SIZE, 200,  NULL},
+    {"memmove/64",     b_memmove,  64,       1000, NULL},
+    {"memmove/4K",     b_memmove,  4096,     1000, NULL},
+    {"memmove/64K",    b_memmove,  BUF_SIZE, 200,  NULL},
+    {"float32_mul",    b_fmul,     0,        1000, NULL},
+    {"float32_div",    b_fdiv,     0,        1000, NULL},
+    {"float32_sqrt",   b_fsqrt,    0,        1000, NULL},
+    {"uint32_div",     b_udiv,     0,        1000, NULL},
+    {"putchar",        b_putchar,  0,        200,  end_line},
+    {"scroll",         b_scroll,   0,        200,  NULL},
+    {"qbasic/for1000", b_qbasic,   0,        20,   NULL},
+};
+#define NBENCH (int)(sizeof(benches) / sizeof(benches[0]))
+
+int bench_count(void)
+{
+    return NBENCH;
+}
+
+const char *bench_name(int i)
+{
+    return i >= 0 && i < NBENCH ? benches[i].name : NULL;
+}
+
+uint64_t bench_overhead(void)
+{
+    uint64_t best = (uint64_t)-1;
+    for (int i = 0; i < 64; ++i) {
+        uint64_t t0 = cycles();
+        uint64_t t = cycles() - t0;
+        if (t < best) best = t;
+    }
+    return best;
+}
+
+/* few enough samples that insertion sort is fine */
+static void sort(uint64_t *v, uint32_t n)
+{
+    for (uint32_t i = 1; i < n; ++i) {
+        uint64_t x = v[i];
+        uint32_t j = i;
+        for (; j > 0 && v[j - 1] > x; --j)
+            v[j] = v[j - 1];
+        v[j] = x;
+    }
+}
+
+enum bench_status bench_run(int i, uint32_t iters, uint64_t overhead, struct bench_result *r)
+{
+    const struct bench *b = &benches[i];
+    if (!iters) iters = b->iters;
+    if (iters > BENCH_MAX_ITERS) iters = BENCH_MAX_ITERS;
+
+    uint64_t *t = kmalloc(iters * sizeof(*t));
+    buf_a = kzalloc(BUF_SIZE + 16);     /* + 16: memmove shifts by one */
+    buf_b = kzalloc(BUF_SIZE);
+    enum bench_status st = t && buf_a && buf_b ? BENCH_OK : BENCH_NO_MEMORY;
+    for (uint32_t k = 0; st == BENCH_OK && k < iters / 8 + 1; ++k)
+        if (!b->fn(b->arg)) st = BENCH_UNAVAILABLE;
+    /* one failed run and the times say nothing: no result at all */
+    for (uint32_t k = 0; st == BENCH_OK && k < iters; ++k) {
+        uint64_t t0 = cycles();
+        bool ran = b->fn(b->arg);
+        uint64_t d = cycles() - t0;
+        t[k] = d > overhead ? d - overhead : 0;
+        if (!ran) st = BENCH_UNAVAILABLE;
+    }
+    if (st != BENCH_NO_MEMORY && b->done) b->done();
+    if (st == BENCH_OK) {
+        sort(t, iters);
+        r->name = b->name;
+        r->iters = iters;
+        r->min = t[0];
+        r->median = t[iters / 2];
+        r->max = t[iters - 1];
+    }
+    kfree(t);
+    kfree(buf_a);
+    kfree(buf_b);
+    buf_a = buf_b = NULL;
+    return st;
+}
+
+/* ---------- serial report ---------- */
+static void put_str(const char *s)
+{
+    serial_write(s, strlen(s));
+}
+
+static void put_u64(uint64_t v)
+{
+    char tmp[21];
+    int i = sizeof(tmp) - 1;
+    tmp[i] = '\0';
+    do {
+        uint32_t rem;
+        v = uint64_divmod32(v, 10, &rem);
+        tmp[--i] = '0' + rem;
+    } while (v);
+    put_str(tmp + i);
+}
+
+void bench_report_serial(const struct bench_result *r)
+{
+    put_str("BENCH ");
+    put_str(r->name);
+    put_str(" iters=");
+    put_u64(r->iters);
+    put_str(" min=");
+    put_u64(r->min);
+    put_str(" median=");
+    put_u64(r->median);
+    put_str(" max=");
+    put_u64(r->max);
+    put_str(" median_ns=");
+    put_u64(cycles_to_ns(r->median));
+    put_str("\n");
+}
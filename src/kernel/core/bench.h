@@ -0,0 +1,36 @@
+/* bench.h  –  microbenchmark registry: warm-up, N runs, min/median/max */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BENCH_MAX_ITERS 10000
+
+struct bench_result {
+    const char *name;
+    uint32_t iters;
+    uint64_t min, median, max;      /* cycles() per run, timer overhead taken off */
+};
+
+int bench_count(void);
+const char *bench_name(int i);
+
+/* cycles() read back to back, the least of a few tries */
+uint64_t bench_overhead(void);
+
+enum bench_status {
+    BENCH_OK,
+    BENCH_NO_MEMORY,                /* the samples don't fit */
+    BENCH_UNAVAILABLE,              /* a run could not happen (QBASIC busy) */
+};
+
+/* warm up, then time iters runs one by one (0: the benchmark's own
+   count); r is only filled in on BENCH_OK */
+enum bench_status bench_run(int i, uint32_t iters, uint64_t overhead, struct bench_result *r);
+
+/* "BENCH <name> iters=.. min=.. median=.. max=.. median_ns=..", cycles
+   but for the last, on the serial port only */
+void bench_report_serial(const struct bench_result *r);
+
+#endif /* BENCH_H */
@@ -0,0 +1,126 @@
+/* cpu.c  –  CPUID probing, x87 + SSE enable */
+#include "cpu.h"
+#include "../lib/string.h"
+
+#define CR0_MP  (1U << 1)       /* monitor coprocessor */
+#define CR0_EM  (1U << 2)       /* emulate: trap every FPU insn */
+#define CR0_TS  (1U << 3)       /* task switched: trap first FPU insn */
+#define CR0_NE  (1U << 5)       /* native FPU error reporting */
+#define CR4_OSFXSR     (1U << 9)
+#define CR4_OSXMMEXCPT (1U << 10)
+
+/* x87 control word: all exceptions masked, 24-bit precision so results
+   round exactly like IEEE single, round to nearest */
+#define FPU_CW_SINGLE  0x007F
+#define MXCSR_DEFAULT  0x1F80   /* all SIMD exceptions masked */
+
+struct cpu_features cpu_features;
+
+/* CPUID exists if EFLAGS.ID (bit 21) can be toggled */
+static bool has_cpuid(void)
+{
+    uint32_t before, after;
+    asm volatile ("pushfl\n"
+                  "pop %0\n"
+                  "mov %0, %1\n"
+                  "xor $0x200000, %1\n"
+                  "push %1\n"
+                  "popfl\n"
+                  "pushfl\n"
+                  "pop %1\n"
+                  "push %0\n"
+                  "popfl\n"
+                  : "=&r"(before), "=&r"(after));
+    return ((before ^ after) & 0x200000) != 0;
+}
+
+void cpu_detect(void)
+{
+    memset(&cpu_features, 0, sizeof(cpu_features));
+    if (!has_cpuid()) {
+        strcpy(cpu_features.vendor, "i486?");
+        return;
+    }
+
+    uint32_t a, b, c, d;
+    cpuid(0, &a, &b, &c, &d);
+    cpu_features.max_leaf = a;
+    memcpy(cpu_features.vendor + 0, &b, 4);
+    memcpy(cpu_features.vendor + 4, &d, 4);
+    memcpy(cpu_features.vendor + 8, &c, 4);
+    cpu_features.vendor[12] = '\0';
+    if (a < 1) return;
+
+    cpuid(1, &a, &b, &c, &d);
+    cpu_features.fpu  = (d >> 0)  & 1;
+    cpu_features.pse  = (d >> 3)  & 1;
+    cpu_features.tsc  = (d >> 4)  & 1;
+    cpu_features.msr  = (d >> 5)  & 1;
+    cpu_features.apic = (d >> 9)  & 1;
+    cpu_features.sep  = (d >> 11) & 1;
+    cpu_features.fxsr = (d >> 24) & 1;
+    cpu_features.sse  = (d >> 25) & 1;
+    cpu_features.sse2 = (d >> 26) & 1;
+}
+
+/* without CPUID: an FPU answers FNINIT/FNSTSW with a zero status word */
+static bool probe_fpu(void)
+{
+    uint16_t sw = 0xFFFF;
+    asm volatile ("fninit\n"
+                  "fnstsw %0\n"
+                  : "+m"(sw));
+    return sw == 0;
+}
+
+void fpu_init(void)
+{
+    uint32_t cr0 = read_cr0();
+    cr0 &= ~(CR0_EM | CR0_TS);
+    cr0 |= CR0_MP | CR0_NE;
+    write_cr0(cr0);
+
+    if (!cpu_features.max_leaf)
+        cpu_features.fpu = probe_fpu();
+    if (!cpu_features.fpu) {
+        write_cr0(cr0 | CR0_EM);    /* stray FPU insns trap as #NM */
+        return;
+    }
+
+    if (cpu_features.fxsr && cpu_features.sse)
+        write_cr4(read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+    else
+        cpu_features.sse = cpu_features.sse2 = false;
+    fpu_reset();
+}
+
+void fpu_reset(void)
+{
+    if (!cpu_features.fpu) return;
+    uint16_t cw = FPU_CW_SINGLE;
+    asm volatile ("fninit\n"
+                  "fldcw %0\n"
+                  : : "m"(cw));
+    if (cpu_features.sse) {
+        uint32_t mxcsr = MXCSR_DEFAULT;
+        asm volatile ("ldmxcsr %0" : : "m"(mxcsr));
+    }
+}
+
+/* FXSAVE only covers the XMM registers once CR4.OSFXSR is set, which
+   fpu_init does exactly when it keeps sse */
+void fpu_save(void *area)
+{
+    if (cpu_features.sse)
+        asm volatile ("fxsave (%0)" : : "r"(area) : "memory");
+    else if (cpu_features.fpu)
+        asm volatile ("fnsave (%0)" : : "r"(area) : "memory");
+}
+
+void fpu_restore(const void *area)
+{
+    if (cpu_features.sse)
+        asm volatile ("fxrstor (%0)" : : "r"(area) : "memory");
+    else if (cpu_features.fpu)
+        asm volatile ("frstor (%0)" : : "r"(area) : "memory");
+}
@@ -0,0 +1,75 @@
+/* cpu.h  –  CPUID feature detection and FPU/SSE setup */
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct cpu_features {
+    char     vendor[13];
+    uint32_t max_leaf;          /* 0 = no CPUID instruction */
+    bool fpu;                   /* x87 present and enabled */
+    bool tsc, msr, pse, apic, sep;
+    bool fxsr, sse, sse2;       /* sse/sse2 only set once CR4 allows them */
+};
+
+extern struct cpu_features cpu_features;
+
+static inline void cpuid(uint32_t leaf, uint32_t *a, uint32_t *b,
+                         uint32_t *c, uint32_t *d)
+{
+    asm volatile ("cpuid"
+                  : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d)
+                  : "a"(leaf), "c"(0));
+}
+
+/* time-stamp counter; only meaningful when cpu_features.tsc */
+static inline uint64_t rdtsc(void)
+{
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* model-specific registers; only when cpu_features.msr */
+static inline void wrmsr(uint32_t msr, uint64_t v)
+{
+    asm volatile ("wrmsr" : : "c"(msr), "a"((uint32_t)v), "d"((uint32_t)(v >> 32)));
+}
+
+/* control registers */
+static inline uint32_t read_cr0(void)
+{
+    uint32_t v; asm volatile ("mov %%cr0, %0" : "=r"(v)); return v;
+}
+static inline void write_cr0(uint32_t v) { asm volatile ("mov %0, %%cr0" : : "r"(v) : "memory"); }
+static inline uint32_t read_cr2(void)
+{
+    uint32_t v; asm volatile ("mov %%cr2, %0" : "=r"(v)); return v;
+}
+static inline uint32_t read_cr3(void)
+{
+    uint32_t v; asm volatile ("mov %%cr3, %0" : "=r"(v)); return v;
+}
+static inline void write_cr3(uint32_t v) { asm volatile ("mov %0, %%cr3" : : "r"(v) : "memory"); }
+static inline uint32_t read_cr4(void)
+{
+    uint32_t v; asm volatile ("mov %%cr4, %0" : "=r"(v)); return v;
+}
+static inline void write_cr4(uint32_t v) { asm volatile ("mov %0, %%cr4" : : "r"(v) : "memory"); }
+
+static inline void invlpg(uint32_t addr)
+{
+    asm volatile ("invlpg (%0)" : : "r"(addr) : "memory");
+}
+
+void cpu_detect(void);  /* fill cpu_features */
+void fpu_init(void);    /* CR0/CR4, FNINIT, MXCSR; after cpu_detect */
+
+/* x87/SSE state of one thread: FXSAVE layout, or FNSAVE without FXSR */
+#define FPU_STATE_SIZE 512
+void fpu_reset(void);                   /* the state fpu_init leaves */
+void fpu_save(void *area);              /* area 16-byte aligned */
+void fpu_restore(const void *area);
+
+#endif /* CPU_H */
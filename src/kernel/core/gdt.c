@@ -1,3 +1,4 @@
+#include "gdt.h"
 #include <stdint.h>
 #include <stddef.h>
 
@@ -17,52 +18,24 @@ struct GDTPointer {
     uint32_t base;         // Base address of the GDT
 } __attribute__((packed));
 
-// Structure for the Task State Segment (TSS)
-struct TSS {
-    uint32_t prev_tss;      // Previous TSS (not used)
-    uint32_t esp0;          // Stack pointer to load when switching to kernel mode
-    uint32_t ss0;           // Stack segment for kernel mode
-    uint32_t esp1;
-    uint32_t ss1;
-    uint32_t esp2;
-    uint32_t ss2;
-    uint32_t cr3;
-    uint32_t eip;
-    uint32_t eflags;
-    uint32_t eax;
-    uint32_t ecx;
-    uint32_t edx;
-    uint32_t ebx;
-    uint32_t esp;
-    uint32_t ebp;
-    uint32_t esi;
-    uint32_t edi;
-    uint32_t es;
-    uint32_t cs;
-    uint32_t ss;
-    uint32_t ds;
-    uint32_t fs;
-    uint32_t gs;
-    uint32_t ldt;
-    uint16_t trap;
-    uint16_t iomap_base;
-} __attribute__((packed));
-
 struct TSS tss;  // Declare a global TSS
+struct TSS df_tss;  // The BSP's double-fault task: runs on its own stack
 
-// GDT with 6 entries: Null, Kernel Code, Kernel Data, User Code, User Data, TSS
-struct GDTEntry gdt[6];
+// GDT with 7 entries: Null, Kernel Code, Kernel Data, User Code, User Data, TSS, double-fault TSS
+// This one is the BSP's; every AP builds its own with init_gdt_cpu()
+struct GDTEntry gdt[GDT_ENTRIES];
 struct GDTPointer gdtp;
 
 // Function to set a GDT entry
-void set_gdt_entry(int num, uint32_t base, uint32_t limit, uint8_t access, uint8_t granularity) {
-    gdt[num].base_low    = (base & 0xFFFF);
-    gdt[num].base_middle = (base >> 16) & 0xFF;
-    gdt[num].base_high   = (base >> 24) & 0xFF;
-
-    gdt[num].limit_low   = (limit & 0xFFFF);
-    gdt[num].granularity = ((limit >> 16) & 0x0F) | (granularity & 0xF0);
-    gdt[num].access      = access;
+static void set_gdt_entry(struct GDTEntry *g, int num, uint32_t base, uint32_t limit,
+                          uint8_t access, uint8_t granularity) {
+    g[num].base_low    = (base & 0xFFFF);
+    g[num].base_middle = (base >> 16) & 0xFF;
+    g[num].base_high   = (base >> 24) & 0xFF;
+
+    g[num].limit_low   = (limit & 0xFFFF);
+    g[num].granularity = ((limit >> 16) & 0x0F) | (granularity & 0xF0);
+    g[num].access      = access;
 }
 
 // Function to load the GDT (using inline assembly)
@@ -92,25 +65,39 @@ void tss_flush(uint16_t tss_segment_selector) {
     );
 }
 
-// Initialize the GDT and TSS
-void init_gdt() {
+// Fill a GDT whose TSS descriptors point at t and df
+static void build_gdt(struct GDTEntry *g, struct TSS *t, struct TSS *df) {
     // Null descriptor (0x0000)
-    set_gdt_entry(0, 0, 0, 0, 0);
+    set_gdt_entry(g, 0, 0, 0, 0, 0);
 
     // Kernel Code Segment (0x0008)
-    set_gdt_entry(1, 0, 0xFFFFF, 0x9A, 0xC0);
+    set_gdt_entry(g, 1, 0, 0xFFFFF, 0x9A, 0xC0);
 
     // Kernel Data Segment (0x0010)
-    set_gdt_entry(2, 0, 0xFFFFF, 0x92, 0xC0);
+    set_gdt_entry(g, 2, 0, 0xFFFFF, 0x92, 0xC0);
 
     // User Code Segment (0x0018)
-    set_gdt_entry(3, 0, 0xFFFFF, 0xFA, 0xC0);
+    set_gdt_entry(g, 3, 0, 0xFFFFF, 0xFA, 0xC0);
 
     // User Data Segment (0x0020)
-    set_gdt_entry(4, 0, 0xFFFFF, 0xF2, 0xC0);
+    set_gdt_entry(g, 4, 0, 0xFFFFF, 0xF2, 0xC0);
 
     // Task State Segment (0x0028)
-    set_gdt_entry(5, (uint32_t)&tss, sizeof(tss) - 1, 0x89, 0x00);
+    set_gdt_entry(g, 5, (uint32_t)t, sizeof(*t) - 1, 0x89, 0x00);
+
+    // Double-fault TSS (0x0030), filled in by set_double_fault_task().
+    // One per CPU: two CPUs faulting at once must not share a stack
+    set_gdt_entry(g, 6, (uint32_t)df, sizeof(*df) - 1, 0x89, 0x00);
+
+    // Initialize the TSS
+    t->ss0  = 0x10;     // Kernel data segment selector
+    t->esp0 = 0;        // Set the stack pointer later with your bootloader's stack
+    t->iomap_base = sizeof(*t);    // No I/O map
+}
+
+// Initialize the GDT and TSS
+void init_gdt() {
+    build_gdt(gdt, &tss, &df_tss);
 
     // Update the GDT pointer
     gdtp.limit = (sizeof(gdt) - 1);
@@ -119,16 +106,40 @@ void init_gdt() {
     // Flush the new GDT
     gdt_flush((uint32_t)&gdtp);
 
-    // Initialize the TSS
-    tss.ss0  = 0x10;    // Kernel data segment selector
-    tss.esp0 = 0;       // Set the stack pointer later with your bootloader's stack
-    tss.iomap_base = sizeof(tss);  // No I/O map
-
     // Flush the TSS (load it into the TR)
     tss_flush(0x28);  // 0x28 is the GDT entry selector for the TSS
 }
 
+// An AP's GDT: ltr marks the TSS descriptor busy, so every CPU needs
+// its own descriptor, and with it its own TSS (and double-fault TSS)
+void init_gdt_cpu(struct gdt_entry *g, struct TSS *t, struct TSS *df) {
+    struct GDTPointer p;
+    build_gdt((struct GDTEntry *)g, t, df);
+    p.limit = sizeof(struct GDTEntry) * GDT_ENTRIES - 1;
+    p.base  = (uint32_t)g;
+    gdt_flush((uint32_t)&p);
+    tss_flush(0x28);
+}
+
 // Function to set the kernel stack in TSS (uses the stack already provided by the bootloader)
 void set_kernel_stack(uint32_t stack) {
     tss.esp0 = stack;  // Set esp0 to the top of your bootloader-provided stack
+}
+
+// Prepare the task that IDT vector 8 switches to. A task switch loads a
+// fresh stack, so a double fault caused by a full stack can still run.
+// entry is entered as if called with faulted, the TSS the CPU saves the
+// interrupted state into.
+void set_double_fault_task(struct TSS *df, void (*entry)(struct TSS *faulted),
+                           struct TSS *faulted, uint32_t stack, uint32_t cr3) {
+    uint32_t *sp = (uint32_t *)((stack & ~15u) - 16);
+    sp[0] = (uint32_t)faulted;  // The argument, 16-aligned as after a call
+    *--sp = 0;                  // A return address nobody uses
+    df->eip = (uint32_t)entry;
+    df->esp = (uint32_t)sp;
+    df->cr3 = cr3;
+    df->eflags = 0x2;       // Reserved bit only: interrupts stay off
+    df->cs  = 0x08;
+    df->ss  = df->ds = df->es = df->fs = df->gs = 0x10;
+    df->iomap_base = sizeof(*df);
 }
\ No newline at end of file
@@ -4,6 +4,9 @@
 
 #include <stdint.h>
 
+/* null, kernel code/data, user code/data, TSS, double-fault TSS */
+#define GDT_ENTRIES 7
+
 /* 8-byte GDT descriptor */
 struct gdt_entry {
     uint16_t limit_low;
@@ -20,12 +23,54 @@ struct gdt_ptr {
     uint32_t base;
 } __attribute__((packed));
 
+// Structure for the Task State Segment (TSS)
+struct TSS {
+    uint32_t prev_tss;      // Previous TSS (not used)
+    uint32_t esp0;          // Stack pointer to load when switching to kernel mode
+    uint32_t ss0;           // Stack segment for kernel mode
+    uint32_t esp1;
+    uint32_t ss1;
+    uint32_t esp2;
+    uint32_t ss2;
+    uint32_t cr3;
+    uint32_t eip;
+    uint32_t eflags;
+    uint32_t eax;
+    uint32_t ecx;
+    uint32_t edx;
+    uint32_t ebx;
+    uint32_t esp;
+    uint32_t ebp;
+    uint32_t esi;
+    uint32_t edi;
+    uint32_t es;
+    uint32_t cs;
+    uint32_t ss;
+    uint32_t ds;
+    uint32_t fs;
+    uint32_t gs;
+    uint32_t ldt;
+    uint16_t trap;
+    uint16_t iomap_base;
+} __attribute__((packed));
+
+extern struct TSS tss;      /* the running task; a task switch saves into it */
+extern struct TSS df_tss;   /* the BSP's double-fault task */
+
+#define GDT_DF_TSS  0x30    /* selector of the double-fault task */
+
 /* ---------- assembly helpers ---------- */
 extern void gdt_flush(uint32_t gdt_ptr);   /* lgdt + reload segs */
 extern void tss_flush(uint16_t sel);       /* ltr  */
 
 /* ---------- C API ---------- */
 void init_gdt(void);                /* build and load the GDT */
+/* an AP's own copy: the same segments, its own TSS, double-fault TSS
+   and task register */
+void init_gdt_cpu(struct gdt_entry *gdt, struct TSS *tss, struct TSS *df_tss);
 void set_kernel_stack(uint32_t stack); /* update tss.esp0 */
+/* df runs entry(faulted) on stack; faulted is the TSS of the same CPU */
+void set_double_fault_task(struct TSS *df, void (*entry)(struct TSS *faulted),
+                           struct TSS *faulted, uint32_t stack, uint32_t cr3);
 
 #endif /* GDT_H */
\ No newline at end of file
@@ -0,0 +1,263 @@
+/* heap.c  –  size-class slabs on pmm pages, page runs for large blocks
+ *
+ * Every allocation starts inside a page whose first bytes are a struct
+ * slab, so kfree() finds its bookkeeping by rounding the pointer down.
+ * A slab page is cut into equal objects chained on a free list; a large
+ * block is a run of pages with the payload right after the header.
+ */
+#include "heap.h"
+#include "pmm.h"
+#include "thread.h"
+#include "spinlock.h"
+#include "../lib/string.h"
+#include <stdbool.h>
+
+#define SLAB_MAGIC   0x51AB51ABu
+#define LARGE_MAGIC  0x1A26E000u
+#define MIN_SHIFT    4          /* class 0 = 16 bytes */
+
+struct slab {
+    uint32_t magic;
+    uint16_t cls;
+    uint16_t inuse;             /* objects handed out */
+    uint32_t npages;            /* large blocks: pages in the run */
+    uint32_t requested;         /* large blocks: bytes asked for */
+    void *free;                 /* slab: first free object */
+    struct slab *next, *prev;   /* slab: class list of pages with room */
+    uint32_t pad;
+};                              /* 32 bytes: objects stay 16-byte aligned */
+
+struct size_class {
+    struct slab *partial;       /* pages with at least one free object */
+    uint16_t per_slab;
+    struct heap_class_stats st;
+};
+
+static struct size_class classes[HEAP_CLASSES];
+static struct heap_stats totals;        /* large blocks and failures */
+static bool ready;
+
+static struct slab *slab_of(const void *p)
+{
+    return (struct slab *)((uintptr_t)p & ~(uintptr_t)(PAGE_SIZE - 1));
+}
+
+static void heap_init(void)
+{
+    for (int c = 0; c < HEAP_CLASSES; ++c) {
+        classes[c].st.size = 1u << (c + MIN_SHIFT);
+        classes[c].per_slab = (PAGE_SIZE - sizeof(struct slab)) >> (c + MIN_SHIFT);
+    }
+    ready = true;
+}
+
+/* smallest class that fits n (1 <= n <= HEAP_SLAB_MAX) */
+static int class_of(size_t n)
+{
+    int c = 0;
+    while ((1u << (c + MIN_SHIFT)) < n) c++;
+    return c;
+}
+
+/* ---------- slab lists ---------- */
+static void unlink_slab(struct size_class *sc, struct slab *s)
+{
+    if (s->prev) s->prev->next = s->next;
+    else sc->partial = s->next;
+    if (s->next) s->next->prev = s->prev;
+    s->next = s->prev = NULL;
+}
+
+static void push_slab(struct size_class *sc, struct slab *s)
+{
+    s->prev = NULL;
+    s->next = sc->partial;
+    if (sc->partial) sc->partial->prev = s;
+    sc->partial = s;
+}
+
+static struct slab *new_slab(int c)
+{
+    struct slab *s = (struct slab *)pmm_alloc();
+    if (!s) return NULL;
+
+    struct size_class *sc = &classes[c];
+    uint32_t size = sc->st.size;
+    s->magic = SLAB_MAGIC;
+    s->cls = (uint16_t)c;
+    s->inuse = 0;
+    s->npages = 1;
+
+    /* thread the free list through the objects, lowest address first */
+    char *obj = (char *)(s + 1);
+    s->free = obj;
+    for (uint32_t i = 1; i < sc->per_slab; ++i, obj += size)
+        *(void **)obj = obj + size;
+    *(void **)obj = NULL;
+
+    push_slab(sc, s);
+    sc->st.slabs++;
+    return s;
+}
+
+static void *slab_alloc(int c)
+{
+    struct size_class *sc = &classes[c];
+    struct slab *s = sc->partial;
+    if (!s && !(s = new_slab(c))) return NULL;
+
+    void *obj = s->free;
+    s->free = *(void **)obj;
+    s->inuse++;
+    if (!s->free) unlink_slab(sc, s);          /* full: out of the way */
+    sc->st.live++;
+    sc->st.allocs++;
+    return obj;
+}
+
+static void slab_free(struct slab *s, void *obj)
+{
+    struct size_class *sc = &classes[s->cls];
+    if (!s->free) push_slab(sc, s);            /* was full, has room again */
+    *(void **)obj = s->free;
+    s->free = obj;
+    s->inuse--;
+    sc->st.live--;
+    sc->st.frees++;
+
+    /* an empty page goes back unless it is the class's only one */
+    if (!s->inuse && (sc->partial != s || s->next)) {
+        unlink_slab(sc, s);
+        s->magic = 0;
+        pmm_free((uint32_t)s);
+        sc->st.slabs--;
+    }
+}
+
+/* ---------- large blocks ---------- */
+static void *large_alloc(size_t size)
+{
+    uint32_t npages = (size + sizeof(struct slab) + PAGE_SIZE - 1) >> PAGE_SHIFT;
+    struct slab *s = (struct slab *)pmm_alloc_pages(npages);
+    if (!s) return NULL;
+
+    s->magic = LARGE_MAGIC;
+    s->npages = npages;
+    s->requested = size;
+    totals.large_live++;
+    totals.large_pages += npages;
+    totals.large_allocs++;
+    totals.large_bytes += size;
+    return s + 1;
+}
+
+static void large_free(struct slab *s)
+{
+    totals.large_live--;
+    totals.large_pages -= s->npages;
+    totals.large_frees++;
+    totals.large_bytes -= s->requested;
+    s->magic = 0;
+    pmm_free_pages((uint32_t)s, s->npages);
+}
+
+/* ---------- public API ----------
+   Threads share the heap, ring-3 programs call it too, and so do pool
+   tasks on the other CPUs: every entry point holds heap_lock, with
+   preemption off so the BSP never switches away while holding it. */
+static spinlock_t heap_lock = SPINLOCK_INIT;
+
+static void lock(void)
+{
+    preempt_disable();
+    spin_lock(&heap_lock);
+}
+
+static void unlock(void)
+{
+    spin_unlock(&heap_lock);
+    preempt_enable();
+}
+
+void *kmalloc(size_t size)
+{
+    if (!size) size = 1;
+
+    lock();
+    if (!ready) heap_init();
+    void *p = size <= HEAP_SLAB_MAX ? slab_alloc(class_of(size)) : large_alloc(size);
+    if (!p) totals.failed++;
+    unlock();
+    return p;
+}
+
+void *kzalloc(size_t size)
+{
+    void *p = kmalloc(size);
+    if (p) memset(p, 0, size);
+    return p;
+}
+
+size_t ksize(const void *p)
+{
+    if (!p) return 0;
+    const struct slab *s = slab_of(p);
+    if (s->magic == LARGE_MAGIC)
+        return (s->npages << PAGE_SHIFT) - sizeof(struct slab);
+    return classes[s->cls].st.size;
+}
+
+void kfree(void *p)
+{
+    if (!p) return;
+    struct slab *s = slab_of(p);
+    lock();
+    if (s->magic == LARGE_MAGIC) {
+        large_free(s);
+    } else if (s->magic == SLAB_MAGIC) {
+        slab_free(s, p);
+    }
+    unlock();
+}
+
+/* true if p can keep size bytes where it is */
+static bool resize_in_place(void *p, size_t size)
+{
+    struct slab *s = slab_of(p);
+    if (size > ksize(p)) return false;
+    /* stay put unless a large block could drop to a slab */
+    if (s->magic == LARGE_MAGIC && size <= HEAP_SLAB_MAX) return false;
+    if (s->magic == LARGE_MAGIC) {
+        totals.large_bytes += size - s->requested;
+        s->requested = size;
+    }
+    return true;
+}
+
+void *krealloc(void *p, size_t size)
+{
+    if (!p) return kmalloc(size);
+    if (!size) size = 1;
+
+    lock();
+    bool kept = resize_in_place(p, size);
+    unlock();
+    if (kept) return p;
+
+    size_t have = ksize(p);
+    void *q = kmalloc(size);
+    if (!q) return NULL;
+    memcpy(q, p, size < have ? size : have);
+    kfree(p);
+    return q;
+}
+
+void heap_get_stats(struct heap_stats *st)
+{
+    lock();
+    if (!ready) heap_init();
+    *st = totals;
+    for (int c = 0; c < HEAP_CLASSES; ++c)
+        st->cls[c] = classes[c].st;
+    unlock();
+}
@@ -0,0 +1,34 @@
+/* heap.h  –  kmalloc: slabs for small objects, whole pages for big ones */
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HEAP_CLASSES    7       /* 16, 32, ... 1024 bytes */
+#define HEAP_SLAB_MAX   1024    /* larger requests get their own pages */
+
+void *kmalloc(size_t size);             /* 16-byte aligned, NULL when out */
+void *kzalloc(size_t size);             /* zeroed */
+void *krealloc(void *p, size_t size);   /* p may be NULL; NULL keeps p */
+void  kfree(void *p);                   /* NULL is fine */
+size_t ksize(const void *p);            /* usable bytes at p */
+
+struct heap_class_stats {
+    uint32_t size;              /* object size */
+    uint32_t slabs;             /* pages owned by the class */
+    uint32_t live;              /* objects handed out now */
+    uint32_t allocs, frees;     /* since boot */
+};
+
+struct heap_stats {
+    struct heap_class_stats cls[HEAP_CLASSES];
+    uint32_t large_live, large_pages;
+    uint32_t large_allocs, large_frees;
+    uint32_t large_bytes;       /* asked for by live large blocks */
+    uint32_t failed;            /* requests the pmm could not back */
+};
+
+void heap_get_stats(struct heap_stats *st);
+
+#endif /* HEAP_H */
@@ -0,0 +1,191 @@
+/* idt.c  –  IDT setup, ISR stubs and C dispatch */
+#include "idt.h"
+#include "../io/pic.h"
+#include "syscall.h"
+#include "thread.h"
+#include "apic.h"
+#include "../io/vga.h"
+#include <stddef.h>
+
+#define IDT_ENTRIES 256
+#define NUM_STUBS   48          /* 32 exceptions + 16 IRQs */
+
+/* 8-byte interrupt gate */
+struct idt_entry {
+    uint16_t base_low;
+    uint16_t sel;
+    uint8_t  zero;
+    uint8_t  flags;
+    uint16_t base_high;
+} __attribute__((packed));
+
+struct idt_ptr {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed));
+
+static struct idt_entry idt[IDT_ENTRIES];
+static struct idt_ptr   idtp;
+static isr_handler_t    handlers[IDT_ENTRIES];
+
+/* ---------- assembly stubs ----------
+   Every vector pushes (err_code, int_no) so all frames look alike; the
+   CPU already pushed an error code for 8, 10-14, 17, 21, 29 and 30. */
+#define ISR_NOERR(n) ".global isr" #n "\nisr" #n ":\n" \
+                     "  push $0\n  push $" #n "\n  jmp isr_common\n"
+#define ISR_ERR(n)   ".global isr" #n "\nisr" #n ":\n" \
+                     "  push $" #n "\n  jmp isr_common\n"
+
+asm(".text\n"
+    ISR_NOERR(0)  ISR_NOERR(1)  ISR_NOERR(2)  ISR_NOERR(3)
+    ISR_NOERR(4)  ISR_NOERR(5)  ISR_NOERR(6)  ISR_NOERR(7)
+    ISR_ERR(8)    ISR_NOERR(9)  ISR_ERR(10)   ISR_ERR(11)
+    ISR_ERR(12)   ISR_ERR(13)   ISR_ERR(14)   ISR_NOERR(15)
+    ISR_NOERR(16) ISR_ERR(17)   ISR_NOERR(18) ISR_NOERR(19)
+    ISR_NOERR(20) ISR_ERR(21)   ISR_NOERR(22) ISR_NOERR(23)
+    ISR_NOERR(24) ISR_NOERR(25) ISR_NOERR(26) ISR_NOERR(27)
+    ISR_NOERR(28) ISR_ERR(29)   ISR_ERR(30)   ISR_NOERR(31)
+    ISR_NOERR(32) ISR_NOERR(33) ISR_NOERR(34) ISR_NOERR(35)
+    ISR_NOERR(36) ISR_NOERR(37) ISR_NOERR(38) ISR_NOERR(39)
+    ISR_NOERR(40) ISR_NOERR(41) ISR_NOERR(42) ISR_NOERR(43)
+    ISR_NOERR(44) ISR_NOERR(45) ISR_NOERR(46) ISR_NOERR(47)
+    ISR_NOERR(128) ISR_NOERR(240) ISR_NOERR(255)
+    "isr_common:\n"
+    "  pusha\n"
+    "  push %ds\n  push %es\n  push %fs\n  push %gs\n"
+    "  mov $0x10, %ax\n"            /* kernel data segment */
+    "  mov %ax, %ds\n  mov %ax, %es\n  mov %ax, %fs\n  mov %ax, %gs\n"
+    "  cld\n"
+    "  push %esp\n"                 /* struct regs * */
+    "  call isr_dispatch\n"
+    "  add $4, %esp\n"
+    "  pop %gs\n  pop %fs\n  pop %es\n  pop %ds\n"
+    "  popa\n"
+    "  add $8, %esp\n"              /* int_no + err_code */
+    "  iret\n");
+
+#define STUB(n) ".long isr" #n "\n"
+asm(".section .data\n"
+    ".align 4\n"
+    "isr_stub_table:\n"
+    STUB(0)  STUB(1)  STUB(2)  STUB(3)  STUB(4)  STUB(5)  STUB(6)  STUB(7)
+    STUB(8)  STUB(9)  STUB(10) STUB(11) STUB(12) STUB(13) STUB(14) STUB(15)
+    STUB(16) STUB(17) STUB(18) STUB(19) STUB(20) STUB(21) STUB(22) STUB(23)
+    STUB(24) STUB(25) STUB(26) STUB(27) STUB(28) STUB(29) STUB(30) STUB(31)
+    STUB(32) STUB(33) STUB(34) STUB(35) STUB(36) STUB(37) STUB(38) STUB(39)
+    STUB(40) STUB(41) STUB(42) STUB(43) STUB(44) STUB(45) STUB(46) STUB(47)
+    ".text\n");
+
+extern const uint32_t isr_stub_table[NUM_STUBS];
+extern void isr128(void);
+extern void isr240(void);
+extern void isr255(void);
+
+static const char *const exc_names[32] = {
+    "Divide error", "Debug", "NMI", "Breakpoint", "Overflow",
+    "Bound range", "Invalid opcode", "Device not available",
+    "Double fault", "Coprocessor overrun", "Invalid TSS",
+    "Segment not present", "Stack fault", "General protection",
+    "Page fault", "Reserved", "x87 FP error", "Alignment check",
+    "Machine check", "SIMD FP error", "Virtualization", "Control protection",
+    "Reserved", "Reserved", "Reserved", "Reserved", "Reserved", "Reserved",
+    "Hypervisor injection", "VMM communication", "Security", "Reserved"
+};
+
+const char *exception_name(uint32_t vec)
+{
+    return exc_names[vec & 31];
+}
+
+/* ---------- helpers ---------- */
+static void print_hex(uint32_t v)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    char buf[11] = "0x";
+    for (int i = 0; i < 8; ++i)
+        buf[2 + i] = digits[(v >> (28 - 4 * i)) & 0xF];
+    buf[10] = '\0';
+    terminal_writestring(buf);
+}
+
+static void unhandled_exception(struct regs *r)
+{
+    terminal_setcolor(VGA_COLOR_RED);
+    terminal_writestring("\nEXCEPTION: ");
+    terminal_writestring(exc_names[r->int_no]);
+    terminal_writestring("  err=");
+    print_hex(r->err_code);
+    terminal_writestring("  eip=");
+    print_hex(r->eip);
+    terminal_writestring("\nSystem halted.\n");
+    terminal_set_autoflush(true);
+    for (;;) asm volatile ("cli; hlt");
+}
+
+/* ---------- C dispatch (called from isr_common) ---------- */
+void isr_dispatch(struct regs *r);
+void isr_dispatch(struct regs *r)
+{
+    if (r->int_no >= IRQ_BASE && r->int_no < IRQ_BASE + 16) {
+        uint8_t irq = r->int_no - IRQ_BASE;
+        if (pic_is_spurious(irq)) return;
+        pic_eoi(irq);           /* before the handler: it may not return soon */
+        if (handlers[r->int_no]) handlers[r->int_no](r);
+        thread_irq_exit(r);     /* preemption happens here */
+        return;
+    }
+
+    if (r->int_no < 32 && (r->cs & 3) == 3) {
+        user_fault(r);          /* ends the program, not the kernel */
+        return;
+    }
+    if (handlers[r->int_no]) {
+        handlers[r->int_no](r);
+        return;
+    }
+    if (r->int_no < 32) unhandled_exception(r);
+}
+
+/* ---------- gate setup ---------- */
+void set_idt_entry(int num, uint32_t base, uint16_t sel, uint8_t flags)
+{
+    idt[num].base_low  = base & 0xFFFF;
+    idt[num].base_high = (base >> 16) & 0xFFFF;
+    idt[num].sel       = sel;
+    idt[num].zero      = 0;
+    idt[num].flags     = flags;
+}
+
+void init_idt(void)
+{
+    /* 0x8E = present, DPL 0, 32-bit interrupt gate */
+    for (int i = 0; i < NUM_STUBS; ++i)
+        set_idt_entry(i, isr_stub_table[i], 0x08, 0x8E);
+    /* 0xEE = the same with DPL 3, so user mode may raise it */
+    set_idt_entry(SYSCALL_VECTOR, (uint32_t)isr128, 0x08, 0xEE);
+    /* local APIC: wake-up IPI and spurious vector */
+    set_idt_entry(APIC_WAKE_VECTOR, (uint32_t)isr240, 0x08, 0x8E);
+    set_idt_entry(APIC_SPURIOUS_VECTOR, (uint32_t)isr255, 0x08, 0x8E);
+
+    idtp.limit = sizeof(idt) - 1;
+    idtp.base  = (uint32_t)&idt;
+    idt_load();
+
+    pic_remap(IRQ_BASE, IRQ_BASE + 8);
+}
+
+void idt_load(void)
+{
+    asm volatile ("lidt (%0)" : : "r"(&idtp) : "memory");
+}
+
+void isr_install(uint8_t vec, isr_handler_t h)
+{
+    handlers[vec] = h;
+}
+
+void irq_install(uint8_t irq, isr_handler_t h)
+{
+    handlers[IRQ_BASE + irq] = h;
+    pic_unmask(irq);
+}
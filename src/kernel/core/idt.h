@@ -0,0 +1,28 @@
+/* idt.h  –  32-bit IDT, exception and IRQ dispatch */
+#ifndef IDT_H
+#define IDT_H
+
+#include <stdint.h>
+
+#define IRQ_BASE    0x20        /* PIC remapped above the CPU exceptions */
+#define SYSCALL_VECTOR 0x80     /* int 0x80, the only gate ring 3 may use */
+
+/* stack frame built by the common ISR stub */
+struct regs {
+    uint32_t gs, fs, es, ds;
+    uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax;   /* pusha */
+    uint32_t int_no, err_code;
+    uint32_t eip, cs, eflags, useresp, ss;             /* pushed by CPU */
+};
+
+typedef void (*isr_handler_t)(struct regs *r);
+
+/* ---------- C API ---------- */
+void init_idt(void);                               /* build + lidt, remap PIC */
+void idt_load(void);                               /* lidt only: one IDT for all CPUs */
+void set_idt_entry(int num, uint32_t base, uint16_t sel, uint8_t flags);
+void isr_install(uint8_t vec, isr_handler_t h);    /* CPU exception handler */
+void irq_install(uint8_t irq, isr_handler_t h);    /* handler + unmask line */
+const char *exception_name(uint32_t vec);          /* vec < 32 */
+
+#endif /* IDT_H */
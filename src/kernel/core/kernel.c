@@ -1,6 +1,22 @@
 /* kernel.c  –  32-bit kernel entry, launches integrated TTY shell */
 #include "../io/vga.h"
 #include "../core/gdt.h"
+#include "../core/idt.h"
+#include "../core/cpu.h"
+#include "../core/timer.h"
+#include "../core/pmm.h"
+#include "../core/paging.h"
+#include "../core/syscall.h"
+#include "../core/thread.h"
+#include "../core/smp.h"
+#include "../fs/ramdisk.h"
+#include "../fs/bcache.h"
+#include "../fs/fat.h"
+#include "../io/ata.h"
+#include "../lib/float.h"
+#include "../lib/string.h"
+#include "../io/keyboard.h"
+#include "../io/serial.h"
 #include "../core/tty.h"          /* new: integrated shell */
 
 static void klog(int level, const char *msg)
@@ -16,15 +32,114 @@ static void klog(int level, const char *msg)
     terminal_writestring(msg);
 }
 
+static void kputu(uint32_t v)
+{
+    char tmp[11];
+    int i = sizeof(tmp) - 1;
+    tmp[i] = '\0';
+    do {
+        tmp[--i] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    terminal_writestring(tmp + i);
+}
+
 /* ---------- C entry point called from ASM ---------- */
-void _init(void)
+void _init(uint32_t magic, const struct multiboot_info *mbi)
 {
+    bool serial = serial_init();     /* first, so it sees the whole log */
     terminal_initialize();
     klog(1, "Terminal ready");
     terminal_putchar('\n');
+    if (magic != MULTIBOOT_BOOTLOADER_MAGIC) {
+        klog(2, "Not started by a multiboot loader, assuming 4 MB RAM\n");
+        mbi = NULL;
+    }
+    pmm_init(mbi);
+    klog(1, "Page frames: ");
+    kputu(pmm_free_count());
+    terminal_writestring(" free of ");
+    kputu(pmm_total_pages());
+    terminal_writestring(" (");
+    kputu(pmm_total_pages() >> (20 - PAGE_SHIFT));
+    terminal_writestring(" MB)\n");
+    ramdisk_init(mbi);
+    if (ramdisk_modules()) {
+        klog(1, "RAM disk: ");
+        kputu(ramdisk_count());
+        terminal_writestring(" files in ");
+        kputu(ramdisk_modules());
+        terminal_writestring(ramdisk_modules() == 1 ? " module\n" : " modules\n");
+    }
     init_gdt();
     klog(1, "GDT loaded");
     terminal_putchar('\n');
+    init_idt();
+    klog(1, "IDT loaded, PIC remapped");
+    terminal_putchar('\n');
+    serial_start();
+    if (serial)
+        klog(1, "Serial console on COM1, 115200 8N1\n");
+    cpu_detect();
+    fpu_init();
+    if (cpu_features.fpu) {
+        float32_init(FLOAT32_X87);
+        klog(1, cpu_features.sse ? "x87 FPU + SSE enabled" : "x87 FPU enabled");
+    } else {
+        klog(2, "No FPU, using soft-float");
+    }
+    terminal_putchar('\n');
+    smp_detect();                   /* ACPI tables may sit outside the map */
+    paging_init();
+    klog(1, paging_large_pages() ? "Paging on, 4 MB pages above 4 MB"
+                                 : "Paging on, 4 KB pages");
+    terminal_putchar('\n');
+    syscall_init();
+    klog(1, syscall_fast ? "System calls via SYSENTER" : "System calls via int 0x80");
+    terminal_putchar('\n');
+    thread_init();
+    string_init(cpu_features.sse2);
+    keyboard_init();
+    asm volatile ("sti");
+    klog(1, "Keyboard on IRQ1");
+    terminal_putchar('\n');
+    timer_init();
+    klog(1, cpu_features.tsc ? "PIT on IRQ0, TSC calibrated" : "PIT on IRQ0, no TSC");
+    terminal_putchar('\n');
+    smp_init();                     /* needs the timer for its delays */
+    if (smp_cpu_count() < smp_cpu_found()) {
+        klog(2, "CPUs online: ");
+        kputu(smp_cpu_count());
+        terminal_writestring(" of ");
+        kputu(smp_cpu_found());
+    } else {
+        klog(1, "CPUs online: ");
+        kputu(smp_cpu_count());
+    }
+    terminal_putchar('\n');
+    ata_init();                     /* its timeouts count timer ticks */
+    for (int n = 0; n < ATA_MAX_DRIVES; ++n) {
+        const struct ata_drive *d = ata_drive(n);
+        if (!d) continue;
+        klog(1, "Disk ");
+        kputu(n);
+        terminal_writestring(": ");
+        terminal_writestring(d->model);
+        terminal_writestring(", ");
+        kputu(d->sectors >> 11);
+        terminal_writestring(d->dma ? " MB, DMA\n" : " MB, PIO\n");
+    }
+    if (!bcache_init())
+        klog(2, "No memory for the block cache\n");
+    for (int n = 0; n < ATA_MAX_DRIVES && !fat_mount(n); ++n)
+        ;
+    if (fat_mounted()) {
+        klog(1, "FAT");
+        kputu(fat_bits());
+        terminal_writestring(" on disk ");
+        kputu(fat_dev());
+        terminal_putchar('\n');
+    }
     terminal_writestring("Welcome to LazyDOS v0.0.1!\n");
     /* start the built-in interactive shell */
     tty_main();          /* never returns */
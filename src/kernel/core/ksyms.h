@@ -0,0 +1,19 @@
+/* ksyms.h  –  kernel symbol table, generated at link time */
+#ifndef KSYMS_H
+#define KSYMS_H
+
+#include <stdint.h>
+
+struct ksym {
+    uint32_t addr;
+    const char *name;
+};
+
+/* sorted by address, followed by an end marker at 0xFFFFFFFF */
+extern const struct ksym ksyms[];
+extern const unsigned ksyms_count;
+
+/* function containing addr, or NULL before the first symbol */
+const struct ksym *ksym_lookup(uint32_t addr);
+
+#endif /* KSYMS_H */
@@ -0,0 +1,40 @@
+/* multiboot.h  –  Multiboot 1 information handed over in ebx */
+#ifndef MULTIBOOT_H
+#define MULTIBOOT_H
+
+#include <stdint.h>
+
+#define MULTIBOOT_BOOTLOADER_MAGIC  0x2BADB002  /* eax at _start */
+
+/* multiboot_info.flags: which fields are valid */
+#define MB_INFO_MEMORY   (1u << 0)  /* mem_lower / mem_upper */
+#define MB_INFO_CMDLINE  (1u << 2)
+#define MB_INFO_MODS     (1u << 3)
+#define MB_INFO_MMAP     (1u << 6)
+
+#define MB_MEMORY_AVAILABLE  1      /* mmap entry type usable as RAM */
+
+struct multiboot_info {
+    uint32_t flags;
+    uint32_t mem_lower, mem_upper;  /* KB below 1 MB / above 1 MB */
+    uint32_t boot_device;
+    uint32_t cmdline;
+    uint32_t mods_count, mods_addr;
+    uint32_t syms[4];
+    uint32_t mmap_length, mmap_addr;
+} __attribute__((packed));
+
+/* size does not count itself: the next entry is at (char *)e + e->size + 4 */
+struct multiboot_mmap_entry {
+    uint32_t size;
+    uint64_t addr, len;
+    uint32_t type;
+} __attribute__((packed));
+
+struct multiboot_module {
+    uint32_t mod_start, mod_end;    /* [start, end) physical */
+    uint32_t string;                /* NUL-terminated command line */
+    uint32_t reserved;
+} __attribute__((packed));
+
+#endif /* MULTIBOOT_H */
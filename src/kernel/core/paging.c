@@ -0,0 +1,257 @@
+/* paging.c  –  page directory, #PF reporting and the double-fault task */
+#include "paging.h"
+#include "pmm.h"
+#include "cpu.h"
+#include "gdt.h"
+#include "idt.h"
+#include "ksyms.h"
+#include "../io/vga.h"
+#include "../lib/string.h"
+#include <stddef.h>
+
+#define ENTRIES         1024
+#define PDE_SHIFT       22
+#define FRAME_MASK      0xFFFFF000u
+#define LARGE_MASK      0xFFC00000u
+
+#define MAX_GUARDS      48      /* boot, thread, AP and ring-3 stacks */
+
+#define CR0_WP          (1u << 16)
+#define CR0_PG          (1u << 31)
+#define CR4_PSE         (1u << 4)
+
+/* #PF error code */
+#define PF_PRESENT      0x01
+#define PF_WRITE        0x02
+#define PF_USER         0x04
+
+extern char stack_guard_low[], stack_guard_high[];     /* boot.asm */
+
+static uint32_t page_dir[ENTRIES] __attribute__((aligned(4096)));
+static uint32_t low_table[ENTRIES] __attribute__((aligned(4096)));
+static bool large_pages;
+static uint32_t guards[MAX_GUARDS];     /* unmapped below/above stacks */
+static int nguards;
+
+/* the double-fault task gets a stack of its own: the fault it handles
+   is usually the kernel stack running into its guard page.  This one
+   is the BSP's, each AP has one in its struct cpu. */
+static uint8_t df_stack[DF_STACK_SIZE] __attribute__((aligned(16)));
+
+/* ---------- helpers ---------- */
+static void print_hex(uint32_t v)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    char buf[11] = "0x";
+    for (int i = 0; i < 8; ++i)
+        buf[2 + i] = digits[(v >> (28 - 4 * i)) & 0xF];
+    buf[10] = '\0';
+    terminal_writestring(buf);
+}
+
+static void print_where(uint32_t eip)
+{
+    terminal_writestring("  eip=");
+    print_hex(eip);
+    const struct ksym *s = ksym_lookup(eip);
+    if (s) {
+        terminal_writestring(" <");
+        terminal_writestring(s->name);
+        terminal_writestring(">");
+    }
+}
+
+static bool in_guard(uint32_t addr)
+{
+    for (int i = 0; i < nguards; ++i)
+        if (addr >= guards[i] && addr - guards[i] < PAGE_SIZE)
+            return true;
+    return false;
+}
+
+static void halt(void)
+{
+    terminal_writestring("\nSystem halted.\n");
+    terminal_set_autoflush(true);
+    for (;;) asm volatile ("cli; hlt");
+}
+
+/* ---------- tables ---------- */
+static uint32_t *table_of(uint32_t pde)
+{
+    return (uint32_t *)(pde & FRAME_MASK);
+}
+
+/* page table covering virt, created (or split from a 4 MB page) on
+   demand; NULL when no frame is left */
+static uint32_t *get_table(uint32_t virt)
+{
+    uint32_t *pde = &page_dir[virt >> PDE_SHIFT];
+    if ((*pde & PAGE_PRESENT) && !(*pde & PAGE_LARGE))
+        return table_of(*pde);
+
+    uint32_t frame = pmm_alloc();
+    if (!frame) return NULL;
+    uint32_t *pt = (uint32_t *)frame;
+    if (*pde & PAGE_LARGE) {
+        /* same mapping, one 4 KB page at a time */
+        uint32_t base = *pde & LARGE_MASK;
+        uint32_t flags = *pde & (PAGE_PRESENT | PAGE_WRITE | PAGE_USER | PAGE_NOCACHE);
+        for (uint32_t i = 0; i < ENTRIES; ++i)
+            pt[i] = (base + (i << PAGE_SHIFT)) | flags;
+    } else {
+        memset(pt, 0, PAGE_SIZE);
+    }
+    /* the PDE stays permissive, the PTEs decide */
+    *pde = frame | PAGE_PRESENT | PAGE_WRITE | PAGE_USER;
+    return pt;
+}
+
+bool map_pages(uint32_t virt, uint32_t phys, uint32_t count, uint32_t flags)
+{
+    flags = (flags & ~(FRAME_MASK | PAGE_LARGE)) | PAGE_PRESENT;
+    while (count) {
+        uint32_t *pt = get_table(virt);
+        if (!pt) return false;
+        /* the rest of this table in one go */
+        for (uint32_t i = (virt >> PAGE_SHIFT) & (ENTRIES - 1);
+             i < ENTRIES && count; ++i, --count) {
+            pt[i] = phys | flags;
+            invlpg(virt);
+            virt += PAGE_SIZE;
+            phys += PAGE_SIZE;
+        }
+    }
+    return true;
+}
+
+void unmap_pages(uint32_t virt, uint32_t count)
+{
+    while (count) {
+        uint32_t pde = page_dir[virt >> PDE_SHIFT];
+        uint32_t i = (virt >> PAGE_SHIFT) & (ENTRIES - 1);
+        uint32_t n = ENTRIES - i < count ? ENTRIES - i : count;
+
+        if (pde & PAGE_PRESENT) {
+            uint32_t *pt = (pde & PAGE_LARGE) ? get_table(virt) : table_of(pde);
+            if (!pt) return;
+            for (uint32_t j = 0; j < n; ++j) {
+                pt[i + j] = 0;
+                invlpg(virt + (j << PAGE_SHIFT));
+            }
+        }
+        virt += n << PAGE_SHIFT;
+        count -= n;
+    }
+}
+
+uint32_t virt_to_phys(uint32_t virt)
+{
+    uint32_t pde = page_dir[virt >> PDE_SHIFT];
+    if (!(pde & PAGE_PRESENT)) return 0;
+    if (pde & PAGE_LARGE)
+        return (pde & LARGE_MASK) | (virt & ~LARGE_MASK);
+    uint32_t pte = table_of(pde)[(virt >> PAGE_SHIFT) & (ENTRIES - 1)];
+    if (!(pte & PAGE_PRESENT)) return 0;
+    return (pte & FRAME_MASK) | (virt & ~FRAME_MASK);
+}
+
+void paging_guard(uint32_t addr)
+{
+    unmap_pages(addr, 1);
+    if (nguards < MAX_GUARDS)
+        guards[nguards++] = addr;
+}
+
+void paging_unguard(uint32_t addr)
+{
+    for (int i = 0; i < nguards; ++i) {
+        if (guards[i] == addr) {
+            guards[i] = guards[--nguards];
+            break;
+        }
+    }
+    map_pages(addr, addr, 1, PAGE_WRITE | (addr >= USER_BASE ? PAGE_USER : 0));
+}
+
+bool paging_is_guard(uint32_t addr) { return in_guard(addr); }
+
+uint32_t paging_directory(void) { return (uint32_t)page_dir; }
+bool     paging_large_pages(void) { return large_pages; }
+
+/* ---------- faults ---------- */
+static void page_fault(struct regs *r)
+{
+    uint32_t addr = read_cr2();
+
+    terminal_setcolor(VGA_COLOR_RED);
+    terminal_writestring("\nPAGE FAULT: ");
+    terminal_writestring(r->err_code & PF_WRITE ? "write to " : "read from ");
+    print_hex(addr);
+    terminal_writestring(r->err_code & PF_PRESENT ? " (protection" : " (not present");
+    terminal_writestring(r->err_code & PF_USER ? ", user)" : ", kernel)");
+    terminal_writestring("\n ");
+    print_where(r->eip);
+    if (addr < PAGE_SIZE)
+        terminal_writestring("\n NULL pointer dereference");
+    else if (in_guard(addr))
+        terminal_writestring("\n kernel stack overflow");
+    halt();
+}
+
+/* entered by a task switch through IDT vector 8: t is the TSS of the
+   CPU that faulted, holding the state of whatever was running there */
+static void double_fault_task(struct TSS *t)
+{
+    terminal_setcolor(VGA_COLOR_RED);
+    if (in_guard(read_cr2()))
+        terminal_writestring("\nKERNEL STACK OVERFLOW  cr2=");
+    else
+        terminal_writestring("\nDOUBLE FAULT  cr2=");
+    print_hex(read_cr2());
+    terminal_writestring("\n ");
+    print_where(t->eip);
+    terminal_writestring("  esp=");
+    print_hex(t->esp);
+    halt();
+}
+
+void paging_double_fault_task(struct TSS *df, struct TSS *t, uint32_t stack)
+{
+    set_double_fault_task(df, double_fault_task, t, stack, (uint32_t)page_dir);
+}
+
+/* ---------- setup ---------- */
+void paging_init(void)
+{
+    /* first 4 MB: 4 KB pages, page 0 and the stack guards left out */
+    for (uint32_t i = 0; i < ENTRIES; ++i) {
+        uint32_t a = i << PAGE_SHIFT;
+        low_table[i] = a | PAGE_PRESENT | PAGE_WRITE | (a >= USER_BASE ? PAGE_USER : 0);
+    }
+    low_table[0] = 0;
+    page_dir[0] = (uint32_t)low_table | PAGE_PRESENT | PAGE_WRITE | PAGE_USER;
+
+    /* everything else up to the top of RAM, 4 MB at a time */
+    large_pages = cpu_features.pse;
+    uint32_t top = pmm_top();
+    for (uint32_t a = LARGE_PAGE_SIZE; a && a < top; a += LARGE_PAGE_SIZE) {
+        if (large_pages) {
+            page_dir[a >> PDE_SHIFT] = a | PAGE_LARGE | PAGE_PRESENT | PAGE_WRITE | PAGE_USER;
+        } else if (!map_pages(a, a, ENTRIES, PAGE_WRITE | PAGE_USER)) {
+            break;              /* out of frames for tables: map less */
+        }
+    }
+
+    /* guards go after the map so they also hold above 4 MB */
+    paging_guard((uint32_t)stack_guard_low);
+    paging_guard((uint32_t)stack_guard_high);
+
+    isr_install(14, page_fault);
+    paging_double_fault_task(&df_tss, &tss, (uint32_t)df_stack + sizeof(df_stack));
+    set_idt_entry(8, 0, GDT_DF_TSS, 0x85);     /* present, DPL 0, task gate */
+
+    if (large_pages) write_cr4(read_cr4() | CR4_PSE);
+    write_cr3((uint32_t)page_dir);
+    write_cr0(read_cr0() | CR0_PG | CR0_WP);
+}
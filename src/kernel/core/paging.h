@@ -0,0 +1,52 @@
+/* paging.h  –  identity-mapped page directory and map/unmap API */
+#ifndef PAGING_H
+#define PAGING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* page directory / table entry bits */
+#define PAGE_PRESENT    0x001
+#define PAGE_WRITE      0x002
+#define PAGE_USER       0x004
+#define PAGE_NOCACHE    0x010
+#define PAGE_LARGE      0x080       /* PDE maps 4 MB directly (PSE) */
+
+#define LARGE_PAGE_SIZE 0x400000u
+
+/* ring 3 may touch memory from here up: the interpreters live in the
+   kernel image and heap.  Below stay the IVT, BIOS data and VRAM. */
+#define USER_BASE       0x100000u
+
+/* identity-map physical memory and turn paging on; after pmm_init,
+   init_idt and cpu_detect.  The first 4 MB uses 4 KB pages so page 0
+   and the boot stack guards can stay unmapped, the rest uses 4 MB
+   pages when the CPU has PSE. */
+void paging_init(void);
+
+/* map count pages at virt to phys; page-aligned addresses.  A 4 MB
+   page in the way is split into a page table first.  false when a
+   page table cannot be allocated. */
+bool map_pages(uint32_t virt, uint32_t phys, uint32_t count, uint32_t flags);
+void unmap_pages(uint32_t virt, uint32_t count);
+
+/* physical address behind virt, 0 when unmapped */
+uint32_t virt_to_phys(uint32_t virt);
+
+/* unmap the page at addr and remember it, so a fault there is reported
+   as a stack overflow.  paging_unguard maps it back (identity, as
+   paging_init had it) before the page goes back to the pmm. */
+void paging_guard(uint32_t addr);
+void paging_unguard(uint32_t addr);
+bool paging_is_guard(uint32_t addr);    /* addr inside a guard page */
+
+/* point df, one CPU's double-fault TSS, at the #DF report running on
+   stack (its top); t is that CPU's own TSS.  Before its GDT is built. */
+#define DF_STACK_SIZE   4096
+struct TSS;
+void paging_double_fault_task(struct TSS *df, struct TSS *t, uint32_t stack);
+
+uint32_t paging_directory(void);    /* value loaded into CR3 */
+bool     paging_large_pages(void);  /* PSE in use */
+
+#endif /* PAGING_H */
@@ -0,0 +1,260 @@
+/* pmm.c  –  one bit per 4 KB frame, bitmap placed right after the kernel */
+#include "pmm.h"
+#include "thread.h"
+#include "spinlock.h"
+#include "../lib/string.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#define LOW_MEMORY    0x100000u     /* BIOS, VGA, loader data: never handed out */
+#define FALLBACK_TOP  0x400000u     /* no multiboot info at all */
+#define MAX_FRAMES    0xFFFFFu      /* keeps every address below 4 GB */
+#define MAX_REGIONS   32
+#define FULL          0xFFFFFFFFu
+
+extern char _kernel_end[];          /* linker.ld */
+
+struct region {
+    uint64_t base, end;
+};
+
+static struct region ram[MAX_REGIONS];
+static int nram;
+
+static uint32_t *bitmap;            /* bit set = frame in use */
+static uint32_t nframes, nwords;
+static uint32_t total, nfree;
+static uint32_t next_word;          /* first word that may have a free bit */
+
+/* ---------- bitmap ---------- */
+static bool used(uint32_t f)
+{
+    return bitmap[f >> 5] & (1u << (f & 31));
+}
+
+static void mark(uint32_t first, uint32_t end, bool in_use)
+{
+    if (end > nframes) end = nframes;
+    for (uint32_t f = first; f < end; ++f) {
+        uint32_t bit = 1u << (f & 31);
+        if (in_use && !(bitmap[f >> 5] & bit)) {
+            bitmap[f >> 5] |= bit;
+            nfree--;
+        } else if (!in_use && (bitmap[f >> 5] & bit)) {
+            bitmap[f >> 5] &= ~bit;
+            nfree++;
+        }
+    }
+}
+
+/* RAM only counts whole frames; reservations round outwards */
+static void release(uint64_t base, uint64_t end)
+{
+    uint64_t first = (base + PAGE_SIZE - 1) >> PAGE_SHIFT;
+    uint64_t last = end >> PAGE_SHIFT;
+    if (first < last && first < nframes)
+        mark((uint32_t)first, last < nframes ? (uint32_t)last : nframes, false);
+}
+
+static void reserve(uint32_t base, uint32_t end)
+{
+    mark(base >> PAGE_SHIFT, (uint32_t)(((uint64_t)end + PAGE_SIZE - 1) >> PAGE_SHIFT), true);
+}
+
+/* ---------- multiboot ---------- */
+static void add_ram(uint64_t base, uint64_t len)
+{
+    if (nram < MAX_REGIONS && len) {
+        ram[nram].base = base;
+        ram[nram].end = base + len;
+        nram++;
+    }
+}
+
+static void read_map(const struct multiboot_info *mbi)
+{
+    if (mbi && (mbi->flags & MB_INFO_MMAP)) {
+        uint32_t p = mbi->mmap_addr, end = p + mbi->mmap_length;
+        while (p < end) {
+            const struct multiboot_mmap_entry *e = (const void *)p;
+            if (e->type == MB_MEMORY_AVAILABLE)
+                add_ram(e->addr, e->len);
+            p += e->size + 4;
+        }
+    } else if (mbi && (mbi->flags & MB_INFO_MEMORY)) {
+        add_ram(0, (uint64_t)mbi->mem_lower << 10);
+        add_ram(LOW_MEMORY, (uint64_t)mbi->mem_upper << 10);
+    } else {
+        add_ram(LOW_MEMORY, FALLBACK_TOP - LOW_MEMORY);
+    }
+}
+
+/* every piece of loader data: the info block, the memory map, the
+   command line, the module list, the modules and their strings */
+static void for_each_boot_range(const struct multiboot_info *mbi,
+                                void (*fn)(uint32_t base, uint32_t end))
+{
+    if (!mbi) return;
+    fn((uint32_t)mbi, (uint32_t)mbi + sizeof(*mbi));
+    if (mbi->flags & MB_INFO_MMAP)
+        fn(mbi->mmap_addr, mbi->mmap_addr + mbi->mmap_length);
+    if (mbi->flags & MB_INFO_CMDLINE)
+        fn(mbi->cmdline, mbi->cmdline + strlen((const char *)mbi->cmdline) + 1);
+    if (mbi->flags & MB_INFO_MODS) {
+        const struct multiboot_module *m = (const void *)mbi->mods_addr;
+        fn(mbi->mods_addr, (uint32_t)(m + mbi->mods_count));
+        for (uint32_t i = 0; i < mbi->mods_count; ++i) {
+            fn(m[i].mod_start, m[i].mod_end);
+            if (m[i].string)
+                fn(m[i].string, m[i].string + strlen((const char *)m[i].string) + 1);
+        }
+    }
+}
+
+static uint32_t boot_end;
+
+static void extend_boot_end(uint32_t base, uint32_t end)
+{
+    (void)base;
+    if (end > boot_end) boot_end = end;
+}
+
+/* the bitmap goes after the kernel and after all of the loader data:
+   GRUB may put the info block or the module list past the kernel, and
+   the memset in pmm_init runs before anything has read them */
+static uint32_t bitmap_base(const struct multiboot_info *mbi)
+{
+    boot_end = (uint32_t)_kernel_end;
+    for_each_boot_range(mbi, extend_boot_end);
+    return (boot_end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+}
+
+void pmm_init(const struct multiboot_info *mbi)
+{
+    read_map(mbi);
+
+    uint64_t top = 0;
+    for (int i = 0; i < nram; ++i)
+        if (ram[i].end > top) top = ram[i].end;
+    top >>= PAGE_SHIFT;
+    nframes = top < MAX_FRAMES ? (uint32_t)top : MAX_FRAMES;
+    nwords = (nframes + 31) / 32;
+
+    /* everything starts used (including the padding bits past nframes),
+       then the RAM regions are opened up */
+    bitmap = (uint32_t *)bitmap_base(mbi);
+    memset(bitmap, 0xFF, nwords * 4);
+    nfree = 0;
+    for (int i = 0; i < nram; ++i)
+        release(ram[i].base, ram[i].end);
+    total = nfree;
+
+    reserve(0, LOW_MEMORY);
+    reserve(LOW_MEMORY, (uint32_t)(bitmap + nwords));
+    for_each_boot_range(mbi, reserve);     /* above 1 MB: not handed out */
+    next_word = 0;
+}
+
+/* ---------- allocation ---------- */
+static uint32_t alloc_frame(void)
+{
+    if (!nfree) return 0;
+
+    /* whole words at a time from the hint; below it everything is taken */
+    for (uint32_t w = next_word; w < nwords; ++w) {
+        if (bitmap[w] == FULL) continue;
+        uint32_t bit = __builtin_ctz(~bitmap[w]);
+        bitmap[w] |= 1u << bit;
+        nfree--;
+        next_word = w;
+        return ((w << 5) + bit) << PAGE_SHIFT;
+    }
+    return 0;
+}
+
+static uint32_t alloc_run(uint32_t count)
+{
+    if (count <= 1) return count ? alloc_frame() : 0;
+    if (count > nfree) return 0;
+
+    /* first fit, skipping full words */
+    uint32_t start = 0, run = 0;
+    for (uint32_t f = next_word << 5; f < nframes; ) {
+        if ((f & 31) == 0 && bitmap[f >> 5] == FULL) {
+            run = 0;
+            f += 32;
+            continue;
+        }
+        if (used(f)) {
+            run = 0;
+        } else {
+            if (run++ == 0) start = f;
+            if (run == count) {
+                mark(start, start + count, true);
+                return start << PAGE_SHIFT;
+            }
+        }
+        f++;
+    }
+    return 0;
+}
+
+static void free_frame(uint32_t addr)
+{
+    uint32_t f = addr >> PAGE_SHIFT;
+    if (f == 0 || f >= nframes || !used(f)) return;    /* bogus or double free */
+    bitmap[f >> 5] &= ~(1u << (f & 31));
+    nfree++;
+    if ((f >> 5) < next_word) next_word = f >> 5;
+}
+
+/* the bitmap is shared by every thread and every CPU: pmm_lock, and no
+   preemption while it is held */
+static spinlock_t pmm_lock = SPINLOCK_INIT;
+
+static void lock(void)
+{
+    preempt_disable();
+    spin_lock(&pmm_lock);
+}
+
+static void unlock(void)
+{
+    spin_unlock(&pmm_lock);
+    preempt_enable();
+}
+
+uint32_t pmm_alloc(void)
+{
+    lock();
+    uint32_t addr = alloc_frame();
+    unlock();
+    return addr;
+}
+
+uint32_t pmm_alloc_pages(uint32_t count)
+{
+    lock();
+    uint32_t addr = alloc_run(count);
+    unlock();
+    return addr;
+}
+
+void pmm_free(uint32_t addr)
+{
+    lock();
+    free_frame(addr);
+    unlock();
+}
+
+void pmm_free_pages(uint32_t addr, uint32_t count)
+{
+    lock();
+    for (uint32_t i = 0; i < count; ++i)
+        free_frame(addr + (i << PAGE_SHIFT));
+    unlock();
+}
+
+uint32_t pmm_total_pages(void) { return total; }
+uint32_t pmm_free_count(void)  { return nfree; }
+uint32_t pmm_top(void)         { return nframes << PAGE_SHIFT; }
@@ -0,0 +1,25 @@
+/* pmm.h  –  physical page-frame allocator over the multiboot memory map */
+#ifndef PMM_H
+#define PMM_H
+
+#include <stdint.h>
+#include "multiboot.h"
+
+#define PAGE_SIZE   4096u
+#define PAGE_SHIFT  12
+
+/* mbi may be NULL (no multiboot loader): then 1-4 MB is assumed */
+void pmm_init(const struct multiboot_info *mbi);
+
+/* physical address of a free frame, 0 when out of memory
+   (frame 0 is never handed out) */
+uint32_t pmm_alloc(void);
+uint32_t pmm_alloc_pages(uint32_t count);     /* physically contiguous */
+void     pmm_free(uint32_t addr);
+void     pmm_free_pages(uint32_t addr, uint32_t count);
+
+uint32_t pmm_total_pages(void);     /* usable RAM reported by the loader */
+uint32_t pmm_free_count(void);
+uint32_t pmm_top(void);             /* end of the highest usable frame */
+
+#endif /* PMM_H */
@@ -0,0 +1,155 @@
+/* prof.c  –  statistical profiler over the link-time symbol table */
+#include "prof.h"
+#include "ksyms.h"
+#include "timer.h"
+#include "../io/vga.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#define HLT_OPCODE  0xF4
+#define MAX_TOP     20
+
+static uint32_t samples[PROF_SAMPLES];
+static volatile uint32_t nsamples;      /* total taken, may exceed the ring */
+static volatile bool running;
+
+void prof_tick(const struct regs *r)
+{
+    if (!running) return;
+    samples[nsamples & (PROF_SAMPLES - 1)] = r->eip;
+    nsamples++;
+}
+
+void prof_start(void)
+{
+    running = false;
+    nsamples = 0;
+    running = true;
+}
+
+void prof_stop(void)
+{
+    running = false;
+}
+
+const struct ksym *ksym_lookup(uint32_t addr)
+{
+    /* last symbol with ksym.addr <= addr */
+    unsigned lo = 0, hi = ksyms_count;
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (ksyms[mid].addr <= addr) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo ? &ksyms[lo - 1] : NULL;
+}
+
+/* ---------- report ---------- */
+static void print(const char *s) { terminal_writestring(s); }
+
+static void print_num(uint32_t v, int width)
+{
+    char tmp[11];
+    int i = sizeof(tmp) - 1;
+    tmp[i] = '\0';
+    do {
+        tmp[--i] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    for (int pad = width - (int)(sizeof(tmp) - 1 - i); pad > 0; --pad)
+        terminal_putchar(' ');
+    print(tmp + i);
+}
+
+/* Shell sort: 4096 words, no allocation, fine for a one-off report */
+static void sort(uint32_t *a, uint32_t n)
+{
+    static const uint32_t gaps[] = { 701, 301, 132, 57, 23, 10, 4, 1 };
+    for (unsigned g = 0; g < sizeof(gaps) / sizeof(gaps[0]); ++g) {
+        uint32_t gap = gaps[g];
+        for (uint32_t i = gap; i < n; ++i) {
+            uint32_t v = a[i], j = i;
+            for (; j >= gap && a[j - gap] > v; j -= gap)
+                a[j] = a[j - gap];
+            a[j] = v;
+        }
+    }
+}
+
+struct hot {
+    const char *name;
+    uint32_t hits;
+};
+
+static void add_hot(struct hot *top, int *n, int max, const char *name, uint32_t hits)
+{
+    if (*n == max && top[max - 1].hits >= hits) return;
+    int i = *n < max ? (*n)++ : max - 1;
+    for (; i > 0 && top[i - 1].hits < hits; --i)
+        top[i] = top[i - 1];
+    top[i].name = name;
+    top[i].hits = hits;
+}
+
+void prof_report(int top_n)
+{
+    static struct hot top[MAX_TOP];
+    bool was_running = running;
+    running = false;
+
+    uint32_t total = nsamples;
+    uint32_t n = total < PROF_SAMPLES ? total : PROF_SAMPLES;
+    if (top_n < 1) top_n = 1;
+    if (top_n > MAX_TOP) top_n = MAX_TOP;
+
+    print("prof: ");
+    print_num(total, 0);
+    print(" samples at ");
+    print_num(TIMER_HZ, 0);
+    print(" Hz");
+    if (total > n) {
+        print(", last ");
+        print_num(n, 0);
+        print(" kept");
+    }
+    terminal_putchar('\n');
+    if (!n) {
+        running = was_running;
+        return;
+    }
+
+    /* idle first: an EIP right after a hlt is the CPU waiting for IRQs */
+    uint32_t idle = 0, busy = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        const uint8_t *ip = (const uint8_t *)samples[i];
+        if (ip[-1] == HLT_OPCODE) idle++;
+        else samples[busy++] = samples[i];
+    }
+
+    /* sorted EIPs: each function is one run, walked alongside ksyms */
+    sort(samples, busy);
+    int ntop = 0;
+    uint32_t i = 0;
+    while (i < busy) {
+        const struct ksym *s = ksym_lookup(samples[i]);
+        uint32_t end = s ? s[1].addr : ksyms_count ? ksyms[0].addr : 0xFFFFFFFF;
+        uint32_t j = i;
+        while (j < busy && samples[j] < end) j++;
+        add_hot(top, &ntop, top_n, s ? s->name : "(unknown)", j - i);
+        i = j;
+    }
+    if (idle) add_hot(top, &ntop, top_n, "(idle: hlt)", idle);
+
+    print("   hits    %  function\n");
+    for (int k = 0; k < ntop; ++k) {
+        print_num(top[k].hits, 7);
+        print_num(top[k].hits * 100 / n, 5);
+        print("  ");
+        print(top[k].name);
+        terminal_putchar('\n');
+    }
+
+    /* the ring now holds sorted busy samples; start over from here */
+    nsamples = 0;
+    running = was_running;
+}
@@ -0,0 +1,15 @@
+/* prof.h  –  sampling profiler: interrupted EIP on every timer tick */
+#ifndef PROF_H
+#define PROF_H
+
+#include "idt.h"
+
+#define PROF_SAMPLES 4096       /* ring; older samples are overwritten */
+
+void prof_start(void);          /* clear and start sampling */
+void prof_stop(void);
+void prof_report(int top_n);    /* hottest functions first */
+
+void prof_tick(const struct regs *r);   /* from the IRQ0 handler */
+
+#endif /* PROF_H */
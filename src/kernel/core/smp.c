@@ -0,0 +1,267 @@
+/* smp.c  –  ACPI MADT, INIT-SIPI-SIPI and the AP side of start-up */
+#include "smp.h"
+#include "apic.h"
+#include "cpu.h"
+#include "idt.h"
+#include "pmm.h"
+#include "heap.h"
+#include "paging.h"
+#include "timer.h"
+#include "taskpool.h"
+#include "../lib/string.h"
+#include "../lib/int.h"
+#include <stddef.h>
+
+#define TRAMPOLINE  0x8000          /* real-mode entry: page aligned, below 1 MB */
+#define SLOT_PAGES  (AP_STACK_PAGES + 1)
+#define SLOT_BYTES  (SLOT_PAGES * PAGE_SIZE)
+
+static struct cpu cpus[MAX_CPUS];   /* [0] is the BSP, the rest in start-up order */
+static uint8_t ap_ids[MAX_CPUS - 1];/* APs listed in the MADT */
+static int nap;
+static int nonline = 1;
+static uint32_t lapic_base;
+
+/* AP i's stack is slot i - 1: a guard page, then AP_STACK_PAGES */
+static uint32_t stack_region, stack_bytes;
+static volatile int booting;        /* cpus[] index of the AP being started */
+
+/* ---------- ACPI ---------- */
+struct rsdp {
+    char     sig[8];                /* "RSD PTR " */
+    uint8_t  checksum;              /* over these 20 bytes */
+    char     oem[6];
+    uint8_t  revision;
+    uint32_t rsdt;
+} __attribute__((packed));
+
+struct sdt_header {
+    char     sig[4];
+    uint32_t length;                /* header included */
+    uint8_t  revision;
+    uint8_t  checksum;
+    char     oem[6];
+    char     oem_table[8];
+    uint32_t oem_revision;
+    uint32_t creator, creator_revision;
+} __attribute__((packed));
+
+struct madt {
+    struct sdt_header h;
+    uint32_t lapic;                 /* local APIC registers, physical */
+    uint32_t flags;
+    uint8_t  entries[];             /* type, length, ... */
+} __attribute__((packed));
+
+#define MADT_LAPIC          0       /* acpi id, apic id, flags */
+#define MADT_LAPIC_ADDR     5       /* 64-bit register address */
+#define LAPIC_ENABLED       1
+
+static bool checksum_ok(const void *p, uint32_t len)
+{
+    const uint8_t *b = p;
+    uint8_t sum = 0;
+    while (len--) sum += *b++;
+    return sum == 0;
+}
+
+static const struct rsdp *scan_rsdp(uint32_t from, uint32_t len)
+{
+    for (uint32_t a = from; a < from + len; a += 16) {
+        const struct rsdp *r = (const struct rsdp *)a;
+        if (!strncmp(r->sig, "RSD PTR ", 8) && checksum_ok(r, 20))
+            return r;
+    }
+    return NULL;
+}
+
+static const struct madt *find_madt(void)
+{
+    /* the first KB of the EBDA, then the BIOS area */
+    uint32_t ebda = (uint32_t)*(const uint16_t *)0x40E << 4;
+    const struct rsdp *r = NULL;
+    if (ebda >= 0x80000 && ebda < 0xA0000) r = scan_rsdp(ebda, 1024);
+    if (!r) r = scan_rsdp(0xE0000, 0x20000);
+    if (!r) return NULL;
+
+    const struct sdt_header *rsdt = (const struct sdt_header *)r->rsdt;
+    if (strncmp(rsdt->sig, "RSDT", 4) || !checksum_ok(rsdt, rsdt->length))
+        return NULL;
+    const uint32_t *tables = (const uint32_t *)(rsdt + 1);
+    uint32_t n = (rsdt->length - sizeof(*rsdt)) / 4;
+    for (uint32_t i = 0; i < n; ++i) {
+        const struct sdt_header *h = (const struct sdt_header *)tables[i];
+        if (!strncmp(h->sig, "APIC", 4) && checksum_ok(h, h->length))
+            return (const struct madt *)h;
+    }
+    return NULL;
+}
+
+void smp_detect(void)
+{
+    uint32_t a, b, c, d;
+    cpus[0].online = true;
+    if (!cpu_features.apic) return;
+    cpuid(1, &a, &b, &c, &d);
+    cpus[0].apic_id = b >> 24;
+
+    const struct madt *m = find_madt();
+    if (!m) return;
+    lapic_base = m->lapic;
+
+    const uint8_t *e = m->entries, *end = (const uint8_t *)m + m->h.length;
+    for (; e + 2 <= end && e[1] >= 2; e += e[1]) {
+        if (e[0] == MADT_LAPIC && (e[4] & LAPIC_ENABLED) &&
+            e[3] != cpus[0].apic_id && nap < MAX_CPUS - 1)
+            ap_ids[nap++] = e[3];
+        else if (e[0] == MADT_LAPIC_ADDR && !*(const uint32_t *)(e + 8))
+            lapic_base = *(const uint32_t *)(e + 4);
+    }
+}
+
+/* ---------- the trampoline ----------
+   Real mode at TRAMPOLINE: load the BSP's GDT, enter protected mode,
+   turn paging on with the BSP's CR3/CR4 and call ap_entry on ap_stack.
+   It runs from the copy, so every address is TRAMPOLINE-relative. */
+#define T(sym) "0x8000 + " #sym " - ap_tramp_start"
+
+asm(".section .rodata\n"
+    ".code16\n"
+    "ap_tramp_start:\n"
+    "  cli\n"
+    "  cld\n"
+    "  xor %ax, %ax\n"
+    "  mov %ax, %ds\n"
+    "  lgdtl " T(ap_gdtr) "\n"
+    "  mov %cr0, %eax\n"
+    "  or $1, %eax\n"               /* PE */
+    "  mov %eax, %cr0\n"
+    "  ljmpl $0x08, $" T(ap_pmode) "\n"
+    ".code32\n"
+    "ap_pmode:\n"
+    "  mov $0x10, %ax\n"
+    "  mov %ax, %ds\n  mov %ax, %es\n  mov %ax, %fs\n  mov %ax, %gs\n  mov %ax, %ss\n"
+    "  mov " T(ap_cr4) ", %eax\n"
+    "  mov %eax, %cr4\n"
+    "  mov " T(ap_cr3) ", %eax\n"
+    "  mov %eax, %cr3\n"
+    "  mov %cr0, %eax\n"
+    "  or $0x80010000, %eax\n"      /* PG | WP */
+    "  mov %eax, %cr0\n"
+    "  mov " T(ap_stack) ", %esp\n"
+    "  call *" T(ap_entry) "\n"
+    "1:\n"
+    "  cli\n  hlt\n  jmp 1b\n"
+    ".align 4\n"
+    "ap_gdtr:  .word 0\n  .long 0\n"
+    ".align 4\n"
+    "ap_cr3:   .long 0\n"
+    "ap_cr4:   .long 0\n"
+    "ap_stack: .long 0\n"
+    "ap_entry: .long 0\n"
+    "ap_tramp_end:\n"
+    ".previous\n");
+
+extern const char ap_tramp_start[], ap_tramp_end[];
+extern const char ap_gdtr[], ap_cr3[], ap_cr4[], ap_stack[], ap_entry[];
+
+/* where a trampoline variable lives once copied */
+static uint32_t *tramp_var(const char *sym)
+{
+    return (uint32_t *)(TRAMPOLINE + (sym - ap_tramp_start));
+}
+
+/* first C code on an AP, on its own stack */
+static void ap_main(void)
+{
+    struct cpu *c = &cpus[booting];
+    paging_double_fault_task(&c->df_tss, &c->tss, (uint32_t)c->df_stack + sizeof(c->df_stack));
+    init_gdt_cpu(c->gdt, &c->tss, &c->df_tss);
+    idt_load();
+    fpu_init();
+    apic_enable();
+    c->online = true;
+    taskpool_worker();
+}
+
+/* ---------- start-up ---------- */
+static void delay_us(uint32_t us)
+{
+    uint64_t wait = uint64_divmod32((uint64_t)us * cycles_hz(), 1000000U, NULL);
+    uint64_t t0 = cycles();
+    while (cycles() - t0 < wait)
+        asm volatile ("pause");
+}
+
+static bool wait_online(const struct cpu *c, uint32_t us)
+{
+    uint64_t wait = uint64_divmod32((uint64_t)us * cycles_hz(), 1000000U, NULL);
+    uint64_t t0 = cycles();
+    while (!c->online && cycles() - t0 < wait)
+        asm volatile ("pause");
+    return c->online;
+}
+
+/* INIT, 10 ms, then STARTUP up to twice: the MP spec's recipe */
+static bool start_ap(int cpu, uint8_t apic_id)
+{
+    struct cpu *c = &cpus[cpu];
+    c->apic_id = apic_id;
+    c->online = false;
+    booting = cpu;
+    *tramp_var(ap_stack) = stack_region + (uint32_t)cpu * SLOT_BYTES;
+
+    apic_send_init(apic_id);
+    delay_us(10000);
+    apic_send_startup(apic_id, TRAMPOLINE);
+    if (!wait_online(c, 200)) {
+        apic_send_startup(apic_id, TRAMPOLINE);
+        wait_online(c, 100000);
+    }
+    if (!c->online)
+        apic_send_init(apic_id);    /* park it: it must not wake up later */
+    return c->online;
+}
+
+void smp_init(void)
+{
+    if (!nap || !lapic_base || !apic_init(lapic_base)) return;
+
+    uint32_t region = pmm_alloc_pages((uint32_t)nap * SLOT_PAGES);
+    if (!region) return;
+    for (int i = 0; i < nap; ++i)
+        paging_guard(region + (uint32_t)i * SLOT_BYTES);
+    stack_region = region;
+    stack_bytes = (uint32_t)nap * SLOT_BYTES;
+
+    /* borrow the page; whatever the loader left there goes back after */
+    char *saved = kmalloc(PAGE_SIZE);
+    if (saved) memcpy(saved, (void *)TRAMPOLINE, PAGE_SIZE);
+    memcpy((void *)TRAMPOLINE, ap_tramp_start, ap_tramp_end - ap_tramp_start);
+    asm volatile ("sgdt (%0)" : : "r"(tramp_var(ap_gdtr)) : "memory");
+    *tramp_var(ap_cr3) = read_cr3();
+    *tramp_var(ap_cr4) = read_cr4();
+    *tramp_var(ap_entry) = (uint32_t)ap_main;
+
+    for (int i = 0; i < nap; ++i)
+        if (start_ap(nonline, ap_ids[i])) nonline++;
+
+    if (saved) {
+        memcpy((void *)TRAMPOLINE, saved, PAGE_SIZE);
+        kfree(saved);
+    }
+}
+
+/* ---------- queries ---------- */
+int smp_cpu_count(void) { return nonline; }
+int smp_cpu_found(void) { return nap + 1; }
+uint8_t smp_apic_id(int cpu) { return cpus[cpu].apic_id; }
+
+int smp_cpu_id(void)
+{
+    uint32_t esp;
+    asm volatile ("mov %%esp, %0" : "=r"(esp));
+    uint32_t off = esp - stack_region;
+    if (off >= stack_bytes) return 0;
+    return 1 + off / SLOT_BYTES;
+}
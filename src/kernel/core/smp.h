@@ -0,0 +1,38 @@
+/* smp.h  –  CPUs from the ACPI MADT, AP start-up, per-CPU state */
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "gdt.h"
+#include "paging.h"
+
+#define MAX_CPUS        8
+#define AP_STACK_PAGES  4           /* plus an unmapped guard page below */
+
+/* the BSP uses the global gdt/tss/df_tss; the rest is for the APs */
+struct cpu {
+    uint8_t apic_id;
+    volatile bool online;
+    struct gdt_entry gdt[GDT_ENTRIES];
+    struct TSS tss;
+    struct TSS df_tss;
+    uint8_t df_stack[DF_STACK_SIZE] __attribute__((aligned(16)));
+};
+
+/* find the CPUs in the MADT.  Before paging_init: the ACPI tables
+   usually sit above the RAM that gets identity-mapped. */
+void smp_detect(void);
+
+/* start every AP into the task pool; after paging_init and timer_init */
+void smp_init(void);
+
+int smp_cpu_count(void);            /* CPUs running, the BSP included */
+int smp_cpu_found(void);            /* ... listed in the MADT */
+uint8_t smp_apic_id(int cpu);
+
+/* 0 on the BSP, 1.. on the APs.  Read off the stack pointer, so ring-3
+   code may ask too (it only ever runs on the BSP). */
+int smp_cpu_id(void);
+
+#endif /* SMP_H */
@@ -0,0 +1,30 @@
+/* spinlock.h  –  test-and-set locks for data shared between CPUs */
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    volatile uint32_t locked;
+} spinlock_t;
+
+#define SPINLOCK_INIT { 0 }
+
+/* xchg and pause are unprivileged, so ring-3 code may take these too.
+   On the BSP, hold them with preemption off (preempt_disable) so a
+   thread never gets switched out while another one spins.  Spin on a
+   plain read: the cache line stays shared until the owner lets go. */
+static inline void spin_lock(spinlock_t *l)
+{
+    while (__atomic_exchange_n(&l->locked, 1, __ATOMIC_ACQUIRE))
+        while (l->locked)
+            asm volatile ("pause");
+}
+
+static inline void spin_unlock(spinlock_t *l)
+{
+    __atomic_store_n(&l->locked, 0, __ATOMIC_RELEASE);
+}
+
+#endif /* SPINLOCK_H */
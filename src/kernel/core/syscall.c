@@ -0,0 +1,289 @@
+/* syscall.c  –  user_run(), SYSENTER and int 0x80 entry, the handlers */
+#include "syscall.h"
+#include "cpu.h"
+#include "gdt.h"
+#include "idt.h"
+#include "pmm.h"
+#include "paging.h"
+#include "timer.h"
+#include "ksyms.h"
+#include "thread.h"
+#include "../io/vga.h"
+#include "../io/keyboard.h"
+
+#define MSR_SYSENTER_CS     0x174
+#define MSR_SYSENTER_ESP    0x175
+#define MSR_SYSENTER_EIP    0x176
+
+#define KERNEL_CS           0x08
+#define USER_STACK_PAGES    4       /* as big as the boot stack */
+
+bool syscall_fast;
+
+int  enter_user(uint32_t eip, uint32_t esp, uint32_t *frame);
+__attribute__((noreturn)) void leave_user(int code, uint32_t frame);
+void sysenter_entry(void);
+
+/* ---------- entry / exit ----------
+   enter_user saves the callee-saved registers, stores esp in *frame
+   (the thread's user_frame) and irets to ring 3.  Everything ring 3
+   raises lands on the kernel stack right below that frame (tss.esp0
+   and SYSENTER_ESP point there), and leave_user, called from the
+   SYS_EXIT or fault handler on that stack, unwinds to the frame and
+   returns from enter_user. */
+asm(".text\n"
+    ".global enter_user\n"
+    "enter_user:\n"
+    "  push %ebp\n  push %ebx\n  push %esi\n  push %edi\n"
+    "  mov 28(%esp), %eax\n"        /* frame */
+    "  mov %esp, (%eax)\n"
+    "  push %esp\n"
+    "  call syscall_set_stack\n"
+    "  add $4, %esp\n"
+    "  mov 20(%esp), %ecx\n"        /* eip */
+    "  mov 24(%esp), %edx\n"        /* esp */
+    "  mov $0x23, %ax\n"            /* user data segment, RPL 3 */
+    "  mov %ax, %ds\n  mov %ax, %es\n  mov %ax, %fs\n  mov %ax, %gs\n"
+    "  push $0x23\n"                /* ss */
+    "  push %edx\n"                 /* esp */
+    "  pushf\n"
+    "  orl $0x200, (%esp)\n"        /* interrupts on */
+    "  push $0x1B\n"                /* user code segment, RPL 3 */
+    "  push %ecx\n"
+    "  iret\n"
+
+    ".global leave_user\n"
+    "leave_user:\n"
+    "  mov 4(%esp), %eax\n"
+    "  mov 8(%esp), %esp\n"
+    "  mov $0x10, %cx\n"
+    "  mov %cx, %ds\n  mov %cx, %es\n  mov %cx, %fs\n  mov %cx, %gs\n"
+    "  pop %edi\n  pop %esi\n  pop %ebx\n  pop %ebp\n"
+    "  sti\n"
+    "  ret\n"
+
+    /* CPU loaded cs/ss/esp/eip from the MSRs and cleared IF; ds and
+       es still hold the flat user segment, which the kernel can use */
+    ".global sysenter_entry\n"
+    "sysenter_entry:\n"
+    "  push %ecx\n"                 /* user esp */
+    "  push %edx\n"                 /* user eip */
+    "  push %edi\n  push %esi\n  push %ebx\n  push %eax\n"
+    "  cld\n"
+    "  call syscall_dispatch\n"
+    "  add $16, %esp\n"
+    "  pop %edx\n"
+    "  pop %ecx\n"
+    "  sysexit\n");
+
+/* first ring-3 instruction: returning from fn is SYS_EXIT too */
+static void user_start(int (*fn)(void *), void *arg)
+{
+    sys_exit(fn(arg));
+}
+
+int user_run(int (*fn)(void *), void *arg)
+{
+    /* a guard page under the stack: running off the bottom is a #PF
+       that user_fault turns into "Program killed", not a write into
+       whatever the pmm handed out below */
+    uint32_t guard = pmm_alloc_pages(USER_STACK_PAGES + 1);
+    if (!guard) return -1;
+    preempt_disable();                  /* guards[] and the page tables */
+    paging_guard(guard);
+    preempt_enable();
+    uint32_t stack = guard + PAGE_SIZE;
+
+    /* user_start(fn, arg) with a return address nobody uses */
+    uint32_t *sp = (uint32_t *)(stack + USER_STACK_PAGES * PAGE_SIZE);
+    *--sp = (uint32_t)arg;
+    *--sp = (uint32_t)fn;
+    *--sp = 0;
+
+    /* the shell's own priority is for typing, not for its programs */
+    struct thread *t = thread_current();
+    uint8_t prio = t->prio;
+    if (prio > PRIO_NORMAL) thread_set_priority(t, PRIO_NORMAL);
+    terminal_set_autoflush(false);      /* SYS_GETKEY and the end flush */
+    t->user_preempt = t->preempt_off;
+    int code = enter_user((uint32_t)user_start, (uint32_t)sp, &t->user_frame);
+    t->preempt_off = t->user_preempt;   /* user_fault never unwinds past a lock */
+    t->user_frame = 0;
+    t->kill = false;
+    terminal_set_autoflush(true);
+    thread_set_priority(t, prio);
+
+    preempt_disable();
+    paging_unguard(guard);
+    preempt_enable();
+    pmm_free_pages(guard, USER_STACK_PAGES + 1);
+    return code;
+}
+
+/* ---------- handlers ---------- */
+/* every page of [p, p+len) user-visible and mapped */
+static bool user_buffer_ok(uint32_t p, uint32_t len)
+{
+    uint32_t end = p + len - 1;
+    if (p < USER_BASE || end < p) return false;
+    for (uint32_t a = p & ~(PAGE_SIZE - 1); ; a += PAGE_SIZE) {
+        if (!virt_to_phys(a)) return false;
+        if (a >= (end & ~(PAGE_SIZE - 1))) return true;
+    }
+}
+
+void syscall_set_stack(uint32_t top)
+{
+    set_kernel_stack(top);
+    if (syscall_fast)
+        wrmsr(MSR_SYSENTER_ESP, top);
+}
+
+static int32_t handle(uint32_t nr, uint32_t a1, uint32_t a2, uint32_t frame)
+{
+    switch (nr) {
+    case SYS_EXIT:
+        if (frame) leave_user((int)a1, frame);
+        return -1;
+    case SYS_WRITE:
+        if (!a2) return 0;
+        if (frame && !user_buffer_ok(a1, a2)) return -1;
+        terminal_write((const char *)a1, a2);
+        return (int32_t)a2;
+    case SYS_GETKEY:
+        terminal_flush();
+        return (unsigned char)lazy_getchar();
+    case SYS_SETCOLOR:
+        terminal_setcolor((uint8_t)a1);
+        return 0;
+    }
+    return -1;
+}
+
+int32_t syscall_dispatch(uint32_t nr, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    struct thread *t = thread_current();
+    uint32_t frame = t->user_frame;
+    (void)a3;
+    asm volatile ("sti");       /* both gates enter with IF clear */
+
+    int32_t ret = handle(nr, a1, a2, frame);
+    /* a program that only waits for keys is killed on the way back */
+    if (frame && t->kill && !t->preempt_off) user_kill();
+    return ret;
+}
+
+static void int80_handler(struct regs *r)
+{
+    r->eax = syscall_dispatch(r->eax, r->ebx, r->esi, r->edi);
+}
+
+static void print_hex(uint32_t v)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    char buf[11] = "0x";
+    for (int i = 0; i < 8; ++i)
+        buf[2 + i] = digits[(v >> (28 - 4 * i)) & 0xF];
+    buf[10] = '\0';
+    terminal_writestring(buf);
+}
+
+void user_fault(struct regs *r)
+{
+    /* the interpreters call kmalloc and friends from ring 3: a fault
+       with preemption still off came from inside one of those, holding
+       heap_lock or pmm_lock, and unwinding would leave it held */
+    struct thread *t = thread_current();
+    bool locked = t->preempt_off != t->user_preempt;
+
+    terminal_setcolor(VGA_COLOR_RED);
+    terminal_writestring(locked ? "\nProgram faulted holding a kernel lock: "
+                                : "\nProgram killed: ");
+    terminal_writestring(exception_name(r->int_no));
+    if (r->int_no == 14) {
+        terminal_writestring(" at ");
+        print_hex(read_cr2());
+        if (paging_is_guard(read_cr2()))
+            terminal_writestring(" (stack overflow)");
+    }
+    terminal_writestring("\n  eip=");
+    print_hex(r->eip);
+    const struct ksym *s = ksym_lookup(r->eip);
+    if (s) {
+        terminal_writestring(" <");
+        terminal_writestring(s->name);
+        terminal_writestring(">");
+    }
+    if (locked) {
+        terminal_writestring("\nSystem halted.\n");
+        terminal_set_autoflush(true);
+        for (;;) asm volatile ("cli; hlt");
+    }
+    terminal_setcolor(VGA_COLOR_LIGHT_GREY);
+    terminal_putchar('\n');
+    leave_user(-1, t->user_frame);
+}
+
+void user_kill(void)
+{
+    terminal_setcolor(VGA_COLOR_RED);
+    terminal_writestring("\nProgram stopped\n");
+    terminal_setcolor(VGA_COLOR_LIGHT_GREY);
+    leave_user(-1, thread_current()->user_frame);
+}
+
+/* ---------- setup ---------- */
+void syscall_init(void)
+{
+    isr_install(SYSCALL_VECTOR, int80_handler);
+
+    /* early Pentium Pros report SEP but have no working SYSENTER */
+    uint32_t a, b, c, d;
+    cpuid(1, &a, &b, &c, &d);
+    uint32_t family = (a >> 8) & 0xF, model = (a >> 4) & 0xF, stepping = a & 0xF;
+    syscall_fast = cpu_features.sep && cpu_features.msr &&
+                   !(family == 6 && model < 3 && stepping < 3);
+    if (!syscall_fast) return;
+
+    /* SYSEXIT derives the user selectors from this: +16 code, +24 data */
+    wrmsr(MSR_SYSENTER_CS, KERNEL_CS);
+    wrmsr(MSR_SYSENTER_ESP, 0);         /* syscall_set_stack() */
+    wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry);
+}
+
+/* ---------- benchmark ---------- */
+static int loop_empty(void *arg)
+{
+    for (uint32_t n = *(uint32_t *)arg; n; --n)
+        asm volatile ("");
+    return 0;
+}
+
+static int loop_int80(void *arg)
+{
+    for (uint32_t n = *(uint32_t *)arg; n; --n)
+        syscall_int80(SYS_WRITE, 0, 0, 0);
+    return 0;
+}
+
+static int loop_sysenter(void *arg)
+{
+    for (uint32_t n = *(uint32_t *)arg; n; --n)
+        syscall_sysenter(SYS_WRITE, 0, 0, 0);
+    return 0;
+}
+
+static uint64_t time_loop(int (*fn)(void *), uint32_t *calls)
+{
+    uint64_t c0 = cycles();
+    user_run(fn, calls);
+    return cycles() - c0;
+}
+
+void syscall_bench(uint32_t calls, struct syscall_bench *b)
+{
+    b->calls = calls;
+    b->empty = time_loop(loop_empty, &calls);
+    b->int80 = time_loop(loop_int80, &calls);
+    b->sysenter = syscall_fast ? time_loop(loop_sysenter, &calls) : 0;
+}
@@ -0,0 +1,88 @@
+/* syscall.h  –  ring-3 entry and the LazyDOS system-call ABI */
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* eax = number, ebx/esi/edi = arguments, result in eax; ecx and edx
+   are lost on the SYSENTER path (SYSEXIT needs them) */
+enum {
+    SYS_EXIT,       /* (code)      back to user_run(), which returns code */
+    SYS_WRITE,      /* (buf, len)  terminal output, returns len */
+    SYS_GETKEY,     /* ()          flush the screen, wait for a key */
+    SYS_SETCOLOR,   /* (attr)      VGA attribute for later output */
+};
+
+struct regs;
+
+extern bool syscall_fast;       /* SYSENTER usable, set by syscall_init() */
+
+void syscall_init(void);        /* MSRs + int 0x80 handler; after cpu_detect */
+
+/* run fn(arg) in ring 3 on a fresh stack until it returns or calls
+   SYS_EXIT; returns its exit code, or -1 if it faulted, was killed (or
+   no stack).  The program runs at PRIO_NORMAL at most. */
+int user_run(int (*fn)(void *), void *arg);
+
+/* kernel stack for traps from ring 3: tss.esp0 and SYSENTER_ESP */
+void    syscall_set_stack(uint32_t top);
+int32_t syscall_dispatch(uint32_t nr, uint32_t a1, uint32_t a2, uint32_t a3);
+void    user_fault(struct regs *r);     /* exception from ring 3 */
+__attribute__((noreturn)) void user_kill(void);  /* thread_kill() landed */
+
+/* cycles for `calls` zero-length writes through each entry path, and
+   for the empty loop around them; sysenter is 0 without SYSENTER */
+struct syscall_bench {
+    uint32_t calls;
+    uint64_t empty, int80, sysenter;
+};
+void syscall_bench(uint32_t calls, struct syscall_bench *b);
+
+/* ---------- user side ---------- */
+static inline int32_t syscall_int80(uint32_t nr, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    int32_t ret;
+    asm volatile ("int $0x80"
+                  : "=a"(ret)
+                  : "a"(nr), "b"(a1), "S"(a2), "D"(a3)
+                  : "memory");
+    return ret;
+}
+
+/* SYSEXIT resumes at edx with esp = ecx, so the caller passes both */
+static inline int32_t syscall_sysenter(uint32_t nr, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    int32_t ret;
+    asm volatile ("mov %%esp, %%ecx\n"
+                  "mov $1f, %%edx\n"
+                  "sysenter\n"
+                  "1:\n"
+                  : "=a"(ret)
+                  : "a"(nr), "b"(a1), "S"(a2), "D"(a3)
+                  : "ecx", "edx", "memory");
+    return ret;
+}
+
+/* the same interpreter code runs in ring 0 (editor, errors before a
+   run) and in ring 3; in the kernel a system call is a plain call */
+static inline int32_t sys_call(uint32_t nr, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    uint16_t cs;
+    asm volatile ("mov %%cs, %0" : "=r"(cs));
+    if ((cs & 3) == 0)
+        return syscall_dispatch(nr, a1, a2, a3);
+    return syscall_fast ? syscall_sysenter(nr, a1, a2, a3)
+                        : syscall_int80(nr, a1, a2, a3);
+}
+
+static inline void sys_exit(int code) { sys_call(SYS_EXIT, (uint32_t)code, 0, 0); }
+static inline void sys_write(const char *buf, size_t len)
+{
+    sys_call(SYS_WRITE, (uint32_t)buf, len, 0);
+}
+static inline char sys_getkey(void) { return (char)sys_call(SYS_GETKEY, 0, 0, 0); }
+static inline void sys_setcolor(uint8_t attr) { sys_call(SYS_SETCOLOR, attr, 0, 0); }
+
+#endif /* SYSCALL_H */
@@ -0,0 +1,211 @@
+/* taskpool.c  –  per-CPU deques, stealing, the AP worker loop
+ *
+ * Every CPU owns a deque.  The owner pushes and pops at the bottom, so
+ * it keeps working on the newest task while its data is still in the
+ * cache; an idle CPU steals from the top, the oldest task, which tends
+ * to be the biggest piece left.  Each deque has its own spinlock, so
+ * the only contention is a thief meeting the owner.
+ */
+#include "taskpool.h"
+#include "smp.h"
+#include "apic.h"
+#include "spinlock.h"
+#include "thread.h"
+#include "timer.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#define BENCH_CHUNKS 64
+
+struct task {
+    void (*fn)(void *);
+    void *arg;
+    struct task_group *group;
+};
+
+struct deque {
+    spinlock_t lock;
+    uint32_t top, bottom;           /* tasks in slot[top .. bottom), mod size */
+    struct task slot[POOL_DEQUE_SIZE];
+    struct taskpool_stats st;
+};
+
+static struct deque deques[MAX_CPUS];
+static volatile uint32_t sleepers;  /* APs in hlt, waiting for a wake-up IPI */
+
+/* ---------- deque (the lock also keeps the BSP thread in place) ---------- */
+static void lock(struct deque *d)
+{
+    preempt_disable();
+    spin_lock(&d->lock);
+}
+
+static void unlock(struct deque *d)
+{
+    spin_unlock(&d->lock);
+    preempt_enable();
+}
+
+static bool push(struct deque *d, const struct task *t)
+{
+    lock(d);
+    bool ok = d->bottom - d->top < POOL_DEQUE_SIZE;
+    if (ok) d->slot[d->bottom++ % POOL_DEQUE_SIZE] = *t;
+    unlock(d);
+    return ok;
+}
+
+static bool pop(struct deque *d, struct task *t)
+{
+    lock(d);
+    bool ok = d->bottom != d->top;
+    if (ok) *t = d->slot[--d->bottom % POOL_DEQUE_SIZE];
+    unlock(d);
+    return ok;
+}
+
+static bool steal(struct deque *d, struct task *t)
+{
+    lock(d);
+    bool ok = d->bottom != d->top;
+    if (ok) *t = d->slot[d->top++ % POOL_DEQUE_SIZE];
+    unlock(d);
+    return ok;
+}
+
+static bool work_queued(void)
+{
+    for (int i = 0; i < smp_cpu_count(); ++i)
+        if (__atomic_load_n(&deques[i].bottom, __ATOMIC_SEQ_CST) !=
+            __atomic_load_n(&deques[i].top, __ATOMIC_SEQ_CST))
+            return true;
+    return false;
+}
+
+/* ---------- running tasks ---------- */
+static void run(struct deque *self, const struct task *t)
+{
+    t->fn(t->arg);
+    __atomic_fetch_add(&self->st.run, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&t->group->pending, 1, __ATOMIC_RELEASE);
+}
+
+/* one task from our own deque, or stolen from the next CPU that has one */
+static bool run_one(int cpu)
+{
+    struct deque *self = &deques[cpu];
+    struct task t;
+
+    if (!pop(self, &t)) {
+        int n = smp_cpu_count(), v;
+        for (v = 1; v < n; ++v)
+            if (steal(&deques[(cpu + v) % n], &t)) break;
+        if (v >= n) return false;
+        __atomic_fetch_add(&self->st.stolen, 1, __ATOMIC_RELAXED);
+    }
+    run(self, &t);
+    return true;
+}
+
+void task_spawn(struct task_group *g, void (*fn)(void *), void *arg)
+{
+    struct task t = { fn, arg, g };
+    struct deque *self = &deques[smp_cpu_id()];
+
+    __atomic_fetch_add(&g->pending, 1, __ATOMIC_RELAXED);
+    if (!push(self, &t)) {
+        run(self, &t);              /* deque full: no queueing, no waiting */
+        return;
+    }
+    /* pairs with the worker's sleepers++ before it looks for work */
+    if (__atomic_load_n(&sleepers, __ATOMIC_SEQ_CST))
+        apic_wake_others();
+}
+
+void task_wait(struct task_group *g)
+{
+    int cpu = smp_cpu_id();
+    while (__atomic_load_n(&g->pending, __ATOMIC_ACQUIRE)) {
+        if (run_one(cpu)) continue;
+        /* the rest is running elsewhere: let other threads have the BSP */
+        if (cpu == 0) yield();
+        asm volatile ("pause");
+    }
+}
+
+void taskpool_worker(void)
+{
+    int cpu = smp_cpu_id();
+    asm volatile ("sti");
+    for (;;) {
+        if (run_one(cpu)) continue;
+
+        /* sti only takes effect after hlt starts, so a wake-up IPI
+           sent after the check still ends the hlt */
+        asm volatile ("cli");
+        __atomic_fetch_add(&sleepers, 1, __ATOMIC_SEQ_CST);
+        if (!work_queued())
+            asm volatile ("sti; hlt");
+        __atomic_fetch_sub(&sleepers, 1, __ATOMIC_SEQ_CST);
+        asm volatile ("sti");
+    }
+}
+
+void taskpool_get_stats(int cpu, struct taskpool_stats *st)
+{
+    *st = deques[cpu].st;
+}
+
+/* ---------- benchmark ---------- */
+struct prime_chunk {
+    uint32_t from, to;
+    uint32_t count;
+};
+
+static void count_primes(void *arg)
+{
+    struct prime_chunk *c = arg;
+    uint32_t n = 0;
+    for (uint32_t v = c->from; v < c->to; ++v) {
+        if (v < 2) continue;
+        bool prime = true;
+        for (uint32_t d = 2; d * d <= v; ++d) {
+            if (v % d == 0) {
+                prime = false;
+                break;
+            }
+        }
+        n += prime;
+    }
+    c->count = n;
+}
+
+void taskpool_bench(uint32_t limit, struct taskpool_bench *b)
+{
+    static struct prime_chunk chunks[BENCH_CHUNKS];
+    uint32_t step = (limit + BENCH_CHUNKS - 1) / BENCH_CHUNKS;
+    for (int i = 0; i < BENCH_CHUNKS; ++i) {
+        chunks[i].from = i * step < limit ? i * step : limit;
+        chunks[i].to = (i + 1) * step < limit ? (i + 1) * step : limit;
+    }
+    b->limit = limit;
+    b->chunks = BENCH_CHUNKS;
+
+    b->primes = 0;
+    uint64_t c0 = cycles();
+    for (int i = 0; i < BENCH_CHUNKS; ++i) {
+        count_primes(&chunks[i]);
+        b->primes += chunks[i].count;
+    }
+    b->serial = cycles() - c0;
+
+    struct task_group g = { 0 };
+    b->primes_pool = 0;
+    c0 = cycles();
+    for (int i = 0; i < BENCH_CHUNKS; ++i)
+        task_spawn(&g, count_primes, &chunks[i]);
+    task_wait(&g);
+    b->pool = cycles() - c0;
+    for (int i = 0; i < BENCH_CHUNKS; ++i)
+        b->primes_pool += chunks[i].count;
+}
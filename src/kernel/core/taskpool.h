@@ -0,0 +1,40 @@
+/* taskpool.h  –  work-stealing task pool over every CPU */
+#ifndef TASKPOOL_H
+#define TASKPOOL_H
+
+#include <stdint.h>
+
+#define POOL_DEQUE_SIZE 256         /* per CPU; task_spawn runs inline when full */
+
+/* tasks spawned into a group and not finished yet */
+struct task_group {
+    volatile uint32_t pending;
+};
+
+/* queue fn(arg) on this CPU's deque, where idle CPUs can steal it.
+   Tasks run in ring 0 on any CPU: they may use the heap and the page
+   allocator, but not threads, the keyboard or the screen.  Ring 0 only. */
+void task_spawn(struct task_group *g, void (*fn)(void *), void *arg);
+
+/* until every task of g is done; runs queued tasks meanwhile */
+void task_wait(struct task_group *g);
+
+/* an AP's life after start-up */
+__attribute__((noreturn)) void taskpool_worker(void);
+
+struct taskpool_stats {
+    uint32_t run;                   /* tasks this CPU ran */
+    uint32_t stolen;                /* ... of those, taken from another CPU */
+};
+void taskpool_get_stats(int cpu, struct taskpool_stats *st);
+
+/* count the primes below limit in chunks: once on this CPU alone, then
+   spread over the pool; both results must agree */
+struct taskpool_bench {
+    uint32_t limit, chunks;
+    uint32_t primes, primes_pool;
+    uint64_t serial, pool;          /* cycles */
+};
+void taskpool_bench(uint32_t limit, struct taskpool_bench *b);
+
+#endif /* TASKPOOL_H */
@@ -0,0 +1,419 @@
+/* thread.c  –  thread slots, run queues, sleep/wakeup, preemption and the switch */
+#include "thread.h"
+#include "cpu.h"
+#include "pmm.h"
+#include "paging.h"
+#include "timer.h"
+#include "syscall.h"
+#include "smp.h"
+#include "../io/vga.h"
+#include "../lib/string.h"
+#include "../lib/int.h"
+#include <stddef.h>
+
+#define SLOT_PAGES  (THREAD_STACK_PAGES + 1)
+
+/* slot 0 is whatever called _init: it already has the boot stack */
+static struct thread threads[MAX_THREADS] = {
+    [0] = { .state = T_RUNNING, .name = "main", .prio = PRIO_HIGH,
+            .slice = TIME_SLICE_TICKS,
+            .color = VGA_COLOR_LIGHT_GREY, .autoflush = true },
+};
+static struct thread *current = &threads[0];
+static struct thread *last;                 /* the thread we switched away from */
+static struct thread *run_head[NR_PRIO], *run_tail[NR_PRIO];
+static bool need_resched;                   /* a better thread is ready */
+static uint32_t stack_region;               /* slot i at (i - 1) * SLOT_PAGES */
+static uint32_t next_id = 1;
+
+/* a switch can now happen anywhere, so the FPU/SSE registers go too */
+static uint8_t fpu_area[MAX_THREADS][FPU_STATE_SIZE] __attribute__((aligned(16)));
+
+static uint64_t switch_in;                  /* cycles() when the CPU last changed hands */
+static uint64_t idle_cycles;
+
+void switch_context(uint32_t *save_esp, uint32_t load_esp);
+
+/* callee-saved registers go on the old stack, esp into *save_esp */
+asm(".text\n"
+    ".global switch_context\n"
+    "switch_context:\n"
+    "  mov 4(%esp), %eax\n"
+    "  mov 8(%esp), %edx\n"
+    "  push %ebp\n  push %ebx\n  push %esi\n  push %edi\n"
+    "  mov %esp, (%eax)\n"
+    "  mov %edx, %esp\n"
+    "  pop %edi\n  pop %esi\n  pop %ebx\n  pop %ebp\n"
+    "  ret\n");
+
+static uint32_t irq_save(void)
+{
+    uint32_t flags;
+    asm volatile ("pushf\n pop %0\n cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static void irq_restore(uint32_t flags)
+{
+    if (flags & 0x200) asm volatile ("sti" : : : "memory");
+}
+
+/* time since the last hand-over goes to t, or to idle for NULL */
+static void charge(struct thread *t)
+{
+    uint64_t now = cycles();
+    if (t) t->cpu_cycles += now - switch_in;
+    else idle_cycles += now - switch_in;
+    switch_in = now;
+}
+
+/* ---------- run queues (interrupts off) ---------- */
+static void enqueue(struct thread *t)
+{
+    t->state = T_READY;
+    t->next = NULL;
+    if (run_tail[t->prio]) run_tail[t->prio]->next = t;
+    else run_head[t->prio] = t;
+    run_tail[t->prio] = t;
+}
+
+static void unqueue(struct thread *t)
+{
+    struct thread **pp = &run_head[t->prio], *prev = NULL;
+    while (*pp && *pp != t) {
+        prev = *pp;
+        pp = &prev->next;
+    }
+    if (!*pp) return;
+    *pp = t->next;
+    if (run_tail[t->prio] == t) run_tail[t->prio] = prev;
+}
+
+/* highest level first, FIFO within a level */
+static struct thread *dequeue(void)
+{
+    for (int p = NR_PRIO - 1; p >= 0; --p) {
+        struct thread *t = run_head[p];
+        if (!t) continue;
+        run_head[p] = t->next;
+        if (!run_head[p]) run_tail[p] = NULL;
+        return t;
+    }
+    return NULL;
+}
+
+static bool ready_from(int prio)
+{
+    for (int p = NR_PRIO - 1; p >= prio; --p)
+        if (run_head[p]) return true;
+    return false;
+}
+
+/* a woken thread that outranks the running one takes over at the end
+   of the current IRQ, or at the next one if preemption is off */
+static void make_ready(struct thread *t)
+{
+    enqueue(t);
+    if (t->prio > current->prio) need_resched = true;
+}
+
+static void wake_sleepers(void)
+{
+    uint64_t now = ticks();
+    for (int i = 0; i < MAX_THREADS; ++i)
+        if (threads[i].state == T_SLEEPING && now >= threads[i].wake_at)
+            make_ready(&threads[i]);
+}
+
+/* runs first thing on the new stack, after every switch */
+static void finish_switch(void)
+{
+    if (last && last->state == T_DEAD && last->detached)
+        last->state = T_FREE;       /* we are off its stack now */
+    last = NULL;
+}
+
+/* switch to the next ready thread; interrupts off.  The caller has put
+   current on a run queue (yield, preemption) or marked it blocked. */
+static void schedule(void)
+{
+    struct thread *prev = current, *next;
+
+    charge(prev);
+    for (;;) {
+        wake_sleepers();
+        if ((next = dequeue())) break;
+        asm volatile ("sti; hlt; cli");     /* all blocked: wait for an IRQ */
+        charge(NULL);
+    }
+    next->state = T_RUNNING;
+    next->slice = TIME_SLICE_TICKS;
+    need_resched = false;
+    if (next == prev) return;
+    prev->switches++;
+
+    /* one screen, many writers: colour and batching go with the thread */
+    prev->color = terminal_getcolor();
+    prev->autoflush = terminal_get_autoflush();
+    terminal_setcolor(next->color);
+    terminal_set_autoflush(next->autoflush);
+    if (next->user_frame)
+        syscall_set_stack(next->user_frame);
+
+    fpu_save(fpu_area[prev - threads]);
+    last = prev;
+    current = next;
+    switch_context(&prev->esp, next->esp);
+    finish_switch();
+    fpu_restore(fpu_area[current - threads]);
+}
+
+/* ---------- preemption ----------
+   Threads live on the BSP; an AP running a pool task has nothing to
+   switch away from, so there it is a no-op. */
+void preempt_disable(void)
+{
+    if (smp_cpu_id() == 0) current->preempt_off++;
+}
+
+void preempt_enable(void)
+{
+    if (smp_cpu_id() == 0)
+        current->preempt_off--;     /* a pending switch waits for the next IRQ */
+}
+
+void thread_tick(void)
+{
+    wake_sleepers();
+    if (current->state != T_RUNNING) return;    /* idling inside schedule() */
+    if (current->slice && --current->slice) return;
+    if (ready_from(current->prio)) need_resched = true;
+}
+
+void thread_irq_exit(const struct regs *r)
+{
+    if (current->state != T_RUNNING || current->preempt_off) return;
+    if (current->kill && current->user_frame && (r->cs & 3) == 3)
+        user_kill();                /* does not return */
+    if (!need_resched) return;
+
+    /* the interrupted code resumes here, and irets, when it next runs */
+    current->preempts++;
+    enqueue(current);
+    schedule();
+}
+
+/* ---------- public API ---------- */
+struct thread *thread_current(void) { return current; }
+
+struct thread *thread_find(uint32_t id)
+{
+    for (int i = 0; i < MAX_THREADS; ++i)
+        if (threads[i].state != T_FREE && threads[i].id == id)
+            return &threads[i];
+    return NULL;
+}
+
+void yield(void)
+{
+    uint32_t flags = irq_save();
+    wake_sleepers();
+    if (ready_from(current->prio)) {
+        enqueue(current);
+        schedule();
+    }
+    irq_restore(flags);
+}
+
+void sleep(uint32_t ms)
+{
+    uint64_t n = uint64_divmod32((uint64_t)ms * TIMER_HZ, 1000, NULL);
+    uint32_t flags = irq_save();
+    current->wake_at = ticks() + n;
+    current->state = T_SLEEPING;
+    schedule();
+    irq_restore(flags);
+}
+
+void thread_wait(const void *chan)
+{
+    current->chan = chan;
+    current->state = T_WAITING;
+    schedule();
+}
+
+void thread_wake(const void *chan)
+{
+    uint32_t flags = irq_save();
+    for (int i = 0; i < MAX_THREADS; ++i)
+        if (threads[i].state == T_WAITING && threads[i].chan == chan)
+            make_ready(&threads[i]);
+    irq_restore(flags);
+}
+
+void mutex_lock(struct mutex *m)
+{
+    uint32_t flags = irq_save();
+    while (m->locked)
+        thread_wait(m);
+    m->locked = true;
+    irq_restore(flags);
+}
+
+void mutex_unlock(struct mutex *m)
+{
+    m->locked = false;
+    thread_wake(m);
+}
+
+void thread_exit(int code)
+{
+    asm volatile ("cli");
+    current->exit_code = code;
+    current->state = T_DEAD;
+    thread_wake(current);           /* join() waits on the thread itself */
+    schedule();
+    for (;;) asm volatile ("hlt");  /* not reached */
+}
+
+int join(struct thread *t)
+{
+    if (!t || t == current || t->detached) return -1;
+    uint32_t flags = irq_save();
+    while (t->state != T_DEAD)
+        thread_wait(t);
+    int code = t->exit_code;
+    t->state = T_FREE;
+    irq_restore(flags);
+    return code;
+}
+
+void kthread_detach(struct thread *t)
+{
+    uint32_t flags = irq_save();
+    t->detached = true;
+    if (t->state == T_DEAD) t->state = T_FREE;
+    irq_restore(flags);
+}
+
+uint8_t thread_set_priority(struct thread *t, uint8_t prio)
+{
+    if (prio >= NR_PRIO) prio = NR_PRIO - 1;
+    uint32_t flags = irq_save();
+    uint8_t old = t->prio;
+    if (t->state == T_READY) {
+        unqueue(t);
+        t->prio = prio;
+        make_ready(t);
+    } else {
+        t->prio = prio;
+    }
+    if (t == current && ready_from(prio + 1)) need_resched = true;
+    irq_restore(flags);
+    return old;
+}
+
+void thread_kill(struct thread *t)
+{
+    uint32_t flags = irq_save();
+    t->kill = true;
+    if (t->state == T_SLEEPING) make_ready(t);
+    irq_restore(flags);
+}
+
+bool thread_break(void)
+{
+    struct thread *shell = &threads[0];
+    if (!shell->user_frame) return false;
+    shell->kill = true;
+    return true;
+}
+
+int thread_snapshot(struct thread_info *out, int max, uint64_t *idle)
+{
+    uint32_t flags = irq_save();
+    charge(current);                /* include the slice in progress */
+    int n = 0;
+    for (int i = 0; i < MAX_THREADS && n < max; ++i) {
+        const struct thread *t = &threads[i];
+        if (t->state == T_FREE) continue;
+        out[n].id = t->id;
+        out[n].state = t->state;
+        out[n].prio = t->prio;
+        memcpy(out[n].name, t->name, THREAD_NAME_LEN);
+        out[n].cpu_cycles = t->cpu_cycles;
+        out[n].switches = t->switches;
+        out[n].preempts = t->preempts;
+        n++;
+    }
+    *idle = idle_cycles;
+    irq_restore(flags);
+    return n;
+}
+
+static void thread_start(void)
+{
+    finish_switch();
+    fpu_reset();
+    asm volatile ("sti");
+    thread_exit(current->fn(current->arg));
+}
+
+struct thread *kthread_create(int (*fn)(void *), void *arg, const char *name)
+{
+    if (!stack_region) return NULL;
+
+    uint32_t flags = irq_save();
+    struct thread *t = NULL;
+    for (int i = 1; i < MAX_THREADS && !t; ++i)
+        if (threads[i].state == T_FREE) t = &threads[i];
+    if (!t) {
+        irq_restore(flags);
+        return NULL;
+    }
+
+    int slot = t - threads;
+    uint32_t top = stack_region + ((uint32_t)slot * SLOT_PAGES) * PAGE_SIZE;
+    uint32_t *sp = (uint32_t *)top;
+    *--sp = 0;                          /* thread_start never returns */
+    *--sp = (uint32_t)thread_start;     /* where switch_context "returns" */
+    for (int i = 0; i < 4; ++i)
+        *--sp = 0;                      /* ebp, ebx, esi, edi */
+
+    t->esp = (uint32_t)sp;
+    t->id = next_id++;
+    size_t n = 0;
+    while (name[n] && n < THREAD_NAME_LEN - 1) {
+        t->name[n] = name[n];
+        n++;
+    }
+    t->name[n] = '\0';
+    t->prio = PRIO_NORMAL;
+    t->preempt_off = 0;
+    t->kill = false;
+    t->fn = fn;
+    t->arg = arg;
+    t->exit_code = 0;
+    t->detached = false;
+    t->user_frame = 0;
+    t->color = terminal_getcolor();
+    t->autoflush = true;
+    t->cpu_cycles = 0;
+    t->switches = t->preempts = 0;
+    make_ready(t);
+    irq_restore(flags);
+    return t;
+}
+
+void thread_init(void)
+{
+    /* slot i (i >= 1): a guard page, then THREAD_STACK_PAGES of stack;
+       the stack of slot i tops out at the guard of slot i + 1 */
+    uint32_t pages = (MAX_THREADS - 1) * SLOT_PAGES;
+    uint32_t base = pmm_alloc_pages(pages);
+    if (!base) return;                  /* no threads, just "main" */
+
+    for (int i = 1; i < MAX_THREADS; ++i)
+        paging_guard(base + (uint32_t)(i - 1) * SLOT_PAGES * PAGE_SIZE);
+    stack_region = base;
+}
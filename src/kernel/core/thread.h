@@ -0,0 +1,126 @@
+/* thread.h  –  kernel threads: priority run queues, timer preemption */
+#ifndef THREAD_H
+#define THREAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "idt.h"
+
+#define MAX_THREADS         16      /* slot 0 is the boot thread */
+#define THREAD_STACK_PAGES  4       /* plus an unmapped guard page below */
+#define THREAD_NAME_LEN     16
+#define TIME_SLICE_TICKS    10      /* ms before an equal-priority thread gets a turn */
+
+/* a ready thread always runs before any ready thread of a lower level;
+   equal levels take turns every time slice */
+enum thread_prio {
+    PRIO_LOW,
+    PRIO_NORMAL,                    /* new threads */
+    PRIO_HIGH,                      /* the shell, so typing beats compute work */
+    NR_PRIO
+};
+
+enum thread_state {
+    T_FREE,                 /* slot unused */
+    T_READY,                /* on the run queue */
+    T_RUNNING,
+    T_SLEEPING,             /* until ticks() reaches wake_at */
+    T_WAITING,              /* until thread_wake(chan) */
+    T_DEAD,                 /* exited, waiting for join() */
+};
+
+struct thread {
+    uint32_t esp;                   /* saved by switch_context */
+    uint32_t id;
+    enum thread_state state;
+    char name[THREAD_NAME_LEN];
+    uint8_t prio;                   /* enum thread_prio */
+    uint32_t slice;                 /* ticks left before round-robin */
+    uint32_t preempt_off;           /* > 0: the timer must not switch away */
+    bool kill;                      /* end the ring-3 program (Ctrl+C, kill) */
+
+    int (*fn)(void *);
+    void *arg;
+    int exit_code;
+    bool detached;                  /* nobody joins: freed on exit */
+
+    uint64_t wake_at;               /* T_SLEEPING */
+    const void *chan;               /* T_WAITING */
+
+    uint32_t user_frame;            /* enter_user() frame while in ring 3 */
+    uint32_t user_preempt;          /* preempt_off when it entered ring 3 */
+    uint8_t color;                  /* terminal state, swapped with the CPU */
+    bool autoflush;
+
+    uint64_t cpu_cycles;            /* cycles() spent running, IRQs included */
+    uint32_t switches;              /* times it gave up the CPU */
+    uint32_t preempts;              /* ... of those, taken away by the timer */
+
+    struct thread *next;            /* run queue */
+};
+
+/* what `ps` shows; copied with interrupts off so it is consistent */
+struct thread_info {
+    uint32_t id;
+    enum thread_state state;
+    uint8_t prio;
+    char name[THREAD_NAME_LEN];
+    uint64_t cpu_cycles;
+    uint32_t switches, preempts;
+};
+
+/* reserve the stack region; after pmm_init and paging_init */
+void thread_init(void);
+
+/* new thread running fn(arg), queued behind the others; NULL when all
+   slots are taken.  Its exit code is fn's return value. */
+struct thread *kthread_create(int (*fn)(void *), void *arg, const char *name);
+void kthread_detach(struct thread *t);     /* free the slot on exit */
+
+void yield(void);                   /* to a ready thread of the same or a higher level */
+void sleep(uint32_t ms);
+int  join(struct thread *t);        /* wait for t, return its exit code */
+__attribute__((noreturn)) void thread_exit(int code);
+
+struct thread *thread_current(void);
+struct thread *thread_find(uint32_t id);    /* NULL unless live */
+
+/* returns the old level; takes effect at the next scheduling decision */
+uint8_t thread_set_priority(struct thread *t, uint8_t prio);
+
+/* stop the ring-3 program t runs, at its next interrupt or system call,
+   and cut a sleep short.  thread_break() is Ctrl+C: the same for the
+   shell thread, false if it is not running a program. */
+void thread_kill(struct thread *t);
+bool thread_break(void);
+
+/* live threads in slot order, at most max; *idle gets the cycles spent
+   halted with nothing to run.  Returns the count. */
+int thread_snapshot(struct thread_info *out, int max, uint64_t *idle);
+
+/* keep the timer from switching threads, e.g. inside the heap; nests,
+   and also works from ring 3 */
+void preempt_disable(void);
+void preempt_enable(void);
+
+/* from IRQ0: sleepers, time slices */
+void thread_tick(void);
+/* end of every IRQ: switch if a better thread is waiting, end a killed
+   program that was interrupted in ring 3 */
+void thread_irq_exit(const struct regs *r);
+
+/* block until thread_wake(chan).  Call with interrupts off, after
+   checking the condition, so an IRQ cannot wake us in between; returns
+   with interrupts still off.  thread_wake is safe from IRQ handlers. */
+void thread_wait(const void *chan);
+void thread_wake(const void *chan);
+
+/* a lock that sleeps instead of spinning, for long waits such as disk
+   I/O.  Threads only: not from IRQ handlers, ring 3 or pool tasks. */
+struct mutex {
+    volatile bool locked;
+};
+void mutex_lock(struct mutex *m);
+void mutex_unlock(struct mutex *m);
+
+#endif /* THREAD_H */
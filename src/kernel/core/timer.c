@@ -0,0 +1,127 @@
+/* timer.c  –  PIT channel 0 at TIMER_HZ, TSC calibrated against it */
+#include "timer.h"
+#include "idt.h"
+#include "cpu.h"
+#include "prof.h"
+#include "thread.h"
+#include "../io/port.h"
+#include "../lib/int.h"
+
+#define PIT_CH0      0x40
+#define PIT_CMD      0x43
+#define PIT_HZ       1193182U   /* input clock */
+#define PIT_DIVISOR  ((PIT_HZ + TIMER_HZ / 2) / TIMER_HZ)
+#define PIT_MODE2    0x34       /* ch0, lo/hi byte, rate generator */
+
+#define TIMER_IRQ    0
+#define CAL_TICKS    50         /* calibration window */
+
+static volatile uint64_t tick_count;
+
+/* cycles() runs at cycle_rate Hz; ns = (cycles * ns_mult) >> ns_shift */
+static uint64_t tsc_base;
+static uint64_t cycle_rate;
+static uint32_t ns_mult;
+static uint32_t ns_shift;
+
+static void timer_irq(struct regs *r)
+{
+    tick_count++;
+    prof_tick(r);
+    thread_tick();
+}
+
+uint64_t ticks(void)
+{
+    /* two 32-bit loads: read until no tick landed in between */
+    uint64_t a, b;
+    do {
+        a = tick_count;
+        b = tick_count;
+    } while (a != b);
+    return a;
+}
+
+uint64_t cycles(void)
+{
+    if (cpu_features.tsc)
+        return rdtsc() - tsc_base;
+    return ticks() * PIT_DIVISOR;
+}
+
+uint64_t cycles_hz(void)
+{
+    return cycle_rate;
+}
+
+/* (v * mult) >> shift with a 96-bit intermediate, shift <= 32 */
+static uint64_t mul_shift(uint64_t v, uint32_t mult, uint32_t shift)
+{
+    uint64_t lo = (uint64_t)(uint32_t)v * mult;
+    uint64_t hi = (uint64_t)(uint32_t)(v >> 32) * mult;
+    return (hi << (32 - shift)) + (lo >> shift);
+}
+
+uint64_t cycles_to_ns(uint64_t c)
+{
+    return mul_shift(c, ns_mult, ns_shift);
+}
+
+uint64_t ns_since_boot(void)
+{
+    return cycles_to_ns(cycles());
+}
+
+/* most precise 32-bit multiplier for 1e9 / hz; one divide, at boot */
+static void set_rate(uint64_t hz)
+{
+    if (!hz) hz = 1;                    /* a TSC that never moved: no /0 */
+    cycle_rate = hz;
+
+    /* above 4.29 GHz the divisor takes k bits off both sides; losing
+       a few cycles per second out of 2^32 is nothing */
+    uint32_t k = 0;
+    while (hz >> (32 + k)) k++;
+    uint32_t h = (uint32_t)(hz >> k);
+    for (ns_shift = 32; ns_shift > 0; --ns_shift) {
+        uint64_t m = uint64_divmod32((1000000000ULL << ns_shift) >> k, h, 0);
+        if ((m >> 32) == 0) {
+            ns_mult = (uint32_t)m;
+            return;
+        }
+    }
+    ns_mult = 1000000000U / h;
+}
+
+static void wait_ticks(uint64_t n)
+{
+    uint64_t start = ticks();
+    while (ticks() - start < n)
+        asm volatile ("hlt");
+}
+
+/* count TSC cycles over CAL_TICKS whole ticks of PIT_DIVISOR clocks */
+static uint64_t calibrate_tsc(void)
+{
+    wait_ticks(1);                      /* start on a tick edge */
+    uint64_t t0 = rdtsc();
+    wait_ticks(CAL_TICKS);
+    uint64_t dt = rdtsc() - t0;
+    return uint64_divmod32(dt * PIT_HZ, CAL_TICKS * PIT_DIVISOR, 0);
+}
+
+void timer_init(void)
+{
+    outb(PIT_CMD, PIT_MODE2);
+    outb(PIT_CH0, PIT_DIVISOR & 0xFF);
+    outb(PIT_CH0, PIT_DIVISOR >> 8);
+    irq_install(TIMER_IRQ, timer_irq);
+
+    set_rate(cpu_features.tsc ? calibrate_tsc() : PIT_HZ);
+
+    /* both clocks start now */
+    asm volatile ("cli");
+    tick_count = 0;
+    if (cpu_features.tsc) tsc_base = rdtsc();
+    asm volatile ("sti");
+}
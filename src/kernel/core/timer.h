@@ -0,0 +1,17 @@
+/* timer.h  –  PIT tick counter and calibrated TSC clock */
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+#define TIMER_HZ    1000        /* IRQ0 rate */
+
+void     timer_init(void);      /* PIT + IRQ0, TSC calibration; needs sti */
+
+uint64_t ticks(void);           /* IRQ0 ticks since timer_init */
+uint64_t cycles(void);          /* TSC since timer_init (PIT clocks without TSC) */
+uint64_t cycles_hz(void);       /* calibrated rate of cycles(): 4 GHz and up fit */
+uint64_t cycles_to_ns(uint64_t c);
+uint64_t ns_since_boot(void);
+
+#endif /* TIMER_H */
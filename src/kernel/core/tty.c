@@ -6,10 +6,28 @@
 #include "../apps/wog.h"
 #include "../lib/string.h"
 #include "../io/port.h"
+#include "../core/cpu.h"
+#include "../core/timer.h"
+#include "../core/prof.h"
+#include "../core/bench.h"
+#include "../core/pmm.h"
+#include "../core/heap.h"
+#include "../core/syscall.h"
+#include "../core/thread.h"
+#include "../core/smp.h"
+#include "../core/taskpool.h"
+#include "../fs/ramdisk.h"
+#include "../fs/bcache.h"
+#include "../fs/fat.h"
+#include "../io/ata.h"
+#include "../io/serial.h"
+#include "../lib/int.h"
 #include <stdbool.h>
 
 #define PROMPT  "LazyDOS> "
 #define BUF_SZ  256
+#define SYSBENCH_CALLS 100000
+#define SMPBENCH_LIMIT 1000000
 
 static char input[BUF_SZ];
 
@@ -29,10 +47,75 @@ static void rtrim(char *s) {
     while (*p) p++;
     while (p > s && p[-1] == ' ') *--p = '\0';
 }
+static void print_u64(uint64_t v) {
+    char tmp[21];
+    int i = sizeof(tmp) - 1;
+    tmp[i] = '\0';
+    do {
+        uint32_t d;
+        v = uint64_divmod32(v, 10, &d);
+        tmp[--i] = '0' + d;
+    } while (v);
+    print(tmp + i);
+}
+/* v as at least `width` digits, zero padded */
+static void print_pad(uint32_t v, int width) {
+    char tmp[11];
+    int i = sizeof(tmp) - 1;
+    tmp[i] = '\0';
+    do {
+        tmp[--i] = '0' + v % 10;
+        v /= 10;
+    } while ((v || --width > 0) && i > 0);
+    print(tmp + i);
+}
+/* v right-aligned in width columns */
+static void print_col(uint32_t v, int width) {
+    char tmp[11];
+    int i = sizeof(tmp) - 1;
+    tmp[i] = '\0';
+    do {
+        tmp[--i] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    for (int pad = width - (int)(sizeof(tmp) - 1 - i); pad > 0; --pad)
+        terminal_putchar(' ');
+    print(tmp + i);
+}
+/* ns as "S.mmm" seconds or "M.uuu" ms */
+static void print_ns(uint64_t ns) {
+    uint32_t rem;
+    if (ns >= 1000000000ULL) {
+        print_u64(uint64_divmod32(ns, 1000000000U, &rem));
+        print(".");
+        print_pad(rem / 1000000, 3);
+        print(" s");
+    } else {
+        print_u64(uint64_divmod32(ns, 1000000U, &rem));
+        print(".");
+        print_pad(rem / 1000, 3);
+        print(" ms");
+    }
+}
+
+static void run_cmd(const char *line);
+
+/* the shell is the boot thread; anything else is a `&` job */
+static bool in_background(void) { return thread_current()->id != 0; }
+
+/* editors and prompts need the screen and keyboard to themselves */
+static bool foreground(const char *what)
+{
+    if (!in_background()) return true;
+    print(what);
+    println(": needs the foreground, can't run with &");
+    return false;
+}
 
 /*  ----------  commands  ----------  */
-static void cmd_help(void)
+static void cmd_help(const char *args)
 {
+    (void)args;
     println("LazyDOS v0.1 - Available commands:");
     println("  help      - this screen");
     println("  calc      - Calculator");
@@ -44,10 +127,32 @@ static void cmd_help(void)
     println("  shutdown  - power off (sort of)");
     println("  clear     - clear screen");
     println("  echo      - echo text");
+    println("  uptime    - time since boot");
+    println("  time CMD  - run CMD and show how long it took");
+    println("  sleep MS  - wait MS milliseconds (try it with &)");
+    println("  prof start|stop|report [N] - sample hot functions");
+    println("  mem       - page frames and kernel heap statistics");
+    println("  sysbench  - int 0x80 vs SYSENTER system-call cost");
+    println("  qbasic run / wog run - run the program from the last edit");
+    println("  CMD &     - run CMD in the background");
+    println("  ps / top  - threads and CPU use (top: the last second)");
+    println("  kill ID   - stop the program a background job runs");
+    println("  nice ID low|normal|high - change a thread's priority");
+    println("  smp [bench [N]] - CPUs and pool tasks; primes below N, 1 CPU vs all");
+    println("  dir       - files on the RAM disk and the FAT disk");
+    println("  type FILE - show a file");
+    println("  run FILE  - run a .BAS or .WOG file");
+    println("  disk [dump N LBA] - IDE disks, or one sector in hex");
+    println("  cache     - block cache hits, read-ahead, write-back");
+    println("  sync      - write the dirty blocks to disk");
+    println("  serial    - COM1 console traffic");
+    println("  bench [list] [NAME] [N] [serial] - microbenchmarks, min/median/max");
+    println("  Ctrl+C    - stop the program running in the foreground");
 }
 
-static void cmd_cfetch(void)
+static void cmd_cfetch(const char *args)
 {
+    (void)args;
     /*  logo:  LDOS  (matching your ASCII)  */
     pr_ok_nl("     ##:::::::'########:::'#######:::'######::");
     pr_ok_nl("     ##::::::: ##.... ##:'##.... ##:'##... ##:");
@@ -59,25 +164,41 @@ static void cmd_cfetch(void)
     pr_ok_nl("     ........::........::::.......::::......:::");
     println("");
     println("LazyDOS v0.0.5        -  works well enough");
-    println("CPU : i486 (probably)");
-    println("RAM : 640 KB conventional");
+    print("CPU : ");
+    print(cpu_features.vendor);
+    println(cpu_features.sse ? " (x87 + SSE)" : cpu_features.fpu ? " (x87)" : " (no FPU)");
+    print("RAM : ");
+    print_u64(pmm_total_pages() >> (20 - PAGE_SHIFT));
+    print(" MB (");
+    print_u64(pmm_free_count() >> (20 - PAGE_SHIFT));
+    println(" MB free)");
     println("Boot: Multiboot");
     println("Shell: LazyTTY (built-in)");
 }
 
-static void cmd_info(void)
+static void cmd_info(const char *args)
 {
+    (void)args;
     println("=== LazyDOS System Information ===");
     println("Kernel Version : 0.0.5");
     println("Architecture   : 32-bit x86");
     println("Boot Method    : Multiboot 1.0");
-    println("Memory Layout  : 1 MB load, stack elsewhere");
-    println("Drivers        : VGA text, polling keyboard");
+    println("Memory Layout  : 1 MB load, page bitmap after the image");
+    print("Physical RAM   : ");
+    print_u64(pmm_total_pages());
+    print(" frames, ");
+    print_u64(pmm_free_count());
+    print(" free, top ");
+    print_u64(pmm_top() >> 10);
+    println(" KB");
+    println("Drivers        : VGA text, IRQ1 keyboard, IRQ0 PIT timer");
     println("==================================");
 }
 
-static void cmd_reboot(void)
+static void cmd_reboot(const char *args)
 {
+    (void)args;
+    bcache_sync();
     println("Rebooting…");
     /* keyboard-controller reset (works on real hardware + QEMU/BOCHS) */
     while (inb(0x64) & 0x02) ;
@@ -85,40 +206,778 @@ static void cmd_reboot(void)
     for(;;) asm volatile ("hlt");
 }
 
-static void cmd_shutdown(void)
+static void cmd_shutdown(const char *args)
 {
+    (void)args;
+    bcache_sync();
     println("Shutdown - please power-off manually.");
     outb(0x64, 0x2000);
     /* QEMU/BOCHS shortcut if you want: outw(0x604, 0x2000); */
     for(;;) asm volatile ("hlt");
 }
 
-static void cmd_clear(void)
+static void cmd_clear(const char *args)
 {
+    (void)args;
     terminal_initialize();
 }
 
-static void cmd_echo(void)
+static void cmd_echo(const char *args)
 {
-    /* echo everything after "echo " until newline */
-    char *p = input + 5;
-    while (*p == ' ') p++;
-    println(p);
+    println(args);
 }
 
+static void cmd_uptime(const char *args)
+{
+    (void)args;
+    uint32_t ms;
+    uint64_t s = uint64_divmod32(ns_since_boot(), 1000000000U, &ms);
+    uint32_t sec;
+    uint64_t m = uint64_divmod32(s, 60, &sec);
+    uint32_t min;
+    uint64_t h = uint64_divmod32(m, 60, &min);
+
+    print("up ");
+    print_u64(h);
+    print(":");
+    print_pad(min, 2);
+    print(":");
+    print_pad(sec, 2);
+    print(".");
+    print_pad(ms / 1000000, 3);
+    print("  (");
+    print_u64(ticks());
+    print(" ticks, ");
+    print_u64(uint64_divmod32(cycles_hz(), 1000000, NULL));
+    println(cpu_features.tsc ? " MHz TSC)" : " MHz PIT, no TSC)");
+}
+
+static void cmd_time(const char *args)
+{
+    if (!*args) {
+        println("usage: time <command>");
+        return;
+    }
+    uint64_t c0 = cycles();
+    run_cmd(args);
+    uint64_t dc = cycles() - c0;
+
+    print("real ");
+    print_ns(cycles_to_ns(dc));
+    print(", ");
+    print_u64(dc);
+    println(" cycles");
+}
+
+static void cmd_sleep(const char *args)
+{
+    uint32_t ms = 0;
+    while (*args >= '0' && *args <= '9') ms = ms * 10 + (*args++ - '0');
+    if (*args || !ms) {
+        println("usage: sleep <milliseconds>");
+        return;
+    }
+    sleep(ms);
+}
+
+static void cmd_prof(const char *args)
+{
+    if (!strncmp(args, "start", 5)) {
+        prof_start();
+        println("prof: sampling");
+    } else if (!strncmp(args, "stop", 4)) {
+        prof_stop();
+        println("prof: stopped");
+    } else if (!strncmp(args, "report", 6)) {
+        const char *p = args + 6;
+        int n = 0;
+        while (*p == ' ') p++;
+        while (*p >= '0' && *p <= '9') n = n * 10 + (*p++ - '0');
+        prof_report(n ? n : 10);
+    } else {
+        println("usage: prof start|stop|report [N]");
+    }
+}
+
+static void cmd_mem(const char *args)
+{
+    (void)args;
+    struct heap_stats st;
+    heap_get_stats(&st);
+
+    print("frames: ");
+    print_u64(pmm_free_count());
+    print(" free of ");
+    print_u64(pmm_total_pages());
+    print(" (");
+    print_u64(pmm_free_count() >> (20 - PAGE_SHIFT));
+    println(" MB free)");
+
+    println("  size  pages   live     allocs      frees");
+    uint32_t slab_pages = 0;
+    for (int c = 0; c < HEAP_CLASSES; ++c) {
+        const struct heap_class_stats *cs = &st.cls[c];
+        slab_pages += cs->slabs;
+        if (!cs->allocs) continue;
+        print_col(cs->size, 6);
+        print_col(cs->slabs, 7);
+        print_col(cs->live, 7);
+        print_col(cs->allocs, 11);
+        print_col(cs->frees, 11);
+        terminal_putchar('\n');
+    }
+    print(" large");
+    print_col(st.large_pages, 7);
+    print_col(st.large_live, 7);
+    print_col(st.large_allocs, 11);
+    print_col(st.large_frees, 11);
+    terminal_putchar('\n');
+
+    print("heap: ");
+    print_u64(slab_pages + st.large_pages);
+    print(" pages, ");
+    print_u64(st.large_bytes);
+    print(" bytes in large blocks, ");
+    print_u64(st.failed);
+    println(" failed");
+}
+
+/* one path's cost per call, the empty loop subtracted */
+static void print_per_call(const char *name, uint64_t total, const struct syscall_bench *b)
+{
+    uint64_t c = total > b->empty ? total - b->empty : 0;
+    uint32_t rem;
+    print(name);
+    print_col((uint32_t)uint64_divmod32(c, b->calls, &rem), 6);
+    print(" cycles/call, ");
+    print_u64(uint64_divmod32(cycles_to_ns(c), b->calls, &rem));
+    println(" ns");
+}
+
+static void cmd_sysbench(const char *args)
+{
+    (void)args;
+    struct syscall_bench b;
+    print_u64(SYSBENCH_CALLS);
+    println(" zero-length SYS_WRITE calls from ring 3:");
+    syscall_bench(SYSBENCH_CALLS, &b);
+    print_per_call("  int 0x80 :", b.int80, &b);
+    if (syscall_fast)
+        print_per_call("  sysenter :", b.sysenter, &b);
+    else
+        println("  sysenter : not supported by this CPU");
+}
+
+/*  ----------  threads  ----------  */
+static const char *const state_names[] = {
+    "free", "ready", "running", "sleeping", "waiting", "dead",
+};
+static const char *const prio_names[NR_PRIO] = { "low", "normal", "high" };
+
+/* s left-aligned in width columns */
+static void print_left(const char *s, int width) {
+    print(s);
+    for (int pad = width - (int)strlen(s); pad > 0; --pad)
+        terminal_putchar(' ');
+}
+/* decimal number at s; NULL if there is none */
+static const char *parse_u32(const char *s, uint32_t *v) {
+    if (*s < '0' || *s > '9') return NULL;
+    for (*v = 0; *s >= '0' && *s <= '9'; ++s)
+        *v = *v * 10 + (*s - '0');
+    return s;
+}
+/* part/whole in percent, both scaled down until whole fits 32 bits */
+static uint32_t percent(uint64_t part, uint64_t whole) {
+    while (whole >> 32) {
+        part >>= 1;
+        whole >>= 1;
+    }
+    if (!whole) return 0;
+    uint32_t rem;
+    return (uint32_t)uint64_divmod32(part * 100, (uint32_t)whole, &rem);
+}
+static uint32_t cycles_ms(uint64_t c) {
+    uint32_t rem;
+    return (uint32_t)uint64_divmod32(cycles_to_ns(c), 1000000U, &rem);
+}
+
+/* used[i] is the CPU time of th[i] over the whole period */
+static void print_threads(const struct thread_info *th, const uint64_t *used,
+                          int n, uint64_t idle, uint64_t whole)
+{
+    println("  ID  PRI     STATE       TIME ms  CPU%  SWITCH  PREEMPT  NAME");
+    for (int i = 0; i < n; ++i) {
+        print_col(th[i].id, 4);
+        print("  ");
+        print_left(prio_names[th[i].prio], 8);
+        print_left(state_names[th[i].state], 9);
+        print_col(cycles_ms(used[i]), 10);
+        print_col(percent(used[i], whole), 5);
+        print("%");
+        print_col(th[i].switches, 8);
+        print_col(th[i].preempts, 9);
+        print("  ");
+        println(th[i].name);
+    }
+    print("      (idle)           ");
+    print_col(cycles_ms(idle), 10);
+    print_col(percent(idle, whole), 5);
+    println("%");
+}
+
+/* CPU time since each thread started, share of the time since boot */
+static void cmd_ps(const char *args)
+{
+    (void)args;
+    struct thread_info th[MAX_THREADS];
+    uint64_t used[MAX_THREADS], idle;
+    int n = thread_snapshot(th, MAX_THREADS, &idle);
+    for (int i = 0; i < n; ++i)
+        used[i] = th[i].cpu_cycles;
+    print_threads(th, used, n, idle, cycles());
+}
+
+/* the same over the next second, for threads alive at both ends */
+static void cmd_top(const char *args)
+{
+    (void)args;
+    static struct thread_info before[MAX_THREADS], after[MAX_THREADS];
+    uint64_t used[MAX_THREADS], idle0, idle1;
+
+    int n0 = thread_snapshot(before, MAX_THREADS, &idle0);
+    uint64_t c0 = cycles();
+    sleep(1000);
+    int n1 = thread_snapshot(after, MAX_THREADS, &idle1);
+    uint64_t whole = cycles() - c0;
+
+    int n = 0;
+    for (int i = 0; i < n1; ++i) {
+        for (int j = 0; j < n0; ++j) {
+            if (before[j].id != after[i].id) continue;
+            after[n] = after[i];
+            used[n++] = after[i].cpu_cycles - before[j].cpu_cycles;
+            break;
+        }
+    }
+    print_threads(after, used, n, idle1 - idle0, whole);
+}
+
+static struct thread *job_arg(const char *args, const char *usage, const char **rest)
+{
+    uint32_t id;
+    if (!(*rest = parse_u32(args, &id))) {
+        println(usage);
+        return NULL;
+    }
+    struct thread *t = thread_find(id);
+    if (!t) println("No such thread");
+    return t;
+}
+
+static void cmd_kill(const char *args)
+{
+    const char *rest;
+    struct thread *t = job_arg(args, "usage: kill <id>", &rest);
+    if (!t) return;
+    if (t->id == 0) {
+        println("kill: that is the shell (Ctrl+C stops its program)");
+        return;
+    }
+    thread_kill(t);
+}
+
+static void cmd_nice(const char *args)
+{
+    const char *rest;
+    struct thread *t = job_arg(args, "usage: nice <id> low|normal|high", &rest);
+    if (!t) return;
+    while (*rest == ' ') rest++;
+    for (int p = 0; p < NR_PRIO; ++p) {
+        if (!strcmp(rest, prio_names[p])) {
+            thread_set_priority(t, p);
+            return;
+        }
+    }
+    println("usage: nice <id> low|normal|high");
+}
+
+/*  ----------  CPUs  ----------  */
+static void smp_bench(const char *args)
+{
+    uint32_t limit = SMPBENCH_LIMIT;
+    while (*args == ' ') args++;
+    if (*args && !parse_u32(args, &limit)) {
+        println("usage: smp bench [N]");
+        return;
+    }
+    struct taskpool_bench b;
+    print("Primes below ");
+    print_u64(limit);
+    print(", ");
+    print_u64(smp_cpu_count());
+    println(smp_cpu_count() == 1 ? " CPU:" : " CPUs:");
+    taskpool_bench(limit, &b);
+
+    print("  1 CPU : ");
+    print_u64(b.primes);
+    print(" in ");
+    print_ns(cycles_to_ns(b.serial));
+    print("\n  pool  : ");
+    print_u64(b.primes_pool);
+    print(" in ");
+    print_ns(cycles_to_ns(b.pool));
+    terminal_putchar('\n');
+    if (b.primes != b.primes_pool)
+        println("  MISMATCH: the pool lost or repeated a chunk");
+    if (b.pool) {
+        uint32_t x100 = percent(b.serial, b.pool);
+        print("  speedup ");
+        print_u64(x100 / 100);
+        print(".");
+        print_pad(x100 % 100, 2);
+        print("x over ");
+        print_u64(b.chunks);
+        println(" chunks");
+    }
+}
+
+static void cmd_smp(const char *args)
+{
+    if (!strncmp(args, "bench", 5)) {
+        smp_bench(args + 5);
+        return;
+    }
+    println("  CPU  APIC  TASKS   STOLEN");
+    for (int i = 0; i < smp_cpu_count(); ++i) {
+        struct taskpool_stats st;
+        taskpool_get_stats(i, &st);
+        print_col(i, 5);
+        print_col(smp_apic_id(i), 6);
+        print_col(st.run, 7);
+        print_col(st.stolen, 9);
+        println(i ? "" : "  (boot CPU)");
+    }
+    if (smp_cpu_found() > smp_cpu_count()) {
+        print_u64(smp_cpu_found() - smp_cpu_count());
+        println(" more listed by ACPI did not start");
+    }
+}
+
+/*  ----------  files: RAM disk, then FAT disk  ----------  */
+#define DIR_MAX 512                 /* root entries on a hard disk FAT */
+
+static void dir_total(int files, uint32_t bytes)
+{
+    print_col(files, 6);
+    print(" file(s)");
+    print_col(bytes, 15);
+    println(" bytes");
+}
+
+static void dir_fat(void)
+{
+    struct fat_dirent *ents = kmalloc(DIR_MAX * sizeof(*ents));
+    if (!ents) {
+        println("dir: out of memory");
+        return;
+    }
+    int n = fat_list(ents, DIR_MAX), files = 0;
+    uint32_t total = 0;
+    print(" Disk ");
+    print_u64(fat_dev());
+    print(", FAT");
+    print_u64(fat_bits());
+    println(":");
+    for (int i = 0; i < n; ++i) {
+        print(" ");
+        print_left(ents[i].name, 24);
+        if (ents[i].dir) {
+            println("     <DIR>");
+            continue;
+        }
+        print_col(ents[i].size, 10);
+        terminal_putchar('\n');
+        total += ents[i].size;
+        files++;
+    }
+    kfree(ents);
+    dir_total(files, total);
+    print_col(fat_free_bytes(), 30);
+    println(" bytes free");
+}
+
+static void cmd_dir(const char *args)
+{
+    (void)args;
+    uint32_t total = 0;
+    if (!ramdisk_modules() && !fat_mounted()) {
+        println("No files: add a module to grub.cfg or limine.cfg, or a FAT disk");
+        return;
+    }
+    if (ramdisk_modules()) {
+        for (int i = 0; i < ramdisk_count(); ++i) {
+            const struct rd_file *f = ramdisk_file(i);
+            print(" ");
+            print_left(f->name, 24);
+            print_col(f->size, 10);
+            terminal_putchar('\n');
+            total += f->size;
+        }
+        dir_total(ramdisk_count(), total);
+    }
+    if (fat_mounted()) {
+        if (ramdisk_modules()) terminal_putchar('\n');
+        dir_fat();
+    }
+}
+
+/* a file to read: straight from the RAM disk, or loaded from FAT */
+struct file {
+    const char *name;
+    const char *data;
+    size_t size;
+    bool terminated;                /* data[size] is a NUL */
+    char *loaded;                   /* kfree'd by file_done() */
+};
+
+static bool file_arg(const char *args, const char *usage, struct file *f)
+{
+    if (!*args) {
+        println(usage);
+        return false;
+    }
+    f->name = args;
+    f->loaded = NULL;
+    const struct rd_file *r = ramdisk_find(args);
+    if (r) {
+        f->data = r->data;
+        f->size = r->size;
+        f->terminated = r->terminated;
+        return true;
+    }
+    enum fat_err e = fat_load(args, &f->loaded, &f->size);
+    if (!e) {
+        f->data = f->loaded;
+        f->terminated = true;
+        return true;
+    }
+    if (e == FAT_NO_VOLUME || e == FAT_NOT_FOUND || e == FAT_BAD_NAME) {
+        println("File not found");
+    } else {
+        print("disk: ");
+        println(fat_strerror(e));
+    }
+    return false;
+}
+
+static void file_done(struct file *f)
+{
+    kfree(f->loaded);
+}
+
+static void cmd_type(const char *args)
+{
+    struct file f;
+    if (!file_arg(args, "usage: type <file>", &f)) return;
+    /* DOS line ends print as plain newlines */
+    const char *p = f.data, *end = f.data + f.size;
+    while (p < end) {
+        const char *q = p;
+        while (q < end && *q != '\r') q++;
+        terminal_write(p, q - p);
+        p = q + 1;
+    }
+    if (f.size && end[-1] != '\n') terminal_putchar('\n');
+    file_done(&f);
+}
+
+static bool has_ext(const char *name, const char *ext)
+{
+    size_t n = strlen(name), e = strlen(ext);
+    if (n < e) return false;
+    for (size_t i = 0; i < e; ++i) {
+        char c = name[n - e + i];
+        if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+        if (c != ext[i]) return false;
+    }
+    return true;
+}
+
+static void cmd_run(const char *args)
+{
+    struct file f;
+    if (!file_arg(args, "usage: run <file>", &f)) return;
+    bool (*run)(const char *, size_t, bool);
+    if (has_ext(f.name, ".BAS")) run = qbasic_run_text;
+    else if (has_ext(f.name, ".WOG")) run = wog_run_text;
+    else {
+        println("run: only .BAS and .WOG files");
+        file_done(&f);
+        return;
+    }
+
+    /* the interpreters stop at a newline or a NUL, and almost every file
+       has one of them at its end: those run straight from where they are
+       (a FAT file always has its NUL, a tar entry usually does).  Only a
+       terminated file may be read past size. */
+    if (!f.size || f.data[f.size - 1] == '\n' || f.terminated) {
+        run(f.data, f.size, in_background());
+        file_done(&f);
+        return;
+    }
+    char *copy = kmalloc(f.size + 1);
+    if (!copy) {
+        println("run: out of memory");
+        file_done(&f);
+        return;
+    }
+    memcpy(copy, f.data, f.size);
+    copy[f.size] = '\0';
+    run(copy, f.size, in_background());
+    kfree(copy);
+    file_done(&f);
+}
+
+/*  ----------  disks  ----------  */
+static void print_hex8(uint8_t v) {
+    const char *hex = "0123456789ABCDEF";
+    terminal_putchar(hex[v >> 4]);
+    terminal_putchar(hex[v & 15]);
+}
+
+static void disk_dump(const char *args)
+{
+    uint32_t n, lba;
+    while (*args == ' ') args++;
+    if (!(args = parse_u32(args, &n))) goto usage;
+    while (*args == ' ') args++;
+    if (!parse_u32(args, &lba)) goto usage;
+
+    struct buf *b = bcache_read(n, lba);
+    if (!b) {
+        println("disk: no such drive or sector, or a read error");
+        return;
+    }
+    for (int row = 0; row < ATA_SECTOR; row += 32) {
+        print_col(row, 4);
+        print(" ");
+        for (int i = 0; i < 32; ++i)
+            print_hex8(b->data[row + i]);
+        terminal_putchar('\n');
+    }
+    bcache_release(b);
+    return;
+usage:
+    println("usage: disk dump <drive> <lba>");
+}
+
+static void cmd_disk(const char *args)
+{
+    if (!strncmp(args, "dump", 4)) {
+        disk_dump(args + 4);
+        return;
+    }
+    int found = 0;
+    for (int n = 0; n < ATA_MAX_DRIVES; ++n) {
+        const struct ata_drive *d = ata_drive(n);
+        if (!d) continue;
+        found++;
+        print("  ");
+        print_col(n, 1);
+        print("  ");
+        print_left(d->model, 41);
+        print_col(d->sectors >> 11, 6);
+        print(" MB  ");
+        println(d->dma ? "DMA" : "PIO");
+    }
+    if (!found) println("No IDE disks (try qemu -hda disk.img)");
+}
+
+static void cmd_cache(const char *args)
+{
+    (void)args;
+    struct bcache_stats c;
+    struct ata_stats a;
+    bcache_get_stats(&c);
+    ata_get_stats(&a);
+
+    print("Blocks     : ");
+    print_u64(c.blocks);
+    print(" x 512 bytes, ");
+    print_u64(c.dirty);
+    println(" dirty");
+    print("Lookups    : ");
+    print_u64(c.hits + c.misses);
+    print(", ");
+    print_u64(c.hits);
+    print(" hits (");
+    print_u64(percent(c.hits, c.hits + c.misses));
+    print("%), ");
+    print_u64(c.misses);
+    println(" misses");
+    print("Read-ahead : ");
+    print_u64(c.ahead);
+    print(" sectors, ");
+    print_u64(c.ahead_hits);
+    println(" used");
+    print("Write-back : ");
+    print_u64(c.writebacks);
+    print(" sectors, ");
+    print_u64(c.evictions);
+    println(" evictions");
+    print("Disk       : ");
+    print_u64(a.dma_cmds);
+    print(" DMA + ");
+    print_u64(a.pio_cmds);
+    print(" PIO commands, ");
+    print_u64(a.sectors_read);
+    print(" sectors in, ");
+    print_u64(a.sectors_written);
+    print(" out, ");
+    print_u64(a.errors);
+    println(" errors");
+}
+
+static void cmd_sync(const char *args)
+{
+    (void)args;
+    if (!bcache_sync()) println("sync: some blocks could not be written");
+}
+
+/*  ----------  serial console  ----------  */
+static void cmd_serial(const char *args)
+{
+    (void)args;
+    if (!serial_present()) {
+        println("No 16550 on COM1");
+        return;
+    }
+    struct serial_stats s;
+    serial_get_stats(&s);
+    println("COM1       : 115200 8N1, 16-byte FIFOs");
+    print("Sent       : ");
+    print_u64(s.tx_bytes);
+    print(" bytes, ");
+    print_u64(s.tx_irqs);
+    print(" FIFO refills from IRQ4, ");
+    print_u64(s.tx_waits);
+    println(" waits for a full buffer");
+    print("Received   : ");
+    print_u64(s.rx_bytes);
+    println(" bytes");
+}
+
+/*  ----------  microbenchmarks  ----------  */
+static void print_cycles(uint64_t c, int width) {
+    print_col(c >> 32 ? 0xFFFFFFFFu : (uint32_t)c, width);
+}
+
+/* bench [list] [NAME] [N] [serial]: NAME is a prefix, "memcpy" runs
+   all the memcpy sizes */
+static void cmd_bench(const char *args)
+{
+    char name[24] = "";
+    uint32_t iters = 0;
+    bool to_serial = false;
+    while (*args) {
+        const char *end = args;
+        while (*end && *end != ' ') end++;
+        size_t n = end - args;
+        uint32_t v;
+        if (parse_u32(args, &v) == end) {
+            iters = v;
+        } else if (n == 6 && !strncmp(args, "serial", 6)) {
+            to_serial = true;
+        } else if (n == 4 && !strncmp(args, "list", 4)) {
+            for (int i = 0; i < bench_count(); ++i)
+                println(bench_name(i));
+            return;
+        } else if (n < sizeof(name) && !name[0]) {
+            memcpy(name, args, n);
+            name[n] = '\0';
+        } else {
+            println("usage: bench [list] [NAME] [N] [serial]");
+            return;
+        }
+        for (args = end; *args == ' '; ++args)
+            ;
+    }
+    if (to_serial && !serial_present()) {
+        println("bench: no serial port, table only");
+        to_serial = false;
+    }
+
+    /* run them all first: putchar and scroll make a mess of the screen */
+    struct bench_result *res = kmalloc(bench_count() * sizeof(*res));
+    if (!res) {
+        println("bench: out of memory");
+        return;
+    }
+    uint64_t overhead = bench_overhead();
+    int n = 0;
+    for (int i = 0; i < bench_count(); ++i) {
+        if (strncmp(bench_name(i), name, strlen(name))) continue;
+        enum bench_status st = bench_run(i, iters, overhead, &res[n]);
+        if (st != BENCH_OK) {
+            print(st == BENCH_NO_MEMORY ? "bench: no memory for " : "bench: skipped ");
+            println(bench_name(i));
+            continue;
+        }
+        if (to_serial) bench_report_serial(&res[n]);
+        n++;
+    }
+    if (!n && name[0]) {
+        print("bench: nothing called ");
+        println(name);
+    }
+
+    if (n) {
+        print(cpu_features.tsc ? "Cycles per run, " : "PIT clocks per run (no TSC), ");
+        print_u64(overhead);
+        println(" of timer overhead taken off");
+        println("  BENCHMARK         RUNS       MIN    MEDIAN       MAX   MEDIAN NS");
+    }
+    for (int i = 0; i < n; ++i) {
+        print("  ");
+        print_left(res[i].name, 15);
+        print_col(res[i].iters, 7);
+        print_cycles(res[i].min, 10);
+        print_cycles(res[i].median, 10);
+        print_cycles(res[i].max, 10);
+        print_cycles(cycles_to_ns(res[i].median), 12);
+        terminal_putchar('\n');
+    }
+    kfree(res);
+}
 
 /*  ----------  dispatcher  ----------  */
 
 
-static void qbasic_cmd(void) { qbasic_run(NULL); }
+static void qbasic_cmd(const char *args)
+{
+    if (!strcmp(args, "run")) qbasic_run_saved(in_background());
+    else if (foreground("qbasic")) qbasic_run(NULL);
+}
+static void calc_cmd(const char *args)
+{
+    (void)args;
+    if (foreground("calc")) calculator_run();
+}
+static void wog_cmd(const char *args)
+{
+    if (!strcmp(args, "run")) wog_run_saved(in_background());
+    else if (foreground("wog")) wog_run();
+}
 
-typedef struct { const char *name; void (*fn)(void); } cmd_t;
+/* fn gets the text after the command word, leading spaces skipped */
+typedef struct { const char *name; void (*fn)(const char *args); } cmd_t;
 static const cmd_t cmds[] = {
     {"help",      cmd_help},
-    {"calc",      calculator_run},
-    {"calculator",calculator_run},
+    {"calc",      calc_cmd},
+    {"calculator",calc_cmd},
     {"qbasic",    qbasic_cmd},
-    {"wog",       wog_run},
+    {"wog",       wog_cmd},
     {"cfetch",    cmd_cfetch},
     {"info",      cmd_info},
     {"reboot",    cmd_reboot},
@@ -126,17 +985,83 @@ static const cmd_t cmds[] = {
     {"clear",     cmd_clear},
     {"cls",       cmd_clear},
     {"echo",      cmd_echo},
+    {"uptime",    cmd_uptime},
+    {"time",      cmd_time},
+    {"sleep",     cmd_sleep},
+    {"prof",      cmd_prof},
+    {"mem",       cmd_mem},
+    {"sysbench",  cmd_sysbench},
+    {"ps",        cmd_ps},
+    {"top",       cmd_top},
+    {"kill",      cmd_kill},
+    {"nice",      cmd_nice},
+    {"smp",       cmd_smp},
+    {"dir",       cmd_dir},
+    {"type",      cmd_type},
+    {"run",       cmd_run},
+    {"disk",      cmd_disk},
+    {"cache",     cmd_cache},
+    {"sync",      cmd_sync},
+    {"serial",    cmd_serial},
+    {"bench",     cmd_bench},
     {NULL, NULL}
 };
 
-static void run_cmd(void)
+static void run_cmd(const char *line)
 {
-    for (const cmd_t *c = cmds; c->name; ++c)
-        if (!strcmp(input, c->name)) { c->fn(); return; }
+    /* first word selects the command, the rest are its arguments */
+    char name[16];
+    size_t n = 0;
+    while (line[n] && line[n] != ' ' && n < sizeof(name) - 1) {
+        name[n] = line[n];
+        n++;
+    }
+    name[n] = '\0';
+    const char *args = line + n;
+    while (*args == ' ') args++;
+
+    if (line[n] == '\0' || line[n] == ' ') {
+        for (const cmd_t *c = cmds; c->name; ++c)
+            if (!strcmp(name, c->name)) { c->fn(args); return; }
+    }
 
     /* not found */
     print("Unknown: ");
-    println(input);
+    println(line);
+}
+
+/*  ----------  background jobs  ----------  */
+static int job_main(void *line)
+{
+    run_cmd(line);
+    terminal_setcolor(VGA_COLOR_DARK_GREY);
+    print("[");
+    print_u64(thread_current()->id);
+    print("] done: ");
+    println(line);
+    terminal_setcolor(VGA_COLOR_LIGHT_GREY);
+    kfree(line);
+    return 0;
+}
+
+/* the job owns a copy of its command line and frees it when done */
+static void start_job(const char *line)
+{
+    /* the thread is ready as soon as it exists, and after "nice 0 low"
+       it runs before the shell does: the copy has to be there first */
+    size_t n = strlen(line);
+    char *copy = kmalloc(n + 1);
+    if (copy) memcpy(copy, line, n + 1);
+    struct thread *t = copy ? kthread_create(job_main, copy, line) : NULL;
+    if (!t) {
+        kfree(copy);
+        println("No free thread for a background job");
+        return;
+    }
+    kthread_detach(t);
+    print("[");
+    print_u64(t->id);
+    println("] started");
 }
 
 /*  ----------  main TTY loop  ----------  */
@@ -184,7 +1109,15 @@ void tty_main(void)
             continue;
         }
         rtrim(input);
+        /* "cmd &" runs in its own thread, the prompt comes straight back */
+        size_t len = strlen(input);
+        if (len && input[len - 1] == '&') {
+            input[len - 1] = '\0';
+            rtrim(input);
+            if (input[0]) start_job(input);
+            continue;
+        }
         /* Execute command */
-        run_cmd();
+        run_cmd(input);
     }
 }
\ No newline at end of file
@@ -0,0 +1,230 @@
+/* bcache.c  –  hash lookup, LRU eviction, read-ahead and write-back
+ *
+ * Every sector buffer is on the LRU list, most recently used first, and
+ * valid ones are also in a hash bucket.  A miss takes buffers from the
+ * cold end; when the miss continues the last access (lba - 1), up to
+ * BCACHE_READAHEAD sectors come in with one ATA command, DMA scattering
+ * them straight into their buffers.  Writes only mark a buffer dirty.
+ */
+#include "bcache.h"
+#include "../core/pmm.h"
+#include "../core/thread.h"
+#include <stddef.h>
+
+static struct buf bufs[BCACHE_BLOCKS];
+static struct buf *lru_head, *lru_tail;
+static struct buf *buckets[BCACHE_BUCKETS];
+static uint32_t last_lba[ATA_MAX_DRIVES];   /* sequential-access detection */
+static struct bcache_stats stats;
+static struct mutex lock;           /* held across disk I/O */
+static bool ready;
+
+/* ---------- lists ---------- */
+static struct buf **bucket(int dev, uint32_t lba)
+{
+    return &buckets[(lba + (uint32_t)dev * 7919u) % BCACHE_BUCKETS];
+}
+
+static struct buf *lookup(int dev, uint32_t lba)
+{
+    for (struct buf *b = *bucket(dev, lba); b; b = b->hnext)
+        if (b->dev == dev && b->lba == lba) return b;
+    return NULL;
+}
+
+static void unhash(struct buf *b)
+{
+    struct buf **pp = bucket(b->dev, b->lba);
+    while (*pp && *pp != b) pp = &(*pp)->hnext;
+    if (*pp) *pp = b->hnext;
+    b->valid = false;
+}
+
+static void rehash(struct buf *b, int dev, uint32_t lba)
+{
+    b->dev = dev;
+    b->lba = lba;
+    struct buf **pp = bucket(dev, lba);
+    b->hnext = *pp;
+    *pp = b;
+}
+
+static void lru_remove(struct buf *b)
+{
+    if (b->prev) b->prev->next = b->next;
+    else lru_head = b->next;
+    if (b->next) b->next->prev = b->prev;
+    else lru_tail = b->prev;
+}
+
+static void lru_front(struct buf *b)
+{
+    lru_remove(b);
+    b->prev = NULL;
+    b->next = lru_head;
+    if (lru_head) lru_head->prev = b;
+    else lru_tail = b;
+    lru_head = b;
+}
+
+/* ---------- write-back and eviction ---------- */
+static bool write_back(struct buf *b)
+{
+    if (!ata_write(b->dev, b->lba, 1, &b->data)) return false;
+    b->dirty = false;
+    stats.writebacks++;
+    return true;
+}
+
+/* the least recently used buffer nobody holds, emptied; NULL if none */
+static struct buf *evict(void)
+{
+    for (struct buf *b = lru_tail; b; b = b->prev) {
+        if (b->refs) continue;
+        if (b->dirty && !write_back(b)) continue;   /* keep what we can't save */
+        if (b->valid) {
+            unhash(b);
+            stats.evictions++;
+        }
+        b->ahead = false;
+        return b;
+    }
+    return NULL;
+}
+
+/* ---------- public API ---------- */
+struct buf *bcache_read(int dev, uint32_t lba)
+{
+    const struct ata_drive *d = ata_drive(dev);
+    if (!ready || !d || lba >= d->sectors) return NULL;
+
+    mutex_lock(&lock);
+    bool sequential = lba == last_lba[dev] + 1;
+    last_lba[dev] = lba;
+
+    struct buf *b = lookup(dev, lba);
+    if (b) {
+        stats.hits++;
+        if (b->ahead) {
+            stats.ahead_hits++;
+            b->ahead = false;
+        }
+        b->refs++;
+        lru_front(b);
+        mutex_unlock(&lock);
+        return b;
+    }
+    stats.misses++;
+
+    /* lba itself, then the sectors after it that are not cached yet */
+    uint32_t want = sequential ? BCACHE_READAHEAD : 1;
+    if (want > d->sectors - lba) want = d->sectors - lba;
+    struct buf *got[BCACHE_READAHEAD];
+    uint8_t *data[BCACHE_READAHEAD];
+    uint32_t n = 0;
+    while (n < want && (n == 0 || !lookup(dev, lba + n))) {
+        struct buf *v = evict();
+        if (!v) break;
+        v->refs++;                  /* so the next evict() skips it */
+        rehash(v, dev, lba + n);
+        got[n] = v;
+        data[n++] = v->data;
+    }
+    if (!n) {
+        mutex_unlock(&lock);
+        return NULL;
+    }
+
+    bool ok = ata_read(dev, lba, n, data);
+    for (uint32_t i = n; i-- > 0; ) {   /* backwards: lba ends up first */
+        struct buf *v = got[i];
+        if (ok) v->valid = true;
+        else unhash(v);
+        if (i) {
+            v->refs--;
+            v->ahead = ok;
+        }
+        lru_front(v);
+    }
+    if (ok) stats.ahead += n - 1;
+    else got[0]->refs--;
+    mutex_unlock(&lock);
+    return ok ? got[0] : NULL;
+}
+
+struct buf *bcache_claim(int dev, uint32_t lba)
+{
+    const struct ata_drive *d = ata_drive(dev);
+    if (!ready || !d || lba >= d->sectors) return NULL;
+
+    mutex_lock(&lock);
+    struct buf *b = lookup(dev, lba);
+    if (b) {
+        stats.hits++;
+        b->ahead = false;
+    } else if ((b = evict())) {
+        rehash(b, dev, lba);
+        b->valid = true;            /* whatever is in it: the caller overwrites */
+    }
+    if (b) {
+        b->refs++;
+        lru_front(b);
+    }
+    mutex_unlock(&lock);
+    return b;
+}
+
+void bcache_dirty(struct buf *b)
+{
+    b->dirty = true;
+}
+
+void bcache_release(struct buf *b)
+{
+    mutex_lock(&lock);
+    b->refs--;
+    mutex_unlock(&lock);
+}
+
+bool bcache_sync(void)
+{
+    if (!ready) return true;
+    bool ok = true;
+    mutex_lock(&lock);
+    for (int i = 0; i < BCACHE_BLOCKS; ++i)
+        if (bufs[i].valid && bufs[i].dirty && !write_back(&bufs[i]))
+            ok = false;
+    mutex_unlock(&lock);
+    return ok;
+}
+
+void bcache_get_stats(struct bcache_stats *st)
+{
+    mutex_lock(&lock);
+    *st = stats;
+    st->dirty = 0;
+    for (int i = 0; i < BCACHE_BLOCKS; ++i)
+        st->dirty += bufs[i].valid && bufs[i].dirty;
+    st->blocks = ready ? BCACHE_BLOCKS : 0;
+    mutex_unlock(&lock);
+}
+
+bool bcache_init(void)
+{
+    const uint32_t per_page = PAGE_SIZE / ATA_SECTOR;
+    uint32_t base = pmm_alloc_pages(BCACHE_BLOCKS / per_page);
+    if (!base) return false;
+
+    for (int i = 0; i < BCACHE_BLOCKS; ++i) {
+        struct buf *b = &bufs[i];
+        b->data = (uint8_t *)(base + (uint32_t)i * ATA_SECTOR);
+        b->prev = i ? &bufs[i - 1] : NULL;
+        b->next = i + 1 < BCACHE_BLOCKS ? &bufs[i + 1] : NULL;
+    }
+    lru_head = &bufs[0];
+    lru_tail = &bufs[BCACHE_BLOCKS - 1];
+    for (int i = 0; i < ATA_MAX_DRIVES; ++i)
+        last_lba[i] = (uint32_t)-2;     /* so lba 0 is not "sequential" */
+    ready = true;
+    return true;
+}
@@ -0,0 +1,50 @@
+/* bcache.h  –  write-back LRU cache of disk sectors, with read-ahead */
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../io/ata.h"
+
+#define BCACHE_BLOCKS     256       /* 128 KB of 512-byte sectors */
+#define BCACHE_BUCKETS    64
+#define BCACHE_READAHEAD  8         /* sectors fetched by a sequential miss */
+
+struct buf {
+    uint8_t *data;                  /* ATA_SECTOR bytes */
+    int dev;
+    uint32_t lba;
+    bool valid;
+    bool dirty;                     /* newer than the disk */
+    bool ahead;                     /* read ahead, not asked for yet */
+    uint32_t refs;                  /* held buffers are never evicted */
+    struct buf *prev, *next;        /* LRU list, most recent first */
+    struct buf *hnext;              /* hash chain */
+};
+
+struct bcache_stats {
+    uint32_t hits, misses;
+    uint32_t ahead, ahead_hits;     /* sectors read ahead / later asked for */
+    uint32_t writebacks;            /* dirty sectors written out */
+    uint32_t evictions;
+    uint32_t dirty, blocks;         /* now */
+};
+
+/* after ata_init; false if the memory is not there */
+bool bcache_init(void);
+
+/* the sector, held until bcache_release(); NULL on a disk error.
+   Threads only: a miss sleeps on the disk. */
+struct buf *bcache_read(int dev, uint32_t lba);
+/* the sector held like bcache_read() but never read from the disk, for a
+   caller about to overwrite all of it; NULL if every buffer is held */
+struct buf *bcache_claim(int dev, uint32_t lba);
+/* the caller changed b->data: written back on eviction or sync */
+void bcache_dirty(struct buf *b);
+void bcache_release(struct buf *b);
+
+/* write every dirty sector; false if any write failed */
+bool bcache_sync(void);
+void bcache_get_stats(struct bcache_stats *st);
+
+#endif /* BCACHE_H */
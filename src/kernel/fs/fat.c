@@ -0,0 +1,519 @@
+/* fat.c  –  FAT12/16: in-memory FAT, chains resolved at open, 8.3 names
+ *
+ * The whole first FAT is read at mount and every lookup and allocation
+ * works on that copy.  Changed FAT sectors are marked and go out to
+ * every FAT on the disk at the end of fat_save().  File data and the
+ * root directory go through the block cache like everything else.
+ */
+#include "fat.h"
+#include "bcache.h"
+#include "../core/heap.h"
+#include "../core/thread.h"
+#include "../lib/string.h"
+
+#define SECTOR        ATA_SECTOR
+#define DIRENTS       (SECTOR / sizeof(struct dirent))
+
+#define ATTR_VOLUME   0x08
+#define ATTR_DIR      0x10
+#define ATTR_LFN      0x0F          /* a long-name piece, not a file */
+#define ATTR_ARCHIVE  0x20
+#define DELETED       0xE5
+#define FAT_DATE      0x0021        /* 1980-01-01: there is no clock to ask */
+
+struct dirent {
+    char     name[11];              /* "HELLO   BAS" */
+    uint8_t  attr;
+    uint8_t  nt, ctime_ms;
+    uint16_t ctime, cdate, adate;
+    uint16_t cluster_hi;            /* FAT32 only */
+    uint16_t mtime, mdate;
+    uint16_t cluster;
+    uint32_t size;
+} __attribute__((packed));
+
+static struct {
+    bool mounted;
+    int dev;
+    int bits;
+    uint32_t spc;                   /* sectors per cluster */
+    uint32_t nfats, fat_start, fat_sectors;
+    uint32_t root_start, root_sectors;
+    uint32_t data_start;
+    uint32_t nclusters;             /* data clusters are 2 .. nclusters + 1 */
+    uint8_t *fat;                   /* the first FAT, whole */
+    uint8_t *dirty;                 /* per FAT sector: changed since the flush */
+    uint32_t next_free;             /* where the next allocation starts looking */
+} vol;
+static struct mutex lock;
+
+static const char *const err_msg[] = {
+    [FAT_OK]        = "OK",
+    [FAT_NO_VOLUME] = "no FAT disk",
+    [FAT_BAD_NAME]  = "not an 8.3 file name",
+    [FAT_NOT_FOUND] = "file not found",
+    [FAT_IS_DIR]    = "that is a directory",
+    [FAT_DISK_FULL] = "disk full",
+    [FAT_DIR_FULL]  = "root directory full",
+    [FAT_NO_MEMORY] = "out of memory",
+    [FAT_IO]        = "disk error",
+};
+
+static uint16_t rd16(const uint8_t *p) { return p[0] | p[1] << 8; }
+static uint32_t rd32(const uint8_t *p) { return rd16(p) | (uint32_t)rd16(p + 2) << 16; }
+
+/* ---------- the cached FAT ---------- */
+static uint32_t fat_get(uint32_t c)
+{
+    if (vol.bits == 16) return rd16(vol.fat + c * 2);
+    uint16_t v = rd16(vol.fat + c + c / 2);
+    return c & 1 ? v >> 4 : v & 0xFFF;
+}
+
+static void fat_set(uint32_t c, uint32_t v)
+{
+    uint32_t off;
+    if (vol.bits == 16) {
+        off = c * 2;
+        vol.fat[off] = v;
+        vol.fat[off + 1] = v >> 8;
+    } else {
+        off = c + c / 2;            /* 12 bits share a byte with a neighbour */
+        if (c & 1) {
+            vol.fat[off] = (vol.fat[off] & 0x0F) | (v << 4);
+            vol.fat[off + 1] = v >> 4;
+        } else {
+            vol.fat[off] = v;
+            vol.fat[off + 1] = (vol.fat[off + 1] & 0xF0) | ((v >> 8) & 0x0F);
+        }
+    }
+    vol.dirty[off / SECTOR] = vol.dirty[(off + 1) / SECTOR] = 1;
+}
+
+static bool is_cluster(uint32_t c) { return c >= 2 && c < vol.nclusters + 2; }
+static uint32_t end_mark(void) { return vol.bits == 16 ? 0xFFFF : 0xFFF; }
+
+static uint32_t cluster_lba(uint32_t c)
+{
+    return vol.data_start + (c - 2) * vol.spc;
+}
+
+static void free_chain(uint32_t c)
+{
+    for (uint32_t n = 0; is_cluster(c) && n < vol.nclusters; ++n) {
+        uint32_t next = fat_get(c);
+        fat_set(c, 0);
+        c = next;
+    }
+}
+
+/* need clusters, linked, first fit from next_free */
+static enum fat_err alloc_chain(uint32_t need, uint32_t *first)
+{
+    uint32_t prev = 0, got = 0;
+    *first = 0;
+    for (uint32_t i = 0; i < vol.nclusters && got < need; ++i) {
+        uint32_t c = 2 + (vol.next_free - 2 + i) % vol.nclusters;
+        if (fat_get(c)) continue;
+        fat_set(c, end_mark());
+        if (prev) fat_set(prev, c);
+        else *first = c;
+        prev = c;
+        got++;
+    }
+    if (got < need) {
+        free_chain(*first);
+        return FAT_DISK_FULL;
+    }
+    if (prev) vol.next_free = is_cluster(prev + 1) ? prev + 1 : 2;
+    return FAT_OK;
+}
+
+/* changed FAT sectors, to every copy on the disk */
+static bool flush_fat(void)
+{
+    for (uint32_t s = 0; s < vol.fat_sectors; ++s) {
+        if (!vol.dirty[s]) continue;
+        for (uint32_t copy = 0; copy < vol.nfats; ++copy) {
+            struct buf *b = bcache_claim(vol.dev, vol.fat_start + copy * vol.fat_sectors + s);
+            if (!b) return false;
+            memcpy(b->data, vol.fat + s * SECTOR, SECTOR);
+            bcache_dirty(b);
+            bcache_release(b);
+        }
+        vol.dirty[s] = 0;
+    }
+    return true;
+}
+
+/* ---------- names ---------- */
+static char upper(char c)
+{
+    return c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c;
+}
+
+/* characters DOS will not take in a short name */
+static bool bad_char(char c)
+{
+    const char *bad = "\"*+,/:;<=>?[\\]|";
+    for (; *bad; ++bad)
+        if (c == *bad) return true;
+    return c <= ' ' || c == 0x7F;
+}
+
+/* "hello.bas" -> "HELLO   BAS"; false if it can't be a short name */
+static bool to_83(const char *s, char out[11])
+{
+    memset(out, ' ', 11);
+    int i = 0, limit = 8;
+    if (!*s || *s == '.') return false;
+    for (; *s; ++s) {
+        char c = upper(*s);
+        if (c == '.') {
+            if (limit == 3) return false;   /* a second dot */
+            i = 8;
+            limit = 3;
+            continue;
+        }
+        if (bad_char(c)) return false;
+        if ((limit == 8 && i == 8) || i == 11) return false;
+        out[i++] = c;
+    }
+    return true;
+}
+
+/* "HELLO   BAS" -> "HELLO.BAS" */
+static void from_83(const char in[11], char out[FAT_NAME_LEN])
+{
+    int n = 0;
+    for (int i = 0; i < 8 && in[i] != ' '; ++i) out[n++] = in[i];
+    if (in[8] != ' ') {
+        out[n++] = '.';
+        for (int i = 8; i < 11 && in[i] != ' '; ++i) out[n++] = in[i];
+    }
+    out[n] = '\0';
+}
+
+/* ---------- root directory ---------- */
+static bool is_file_entry(const struct dirent *d)
+{
+    return d->name[0] != (char)DELETED && d->name[0] != '.' &&
+           d->attr != ATTR_LFN && !(d->attr & ATTR_VOLUME);
+}
+
+/* the entry called name, or the first free one for NULL: a copy in
+   *out and where it lives */
+static enum fat_err dir_find(const char *name, struct dirent *out,
+                             uint32_t *lba, uint32_t *idx)
+{
+    for (uint32_t s = 0; s < vol.root_sectors; ++s) {
+        struct buf *b = bcache_read(vol.dev, vol.root_start + s);
+        if (!b) return FAT_IO;
+        const struct dirent *d = (const struct dirent *)b->data;
+        for (uint32_t i = 0; i < DIRENTS; ++i, ++d) {
+            bool end = !d->name[0];
+            bool hit = name ? !end && is_file_entry(d) && !strncmp(d->name, name, 11)
+                            : end || d->name[0] == (char)DELETED;
+            if (!hit && !end) continue;
+            if (hit) {
+                *out = *d;
+                *lba = vol.root_start + s;
+                *idx = i;
+            }
+            bcache_release(b);
+            return hit ? FAT_OK : FAT_NOT_FOUND;
+        }
+        bcache_release(b);
+    }
+    return name ? FAT_NOT_FOUND : FAT_DIR_FULL;
+}
+
+static enum fat_err dir_write(const struct dirent *d, uint32_t lba, uint32_t idx)
+{
+    struct buf *b = bcache_read(vol.dev, lba);
+    if (!b) return FAT_IO;
+    memcpy(b->data + idx * sizeof(*d), d, sizeof(*d));
+    bcache_dirty(b);
+    bcache_release(b);
+    return FAT_OK;
+}
+
+int fat_list(struct fat_dirent *out, int max)
+{
+    if (!vol.mounted) return 0;
+    int n = 0;
+    mutex_lock(&lock);
+    for (uint32_t s = 0; s < vol.root_sectors && n < max; ++s) {
+        struct buf *b = bcache_read(vol.dev, vol.root_start + s);
+        if (!b) break;
+        const struct dirent *d = (const struct dirent *)b->data;
+        bool end = false;
+        for (uint32_t i = 0; i < DIRENTS && n < max; ++i, ++d) {
+            if (!d->name[0]) {
+                end = true;
+                break;
+            }
+            if (!is_file_entry(d)) continue;
+            from_83(d->name, out[n].name);
+            out[n].size = d->size;
+            out[n].dir = d->attr & ATTR_DIR;
+            n++;
+        }
+        bcache_release(b);
+        if (end) break;
+    }
+    mutex_unlock(&lock);
+    return n;
+}
+
+/* ---------- files ---------- */
+enum fat_err fat_open(const char *name, struct fat_file *f)
+{
+    char n83[11];
+    struct dirent d;
+    uint32_t lba, idx;
+    if (!vol.mounted) return FAT_NO_VOLUME;
+    if (!to_83(name, n83)) return FAT_BAD_NAME;
+
+    mutex_lock(&lock);
+    enum fat_err e = dir_find(n83, &d, &lba, &idx);
+    if (!e && (d.attr & ATTR_DIR)) e = FAT_IS_DIR;
+    if (e) {
+        mutex_unlock(&lock);
+        return e;
+    }
+
+    /* walk the chain once; the count bounds a looping FAT */
+    uint32_t n = 0;
+    for (uint32_t c = d.cluster; is_cluster(c) && n < vol.nclusters; c = fat_get(c))
+        n++;
+    f->chain = kmalloc((n ? n : 1) * sizeof(*f->chain));
+    if (!f->chain) {
+        mutex_unlock(&lock);
+        return FAT_NO_MEMORY;
+    }
+    uint32_t c = d.cluster;
+    for (uint32_t i = 0; i < n; ++i, c = fat_get(c))
+        f->chain[i] = c;
+    f->nclusters = n;
+    f->size = d.size;
+    mutex_unlock(&lock);
+    return FAT_OK;
+}
+
+int32_t fat_read(struct fat_file *f, uint32_t off, void *buf, uint32_t n)
+{
+    uint32_t bytes = vol.spc * SECTOR, done = 0;
+    if (off >= f->size) return 0;
+    if (n > f->size - off) n = f->size - off;
+
+    while (done < n) {
+        uint32_t pos = off + done;
+        uint32_t ci = pos / bytes;
+        if (ci >= f->nclusters) break;          /* chain shorter than the size */
+        uint32_t lba = cluster_lba(f->chain[ci]) + pos % bytes / SECTOR;
+        uint32_t in = pos % SECTOR, k = SECTOR - in;
+        if (k > n - done) k = n - done;
+
+        struct buf *b = bcache_read(vol.dev, lba);
+        if (!b) return -1;
+        memcpy((char *)buf + done, b->data + in, k);
+        bcache_release(b);
+        done += k;
+    }
+    return done;
+}
+
+void fat_close(struct fat_file *f)
+{
+    kfree(f->chain);
+    f->chain = NULL;
+}
+
+enum fat_err fat_load(const char *name, char **data, size_t *len)
+{
+    struct fat_file f;
+    enum fat_err e = fat_open(name, &f);
+    if (e) return e;
+    char *p = kmalloc(f.size + 1);
+    if (!p) {
+        fat_close(&f);
+        return FAT_NO_MEMORY;
+    }
+    int32_t got = fat_read(&f, 0, p, f.size);
+    fat_close(&f);
+    if (got < 0) {
+        kfree(p);
+        return FAT_IO;
+    }
+    p[got] = '\0';
+    *data = p;
+    *len = got;
+    return FAT_OK;
+}
+
+/* data into a fresh chain; sectors are overwritten whole, never read */
+static enum fat_err write_data(uint32_t c, const char *data, size_t len)
+{
+    size_t off = 0;
+    for (; off < len && is_cluster(c); c = fat_get(c)) {
+        for (uint32_t s = 0; s < vol.spc && off < len; ++s) {
+            struct buf *b = bcache_claim(vol.dev, cluster_lba(c) + s);
+            if (!b) return FAT_IO;
+            size_t k = len - off < SECTOR ? len - off : SECTOR;
+            memcpy(b->data, data + off, k);
+            memset(b->data + k, 0, SECTOR - k);
+            bcache_dirty(b);
+            bcache_release(b);
+            off += k;
+        }
+    }
+    return off == len ? FAT_OK : FAT_IO;
+}
+
+/* the new chain is written before the old one is freed, so a full disk
+   leaves the old file as it was */
+static enum fat_err save_locked(const char *n83, const char *data, size_t len)
+{
+    struct dirent d;
+    uint32_t lba, idx, old = 0;
+    enum fat_err e = dir_find(n83, &d, &lba, &idx);
+    if (!e) {
+        if (d.attr & ATTR_DIR) return FAT_IS_DIR;
+        old = d.cluster;
+    } else if (e == FAT_NOT_FOUND) {
+        if ((e = dir_find(NULL, &d, &lba, &idx))) return e;
+        memset(&d, 0, sizeof(d));
+        memcpy(d.name, n83, 11);
+        d.attr = ATTR_ARCHIVE;
+        d.cdate = FAT_DATE;
+    } else {
+        return e;
+    }
+
+    uint32_t bytes = vol.spc * SECTOR, first;
+    if ((e = alloc_chain((len + bytes - 1) / bytes, &first))) return e;
+    if ((e = write_data(first, data, len))) {
+        free_chain(first);
+        return e;
+    }
+    free_chain(old);
+    d.cluster = first;
+    d.size = len;
+    d.mdate = d.adate = FAT_DATE;
+    return dir_write(&d, lba, idx);
+}
+
+enum fat_err fat_save(const char *name, const char *data, size_t len)
+{
+    char n83[11];
+    if (!vol.mounted) return FAT_NO_VOLUME;
+    if (!to_83(name, n83)) return FAT_BAD_NAME;
+
+    mutex_lock(&lock);
+    enum fat_err e = save_locked(n83, data, len);
+    if (!flush_fat() && !e) e = FAT_IO;
+    if (!bcache_sync() && !e) e = FAT_IO;
+    mutex_unlock(&lock);
+    return e;
+}
+
+const char *fat_strerror(enum fat_err e)
+{
+    return err_msg[e];
+}
+
+/* ---------- volume ---------- */
+static bool bpb_ok(const uint8_t *s)
+{
+    uint8_t spc = s[13];
+    return s[510] == 0x55 && s[511] == 0xAA &&
+           rd16(s + 11) == SECTOR &&            /* bytes per sector */
+           spc && !(spc & (spc - 1)) &&
+           rd16(s + 14) &&                      /* reserved sectors */
+           (s[16] == 1 || s[16] == 2) &&        /* FAT copies */
+           rd16(s + 17) &&                      /* root entries: 0 on FAT32 */
+           rd16(s + 22);                        /* sectors per FAT */
+}
+
+/* the first FAT partition of an MBR, 0 if none */
+static uint32_t find_partition(const uint8_t *mbr)
+{
+    if (mbr[510] != 0x55 || mbr[511] != 0xAA) return 0;
+    for (int i = 0; i < 4; ++i) {
+        const uint8_t *e = mbr + 446 + 16 * i;
+        if (e[4] == 0x01 || e[4] == 0x04 || e[4] == 0x06 || e[4] == 0x0E)
+            return rd32(e + 8);
+    }
+    return 0;
+}
+
+bool fat_mount(int dev)
+{
+    uint32_t part = 0;
+    struct buf *b = bcache_read(dev, 0);
+    if (!b) return false;
+    if (!bpb_ok(b->data)) {
+        part = find_partition(b->data);
+        bcache_release(b);
+        if (!part || !(b = bcache_read(dev, part))) return false;
+        if (!bpb_ok(b->data)) {
+            bcache_release(b);
+            return false;
+        }
+    }
+
+    const uint8_t *s = b->data;
+    uint32_t total = rd16(s + 19) ? rd16(s + 19) : rd32(s + 32);
+    vol.spc = s[13];
+    vol.nfats = s[16];
+    vol.fat_sectors = rd16(s + 22);
+    vol.fat_start = part + rd16(s + 14);
+    vol.root_start = vol.fat_start + vol.nfats * vol.fat_sectors;
+    vol.root_sectors = (rd16(s + 17) * sizeof(struct dirent) + SECTOR - 1) / SECTOR;
+    vol.data_start = vol.root_start + vol.root_sectors;
+    bcache_release(b);
+
+    if (part + total <= vol.data_start) return false;
+    vol.nclusters = (part + total - vol.data_start) / vol.spc;
+    if (vol.nclusters < 4085) vol.bits = 12;
+    else if (vol.nclusters < 65525) vol.bits = 16;
+    else return false;                          /* FAT32 */
+    /* the FAT may be shorter than the cluster count says */
+    uint32_t fits = vol.fat_sectors * SECTOR * 8 / vol.bits;
+    if (vol.nclusters + 2 > fits) vol.nclusters = fits - 2;
+
+    vol.fat = kmalloc(vol.fat_sectors * SECTOR);
+    vol.dirty = kzalloc(vol.fat_sectors);
+    if (!vol.fat || !vol.dirty) goto fail;
+    vol.dev = dev;
+    for (uint32_t i = 0; i < vol.fat_sectors; ++i) {
+        if (!(b = bcache_read(dev, vol.fat_start + i))) goto fail;
+        memcpy(vol.fat + i * SECTOR, b->data, SECTOR);
+        bcache_release(b);
+    }
+    vol.next_free = 2;
+    vol.mounted = true;
+    return true;
+
+fail:
+    kfree(vol.fat);
+    kfree(vol.dirty);
+    vol.fat = vol.dirty = NULL;
+    return false;
+}
+
+bool fat_mounted(void) { return vol.mounted; }
+int fat_dev(void) { return vol.dev; }
+int fat_bits(void) { return vol.bits; }
+
+uint32_t fat_free_bytes(void)
+{
+    if (!vol.mounted) return 0;
+    uint32_t n = 0;
+    mutex_lock(&lock);
+    for (uint32_t c = 2; c < vol.nclusters + 2; ++c)
+        n += !fat_get(c);
+    mutex_unlock(&lock);
+    return n * vol.spc * SECTOR;
+}
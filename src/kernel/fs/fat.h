@@ -0,0 +1,60 @@
+/* fat.h  –  FAT12/16 root directory on an IDE disk, through bcache */
+#ifndef FAT_H
+#define FAT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define FAT_NAME_LEN 13             /* "NAME.EXT" and a NUL */
+
+enum fat_err {
+    FAT_OK,
+    FAT_NO_VOLUME,
+    FAT_BAD_NAME,
+    FAT_NOT_FOUND,
+    FAT_IS_DIR,
+    FAT_DISK_FULL,
+    FAT_DIR_FULL,
+    FAT_NO_MEMORY,
+    FAT_IO,
+};
+
+struct fat_dirent {
+    char name[FAT_NAME_LEN];
+    uint32_t size;
+    bool dir;
+};
+
+/* an open file: its cluster chain is read from the cached FAT once, so
+   reading never walks the FAT again */
+struct fat_file {
+    uint32_t size;
+    uint16_t *chain;
+    uint32_t nclusters;
+};
+
+/* a volume on the whole disk (mkfs.fat disk.img) or in the first FAT
+   partition of an MBR; the FAT stays in memory from here on */
+bool fat_mount(int dev);
+bool fat_mounted(void);
+int fat_dev(void);
+int fat_bits(void);                 /* 12 or 16 */
+uint32_t fat_free_bytes(void);
+
+/* root directory entries, at most max; returns the count */
+int fat_list(struct fat_dirent *out, int max);
+
+enum fat_err fat_open(const char *name, struct fat_file *f);
+/* up to n bytes from off; returns the count, or -1 on a disk error */
+int32_t fat_read(struct fat_file *f, uint32_t off, void *buf, uint32_t n);
+void fat_close(struct fat_file *f);
+
+/* the whole file in a kmalloc'd buffer with a NUL after it */
+enum fat_err fat_load(const char *name, char **data, size_t *len);
+/* create or replace name with len bytes of data, then sync the disk */
+enum fat_err fat_save(const char *name, const char *data, size_t len);
+
+const char *fat_strerror(enum fat_err e);
+
+#endif /* FAT_H */
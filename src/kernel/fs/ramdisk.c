@@ -0,0 +1,153 @@
+/* ramdisk.c  –  ustar archives and plain files loaded by GRUB or Limine */
+#include "ramdisk.h"
+#include "../lib/string.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#define TAR_BLOCK 512
+
+/* POSIX ustar header, one 512-byte block before each entry's data */
+struct tar_header {
+    char name[100];
+    char mode[8], uid[8], gid[8];
+    char size[12];                  /* octal */
+    char mtime[12];
+    char chksum[8];
+    char typeflag;                  /* '0' or NUL: a regular file */
+    char linkname[100];
+    char magic[6];                  /* "ustar" */
+    char version[2];
+    char uname[32], gname[32];
+    char devmajor[8], devminor[8];
+    char prefix[155];               /* prepended to name with a '/' */
+    char pad[12];
+} __attribute__((packed));
+
+static struct rd_file files[RD_MAX_FILES];
+static int nfiles;
+static uint32_t nmodules;
+
+static uint32_t octal(const char *s, size_t n)
+{
+    uint32_t v = 0;
+    while (n && *s == ' ') { s++; n--; }
+    for (; n && *s >= '0' && *s <= '7'; s++, n--)
+        v = v * 8 + (*s - '0');
+    return v;
+}
+
+/* append at most n bytes of s (it need not be terminated) */
+static bool append(char *dst, size_t *len, const char *s, size_t n)
+{
+    for (; n && *s; s++, n--) {
+        if (*len == RD_NAME_LEN - 1) return false;
+        dst[(*len)++] = *s;
+    }
+    dst[*len] = '\0';
+    return true;
+}
+
+/* end is the end of the module the data lives in */
+static void add(const char *name, size_t n, const char *prefix, size_t pn,
+                const char *data, uint32_t size, const char *end)
+{
+    if (nfiles == RD_MAX_FILES) return;
+    struct rd_file *f = &files[nfiles];
+    size_t len = 0;
+    f->name[0] = '\0';
+    if (prefix && *prefix) {
+        if (!append(f->name, &len, prefix, pn) || !append(f->name, &len, "/", 1))
+            return;
+    }
+    if (!append(f->name, &len, name, n)) return;
+
+    /* "tar -C dir ." writes every name as ./something */
+    char *p = f->name;
+    while (p[0] == '.' && p[1] == '/') p += 2;
+    if (!*p) return;
+    if (p != f->name) memmove(f->name, p, strlen(p) + 1);
+    f->data = data;
+    f->size = size;
+    f->terminated = data + size < end && !data[size];
+    nfiles++;
+}
+
+static bool is_tar(const char *start, uint32_t len)
+{
+    const struct tar_header *h = (const void *)start;
+    return len >= TAR_BLOCK && !strncmp(h->magic, "ustar", 5);
+}
+
+static void add_tar(const char *start, const char *end)
+{
+    const char *p = start;
+    while (p + TAR_BLOCK <= end) {
+        const struct tar_header *h = (const void *)p;
+        if (!h->name[0]) break;                     /* the zero blocks at the end */
+        if (strncmp(h->magic, "ustar", 5)) break;   /* not a header: give up */
+
+        uint32_t size = octal(h->size, sizeof(h->size));
+        const char *data = p + TAR_BLOCK;
+        if (data + size > end) break;               /* truncated archive */
+        if (h->typeflag == '0' || h->typeflag == '\0')
+            add(h->name, sizeof(h->name), h->prefix, sizeof(h->prefix), data, size, end);
+        p = data + ((size + TAR_BLOCK - 1) & ~(TAR_BLOCK - 1));
+    }
+}
+
+/* "/boot/hello.bas hello.bas" or "/boot/hello.bas": the last path
+   component of the first word */
+static void add_plain(const char *cmdline, const char *data, uint32_t size)
+{
+    const char *name = "MODULE", *end;
+    if (cmdline && *cmdline) {
+        while (*cmdline == ' ') cmdline++;
+        end = cmdline;
+        while (*end && *end != ' ') end++;
+        name = end;
+        while (name > cmdline && name[-1] != '/') name--;
+        if (name < end) {
+            add(name, end - name, NULL, 0, data, size, data + size);
+            return;
+        }
+    }
+    add(name, strlen(name), NULL, 0, data, size, data + size);
+}
+
+void ramdisk_init(const struct multiboot_info *mbi)
+{
+    if (!mbi || !(mbi->flags & MB_INFO_MODS)) return;
+    const struct multiboot_module *m = (const void *)mbi->mods_addr;
+    for (uint32_t i = 0; i < mbi->mods_count; ++i) {
+        const char *start = (const char *)m[i].mod_start;
+        uint32_t len = m[i].mod_end - m[i].mod_start;
+        if (is_tar(start, len))
+            add_tar(start, start + len);
+        else
+            add_plain((const char *)m[i].string, start, len);
+    }
+    nmodules = mbi->mods_count;
+}
+
+uint32_t ramdisk_modules(void) { return nmodules; }
+int ramdisk_count(void) { return nfiles; }
+
+const struct rd_file *ramdisk_file(int i)
+{
+    return i >= 0 && i < nfiles ? &files[i] : NULL;
+}
+
+static char upper(char c)
+{
+    return c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c;
+}
+
+const struct rd_file *ramdisk_find(const char *name)
+{
+    for (int i = 0; i < nfiles; ++i) {
+        const char *a = files[i].name, *b = name;
+        while (*a && upper(*a) == upper(*b)) { a++; b++; }
+        if (!*a && !*b) return &files[i];
+    }
+    return NULL;
+}
@@ -0,0 +1,35 @@
+/* ramdisk.h  –  read-only files from the multiboot modules */
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../core/multiboot.h"
+
+#define RD_MAX_FILES 64
+#define RD_NAME_LEN  64             /* longer paths are left out */
+
+/* data points into the module itself: nothing is ever copied.  Only
+   when terminated is data[size] part of the module, and a NUL: a tar
+   entry followed by its zero padding.  A plain module ends at size, and
+   the page after it may not even be mapped. */
+struct rd_file {
+    char name[RD_NAME_LEN];
+    const char *data;
+    uint32_t size;
+    bool terminated;
+};
+
+/* a module that is a ustar archive gives one file per regular entry;
+   any other module is one file named after its command line.  Runs
+   once, after pmm_init() has reserved the modules. */
+void ramdisk_init(const struct multiboot_info *mbi);
+
+uint32_t ramdisk_modules(void);
+int ramdisk_count(void);
+const struct rd_file *ramdisk_file(int i);
+
+/* case does not matter, as in DOS; NULL if there is no such file */
+const struct rd_file *ramdisk_find(const char *name);
+
+#endif /* RAMDISK_H */
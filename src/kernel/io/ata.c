@@ -0,0 +1,281 @@
+/* ata.c  –  LBA28 commands on the legacy IDE ports, DMA via the PCI
+ *           bus-master registers
+ *
+ * Drive interrupts stay off (nIEN): a transfer is started, then polled.
+ * For DMA the thread yields while it waits, so the CPU goes to whoever
+ * else is ready instead of spinning on a status register.
+ */
+#include "ata.h"
+#include "pci.h"
+#include "port.h"
+#include "../core/timer.h"
+#include "../core/thread.h"
+#include "../lib/string.h"
+#include <stddef.h>
+
+/* task-file registers, from the channel's I/O base */
+#define REG_DATA        0
+#define REG_ERROR       1
+#define REG_COUNT       2
+#define REG_LBA0        3
+#define REG_LBA1        4
+#define REG_LBA2        5
+#define REG_DRIVE       6
+#define REG_STATUS      7           /* read */
+#define REG_COMMAND     7           /* write */
+
+/* control block: alternate status (read) / device control (write) */
+#define CTL_NIEN        0x02
+
+#define ST_ERR          0x01
+#define ST_DRQ          0x08
+#define ST_DF           0x20
+#define ST_BSY          0x80
+
+#define CMD_READ_PIO    0x20
+#define CMD_WRITE_PIO   0x30
+#define CMD_READ_DMA    0xC8
+#define CMD_WRITE_DMA   0xCA
+#define CMD_FLUSH       0xE7
+#define CMD_IDENTIFY    0xEC
+
+/* bus-master registers, from the channel's BM base */
+#define BM_COMMAND      0
+#define BM_STATUS       2
+#define BM_PRDT         4
+#define BM_START        0x01
+#define BM_TO_MEMORY    0x08        /* command: the device writes memory */
+#define BM_ACTIVE       0x01        /* status */
+#define BM_ERROR        0x02
+#define BM_IRQ          0x04
+
+/* physical region descriptor: one per sector buffer */
+struct prd {
+    uint32_t addr;
+    uint16_t bytes;
+    uint16_t flags;                 /* 0x8000 on the last entry */
+} __attribute__((packed));
+#define PRD_LAST        0x8000
+
+struct channel {
+    uint16_t io, ctl, bm;           /* bm 0: no bus master, PIO only */
+};
+
+static struct channel channels[2] = {
+    { 0x1F0, 0x3F6, 0 },
+    { 0x170, 0x376, 0 },
+};
+static struct ata_drive drives[ATA_MAX_DRIVES];
+static struct ata_stats stats;
+
+/* 128 bytes, aligned to 256: a table must not cross a 64 KB boundary */
+static struct prd prdt[2][ATA_MAX_XFER] __attribute__((aligned(256)));
+
+/* ---------- low level ---------- */
+static uint8_t alt_status(const struct channel *c) { return inb(c->ctl); }
+
+/* each alternate-status read takes about 100 ns */
+static void delay400(const struct channel *c)
+{
+    for (int i = 0; i < 4; ++i) alt_status(c);
+}
+
+/* status once BSY drops; ST_ERR also stands for a timeout */
+static uint8_t wait_ready(const struct channel *c)
+{
+    uint64_t end = ticks() + ATA_TIMEOUT_MS;
+    uint8_t st;
+    while ((st = alt_status(c)) & ST_BSY) {
+        if (ticks() > end) return ST_ERR;
+        asm volatile ("pause");
+    }
+    return st;
+}
+
+static void select(const struct channel *c, int slave, uint32_t lba)
+{
+    outb(c->io + REG_DRIVE, 0xE0 | (slave << 4) | ((lba >> 24) & 0x0F));
+    delay400(c);
+}
+
+static void issue(const struct channel *c, uint32_t lba, uint32_t count, uint8_t cmd)
+{
+    outb(c->io + REG_COUNT, count);
+    outb(c->io + REG_LBA0, lba);
+    outb(c->io + REG_LBA1, lba >> 8);
+    outb(c->io + REG_LBA2, lba >> 16);
+    outb(c->io + REG_COMMAND, cmd);
+}
+
+/* only once the drive is idle: no BSY, no DRQ */
+static bool flush(const struct channel *c)
+{
+    outb(c->io + REG_COMMAND, CMD_FLUSH);
+    delay400(c);
+    return !(wait_ready(c) & (ST_ERR | ST_DF));
+}
+
+/* ---------- PIO ---------- */
+static bool pio(int n, uint32_t lba, uint32_t count, uint8_t *const *bufs, bool write)
+{
+    const struct channel *c = &channels[n >> 1];
+    stats.pio_cmds++;
+    select(c, n & 1, lba);
+    if (wait_ready(c) & ST_ERR) return false;
+    issue(c, lba, count, write ? CMD_WRITE_PIO : CMD_READ_PIO);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        delay400(c);
+        uint8_t st = wait_ready(c);
+        if ((st & (ST_ERR | ST_DF)) || !(st & ST_DRQ)) return false;
+        if (write) outsw(c->io + REG_DATA, bufs[i], ATA_SECTOR / 2);
+        else insw(c->io + REG_DATA, bufs[i], ATA_SECTOR / 2);
+    }
+    /* after the last sector the drive stays BSY while it commits it,
+       and the Command register is off limits until it is done */
+    delay400(c);
+    if (wait_ready(c) & (ST_ERR | ST_DF | ST_DRQ)) return false;
+    return write ? flush(c) : true;
+}
+
+/* ---------- DMA ---------- */
+static bool dma(int n, uint32_t lba, uint32_t count, uint8_t *const *bufs, bool write)
+{
+    const struct channel *c = &channels[n >> 1];
+    struct prd *t = prdt[n >> 1];
+    stats.dma_cmds++;
+
+    /* kernel memory is identity-mapped: the pointer is the address */
+    for (uint32_t i = 0; i < count; ++i) {
+        t[i].addr = (uint32_t)bufs[i];
+        t[i].bytes = ATA_SECTOR;
+        t[i].flags = i + 1 == count ? PRD_LAST : 0;
+    }
+    outl(c->bm + BM_PRDT, (uint32_t)t);
+    outb(c->bm + BM_COMMAND, write ? 0 : BM_TO_MEMORY);
+    outb(c->bm + BM_STATUS, inb(c->bm + BM_STATUS) | BM_ERROR | BM_IRQ);
+
+    select(c, n & 1, lba);
+    if (wait_ready(c) & ST_ERR) return false;
+    issue(c, lba, count, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+    outb(c->bm + BM_COMMAND, inb(c->bm + BM_COMMAND) | BM_START);
+
+    uint64_t end = ticks() + ATA_TIMEOUT_MS;
+    uint8_t bs, st;
+    for (;;) {
+        bs = inb(c->bm + BM_STATUS);
+        st = alt_status(c);
+        if (!(bs & BM_ACTIVE) && !(st & ST_BSY)) break;
+        if ((bs & BM_ERROR) || ticks() > end) break;
+        yield();
+    }
+    outb(c->bm + BM_COMMAND, inb(c->bm + BM_COMMAND) & ~BM_START);
+
+    if ((bs & (BM_ACTIVE | BM_ERROR)) || (st & (ST_BSY | ST_ERR | ST_DF)))
+        return false;
+    return write ? flush(c) : true;
+}
+
+static bool transfer(int n, uint32_t lba, uint32_t count, uint8_t *const *bufs, bool write)
+{
+    if (n < 0 || n >= ATA_MAX_DRIVES || !drives[n].present) return false;
+    struct ata_drive *d = &drives[n];
+    if (!count || count > ATA_MAX_XFER || lba + count > d->sectors) return false;
+
+    bool ok = false;
+    if (d->dma) {
+        ok = dma(n, lba, count, bufs, write);
+        if (!ok) d->dma = false;    /* the controller lied: PIO from now on */
+    }
+    if (!ok) ok = pio(n, lba, count, bufs, write);
+    if (!ok) stats.errors++;
+    else if (write) stats.sectors_written += count;
+    else stats.sectors_read += count;
+    return ok;
+}
+
+bool ata_read(int n, uint32_t lba, uint32_t count, uint8_t *const *bufs)
+{
+    return transfer(n, lba, count, bufs, false);
+}
+
+bool ata_write(int n, uint32_t lba, uint32_t count, uint8_t *const *bufs)
+{
+    return transfer(n, lba, count, bufs, true);
+}
+
+/* ---------- detection ---------- */
+static void identify(int n)
+{
+    const struct channel *c = &channels[n >> 1];
+    static uint16_t id[256];
+
+    select(c, n & 1, 0);
+    issue(c, 0, 0, CMD_IDENTIFY);
+    delay400(c);
+    if (!alt_status(c)) return;                     /* nobody home */
+    uint8_t st = wait_ready(c);
+    if (st & ST_ERR) return;                        /* ATAPI aborts, or timeout */
+    if (inb(c->io + REG_LBA1) || inb(c->io + REG_LBA2))
+        return;                                     /* ATAPI or SATA signature */
+    uint64_t end = ticks() + ATA_TIMEOUT_MS;
+    while (!((st = alt_status(c)) & (ST_DRQ | ST_ERR)))
+        if (ticks() > end) return;
+    if (st & ST_ERR) return;
+    insw(c->io + REG_DATA, id, 256);
+
+    struct ata_drive *d = &drives[n];
+    d->sectors = id[60] | (uint32_t)id[61] << 16;
+    if (!d->sectors) return;                        /* CHS only: not for us */
+    for (int i = 0; i < 20; ++i) {                  /* byte-swapped words */
+        d->model[2 * i] = id[27 + i] >> 8;
+        d->model[2 * i + 1] = id[27 + i];
+    }
+    int len = 40;
+    while (len && d->model[len - 1] == ' ') len--;
+    d->model[len] = '\0';
+    d->dma = c->bm && (id[49] & 0x100);
+    d->present = true;
+}
+
+void ata_init(void)
+{
+    struct pci_dev pci;
+    if (pci_find_class(0x01, 0x01, &pci)) {         /* mass storage, IDE */
+        /* native-mode channels take their ports from BARs 0-3 */
+        if (pci.prog_if & 0x01) {
+            channels[0].io = pci_io_bar(&pci, 0);
+            channels[0].ctl = pci_io_bar(&pci, 1) + 2;
+        }
+        if (pci.prog_if & 0x04) {
+            channels[1].io = pci_io_bar(&pci, 2);
+            channels[1].ctl = pci_io_bar(&pci, 3) + 2;
+        }
+        uint16_t bm = pci_io_bar(&pci, 4);
+        if ((pci.prog_if & 0x80) && bm) {           /* bus mastering supported */
+            channels[0].bm = bm;
+            channels[1].bm = bm + 8;
+            pci_write16(&pci, PCI_COMMAND, pci_read16(&pci, PCI_COMMAND) |
+                        PCI_CMD_IO | PCI_CMD_MASTER);
+        }
+    }
+
+    for (int ch = 0; ch < 2; ++ch) {
+        if (inb(channels[ch].io + REG_STATUS) == 0xFF)
+            continue;                               /* floating bus: no channel */
+        outb(channels[ch].ctl, CTL_NIEN);
+        identify(ch * 2);
+        identify(ch * 2 + 1);
+    }
+}
+
+const struct ata_drive *ata_drive(int n)
+{
+    if (n < 0 || n >= ATA_MAX_DRIVES || !drives[n].present) return NULL;
+    return &drives[n];
+}
+
+void ata_get_stats(struct ata_stats *st)
+{
+    *st = stats;
+}
@@ -0,0 +1,41 @@
+/* ata.h  –  IDE disks: bus-master DMA, PIO when there is no DMA */
+#ifndef ATA_H
+#define ATA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ATA_SECTOR      512
+#define ATA_MAX_DRIVES  4           /* primary/secondary × master/slave */
+#define ATA_MAX_XFER    16          /* sectors per command */
+#define ATA_TIMEOUT_MS  3000
+
+struct ata_drive {
+    bool present;
+    bool dma;                       /* cleared for good after a failed DMA */
+    uint32_t sectors;               /* LBA28 */
+    char model[41];
+};
+
+struct ata_stats {
+    uint32_t dma_cmds, pio_cmds;
+    uint32_t sectors_read, sectors_written;
+    uint32_t errors;
+};
+
+/* find the controller on PCI and IDENTIFY the four drive positions;
+   after timer_init (timeouts count ticks) */
+void ata_init(void);
+
+/* NULL if there is no disk at n */
+const struct ata_drive *ata_drive(int n);
+void ata_get_stats(struct ata_stats *st);
+
+/* count (<= ATA_MAX_XFER) sectors starting at lba, sector i in bufs[i].
+   A buffer is 512 bytes of kernel memory inside one page, so DMA can
+   scatter straight into it.  One caller at a time (bcache's mutex);
+   waits for DMA with yield().  false on a disk error or timeout. */
+bool ata_read(int n, uint32_t lba, uint32_t count, uint8_t *const *bufs);
+bool ata_write(int n, uint32_t lba, uint32_t count, uint8_t *const *bufs);
+
+#endif /* ATA_H */
@@ -1,12 +1,17 @@
-/* keyboard.c – LazyDOS keyboard driver (ASCII Ctrl support) */
+/* keyboard.c – LazyDOS keyboard driver (IRQ1, ASCII Ctrl support) */
 #include "keyboard.h"
 #include "port.h"
+#include "../core/idt.h"
+#include "../core/thread.h"
 #include <stdint.h>
 
 #define PS2_STATUS 0x64
 #define PS2_DATA   0x60
 #define STAT_OBF   1   /* output buffer full */
 
+#define KBD_IRQ    1
+#define KBD_BUF_SZ 128 /* power of two */
+
 /* scancode set 1 */
 static const char normal[128] = {
     0,0,'1','2','3','4','5','6','7','8','9','0','-','=','\b','\t',
@@ -30,24 +35,46 @@ static const char shifted[128] = {
     0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0
 };
 
+/* E0 xx: the grey cursor block */
+static char extended(uint8_t sc)
+{
+    switch (sc) {
+        case 0x48: return KEY_UP;
+        case 0x50: return KEY_DOWN;
+        case 0x4B: return KEY_LEFT;
+        case 0x4D: return KEY_RIGHT;
+        case 0x47: return KEY_HOME;
+        case 0x4F: return KEY_END;
+        case 0x49: return KEY_PGUP;
+        case 0x51: return KEY_PGDN;
+        case 0x53: return KEY_DELETE;
+        case 0x1C: return '\n';        /* keypad Enter */
+        case 0x35: return '/';          /* keypad / */
+    }
+    return 0;
+}
+
 /* modifier state */
 static struct {
     uint8_t shift : 1;
     uint8_t ctrl  : 1;
     uint8_t alt   : 1;
     uint8_t del   : 1;
+    uint8_t e0    : 1;              /* last byte was the E0 prefix */
 } state;
 
-/* -------------------------------------------------- */
+/* decoded keys: single producer / single consumer ring.  head is only
+   written from IRQ handlers (IRQ1, and IRQ4 for the serial console;
+   they never nest), tail only by readers. */
+static char kbd_buf[KBD_BUF_SZ];
+static uint32_t kbd_head;
+static uint32_t kbd_tail;
 
-static int data_waiting(void)
-{
-    return inb(PS2_STATUS) & STAT_OBF;
-}
+/* -------------------------------------------------- */
 
 int lazy_key_available(void)
 {
-    return data_waiting();
+    return __atomic_load_n(&kbd_head, __ATOMIC_ACQUIRE) != kbd_tail;
 }
 
 static void update_modifiers(uint8_t sc)
@@ -72,18 +99,28 @@ static void update_modifiers(uint8_t sc)
 
 /* -------------------------------------------------- */
 
-char lazy_trygetchar(void)
+static char decode(uint8_t sc)
 {
-    if (!data_waiting())
+    if (sc == 0xE0) {
+        state.e0 = 1;
+        return 0;
+    }
+    uint8_t ext = state.e0;
+    state.e0 = 0;
+
+    /* E0 2A / E0 36 are fake shifts sent around the cursor block */
+    if (ext && ((sc & 0x7F) == 0x2A || (sc & 0x7F) == 0x36))
         return 0;
 
-    uint8_t sc = inb(PS2_DATA);
     update_modifiers(sc);
 
     /* ignore key releases */
     if (sc & 0x80)
         return 0;
 
+    if (ext)
+        return extended(sc);
+
     /* ASCII Ctrl mappings (minimal, explicit) */
     if (state.ctrl) {
         /* Ctrl+R */
@@ -93,20 +130,77 @@ char lazy_trygetchar(void)
         /* Ctrl+X */
         if (sc == 0x2D)    /* X */
             return 0x18;   /* ASCII CAN */
-    }
 
-    if (sc >= 128)
-        return 0;
+        /* Ctrl+S */
+        if (sc == 0x1F)    /* S */
+            return 0x13;   /* ASCII DC3 */
+
+        /* Ctrl+O */
+        if (sc == 0x18)    /* O */
+            return 0x0F;   /* ASCII SI */
+
+        /* Ctrl+C */
+        if (sc == 0x2E)    /* C */
+            return KEY_BREAK;
+    }
 
     const char *tbl = state.shift ? shifted : normal;
     return tbl[sc];
 }
 
+static void kbd_push(char c)
+{
+    uint32_t head = kbd_head;
+    if (head - __atomic_load_n(&kbd_tail, __ATOMIC_ACQUIRE) >= KBD_BUF_SZ)
+        return;                         /* full: drop the key */
+    kbd_buf[head & (KBD_BUF_SZ - 1)] = c;
+    __atomic_store_n(&kbd_head, head + 1, __ATOMIC_RELEASE);
+}
+
+void keyboard_push(char c)
+{
+    if (c == KEY_BREAK)
+        thread_break();         /* stops a runaway program; still a key */
+    kbd_push(c);
+    thread_wake(&kbd_head);
+}
+
+static void keyboard_irq(struct regs *r)
+{
+    (void)r;
+    char c = decode(inb(PS2_DATA));
+    if (c) keyboard_push(c);
+}
+
+void keyboard_init(void)
+{
+    /* drop anything the BIOS left in the controller */
+    while (inb(PS2_STATUS) & STAT_OBF)
+        inb(PS2_DATA);
+    irq_install(KBD_IRQ, keyboard_irq);
+}
+
+char lazy_trygetchar(void)
+{
+    uint32_t tail = kbd_tail;
+    if (__atomic_load_n(&kbd_head, __ATOMIC_ACQUIRE) == tail)
+        return 0;
+    char c = kbd_buf[tail & (KBD_BUF_SZ - 1)];
+    __atomic_store_n(&kbd_tail, tail + 1, __ATOMIC_RELEASE);
+    return c;
+}
+
 char lazy_getchar(void)
 {
     char c;
-    while (!(c = lazy_trygetchar()))
-        ;
+    for (;;) {
+        /* check with IRQs off so IRQ1 cannot push a key between the
+           test and going to sleep; other threads run meanwhile */
+        asm volatile ("cli");
+        if ((c = lazy_trygetchar())) break;
+        thread_wait(&kbd_head);
+    }
+    asm volatile ("sti");
     return c;
 }
 
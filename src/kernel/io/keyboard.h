@@ -4,9 +4,26 @@
 
 #include <stdint.h>
 
-int  lazy_key_available(void);   /* 1 = scancode waiting */
-char lazy_getchar(void);         /* blocking ASCII */
+/* non-ASCII keys (E0-prefixed scancodes), above the 7-bit range */
+#define KEY_UP      ((char)0x80)
+#define KEY_DOWN    ((char)0x81)
+#define KEY_LEFT    ((char)0x82)
+#define KEY_RIGHT   ((char)0x83)
+#define KEY_HOME    ((char)0x84)
+#define KEY_END     ((char)0x85)
+#define KEY_PGUP    ((char)0x86)
+#define KEY_PGDN    ((char)0x87)
+#define KEY_DELETE  ((char)0x88)
+
+#define KEY_BREAK   0x03        /* Ctrl+C; also stops the shell's program */
+
+void keyboard_init(void);        /* hook IRQ1 */
+int  lazy_key_available(void);   /* 1 = key waiting in the buffer */
+char lazy_getchar(void);         /* blocking ASCII, hlt while idle */
 char lazy_trygetchar(void);      /* 0 = none ready   */
 int  lazy_is_ctrl_alt_del(void); /* 1 = reboot combo */
 
+/* a key from another source (the serial console), from its IRQ handler */
+void keyboard_push(char c);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,77 @@
+/* pci.c  –  configuration mechanism #1 and a brute-force bus scan */
+#include "pci.h"
+#include "port.h"
+
+#define CONFIG_ADDRESS  0xCF8
+#define CONFIG_DATA     0xCFC
+
+static uint32_t address(uint8_t bus, uint8_t dev, uint8_t fn, uint8_t off)
+{
+    return 0x80000000u | (uint32_t)bus << 16 | (uint32_t)dev << 11 |
+           (uint32_t)fn << 8 | (off & 0xFC);
+}
+
+static uint32_t read(uint8_t bus, uint8_t dev, uint8_t fn, uint8_t off)
+{
+    outl(CONFIG_ADDRESS, address(bus, dev, fn, off));
+    return inl(CONFIG_DATA);
+}
+
+uint32_t pci_read32(const struct pci_dev *d, uint8_t off)
+{
+    return read(d->bus, d->dev, d->fn, off);
+}
+
+void pci_write32(const struct pci_dev *d, uint8_t off, uint32_t v)
+{
+    outl(CONFIG_ADDRESS, address(d->bus, d->dev, d->fn, off));
+    outl(CONFIG_DATA, v);
+}
+
+uint16_t pci_read16(const struct pci_dev *d, uint8_t off)
+{
+    return pci_read32(d, off) >> ((off & 2) * 8);
+}
+
+void pci_write16(const struct pci_dev *d, uint8_t off, uint16_t v)
+{
+    uint32_t shift = (off & 2) * 8;
+    uint32_t old = pci_read32(d, off) & ~(0xFFFFu << shift);
+    pci_write32(d, off, old | (uint32_t)v << shift);
+}
+
+bool pci_find_class(uint8_t class, uint8_t subclass, struct pci_dev *out)
+{
+    for (uint32_t bus = 0; bus < 256; ++bus) {
+        for (uint8_t dev = 0; dev < 32; ++dev) {
+            for (uint8_t fn = 0; fn < 8; ++fn) {
+                uint32_t id = read(bus, dev, fn, 0);
+                if ((id & 0xFFFF) == 0xFFFF) {
+                    if (fn == 0) break;     /* no device at all */
+                    continue;
+                }
+                uint32_t cls = read(bus, dev, fn, PCI_CLASS);
+                if (cls >> 24 == class && (cls >> 16 & 0xFF) == subclass) {
+                    out->bus = bus;
+                    out->dev = dev;
+                    out->fn = fn;
+                    out->class = class;
+                    out->subclass = subclass;
+                    out->prog_if = cls >> 8;
+                    out->vendor = id;
+                    out->device = id >> 16;
+                    return true;
+                }
+                /* header type bit 7: the other functions exist */
+                if (fn == 0 && !(read(bus, dev, 0, 0x0C) & 0x800000)) break;
+            }
+        }
+    }
+    return false;
+}
+
+uint16_t pci_io_bar(const struct pci_dev *d, int n)
+{
+    uint32_t bar = pci_read32(d, PCI_BAR0 + 4 * n);
+    return (bar & 1) ? (bar & 0xFFFC) : 0;
+}
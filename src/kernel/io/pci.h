@@ -0,0 +1,33 @@
+/* pci.h  –  PCI configuration space through ports 0xCF8/0xCFC */
+#ifndef PCI_H
+#define PCI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PCI_COMMAND         0x04    /* 16 bits */
+#define PCI_CLASS           0x08    /* revision, prog-if, subclass, class */
+#define PCI_BAR0            0x10    /* BAR n at 0x10 + 4 * n */
+
+#define PCI_CMD_IO          0x0001
+#define PCI_CMD_MEMORY      0x0002
+#define PCI_CMD_MASTER      0x0004  /* the device may start DMA */
+
+struct pci_dev {
+    uint8_t bus, dev, fn;
+    uint8_t class, subclass, prog_if;
+    uint16_t vendor, device;
+};
+
+uint32_t pci_read32(const struct pci_dev *d, uint8_t off);
+void pci_write32(const struct pci_dev *d, uint8_t off, uint32_t v);
+uint16_t pci_read16(const struct pci_dev *d, uint8_t off);
+void pci_write16(const struct pci_dev *d, uint8_t off, uint16_t v);
+
+/* the first function with this class and subclass; false if none */
+bool pci_find_class(uint8_t class, uint8_t subclass, struct pci_dev *out);
+
+/* I/O port base of BAR n, 0 if it is a memory BAR or unset */
+uint16_t pci_io_bar(const struct pci_dev *d, int n);
+
+#endif /* PCI_H */
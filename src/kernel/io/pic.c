@@ -0,0 +1,60 @@
+/* pic.c  –  8259A PIC remap / mask / EOI */
+#include "pic.h"
+#include "port.h"
+
+#define PIC1_CMD   0x20
+#define PIC1_DATA  0x21
+#define PIC2_CMD   0xA0
+#define PIC2_DATA  0xA1
+
+#define ICW1_INIT  0x11     /* edge triggered, cascade, ICW4 follows */
+#define ICW4_8086  0x01
+#define OCW3_ISR   0x0B     /* next read of CMD returns in-service reg */
+#define PIC_EOI    0x20
+
+static void io_wait(void) { outb(0x80, 0); }
+
+void pic_remap(uint8_t master_base, uint8_t slave_base)
+{
+    outb(PIC1_CMD, ICW1_INIT);  io_wait();
+    outb(PIC2_CMD, ICW1_INIT);  io_wait();
+    outb(PIC1_DATA, master_base); io_wait();
+    outb(PIC2_DATA, slave_base);  io_wait();
+    outb(PIC1_DATA, 0x04);      io_wait();  /* slave on IRQ2 */
+    outb(PIC2_DATA, 0x02);      io_wait();  /* cascade identity */
+    outb(PIC1_DATA, ICW4_8086); io_wait();
+    outb(PIC2_DATA, ICW4_8086); io_wait();
+
+    /* everything masked except the cascade line */
+    outb(PIC1_DATA, 0xFB);
+    outb(PIC2_DATA, 0xFF);
+}
+
+void pic_unmask(uint8_t irq)
+{
+    uint16_t port = (irq < 8) ? PIC1_DATA : PIC2_DATA;
+    outb(port, inb(port) & ~(1 << (irq & 7)));
+}
+
+void pic_mask(uint8_t irq)
+{
+    uint16_t port = (irq < 8) ? PIC1_DATA : PIC2_DATA;
+    outb(port, inb(port) | (1 << (irq & 7)));
+}
+
+void pic_eoi(uint8_t irq)
+{
+    if (irq >= 8) outb(PIC2_CMD, PIC_EOI);
+    outb(PIC1_CMD, PIC_EOI);
+}
+
+int pic_is_spurious(uint8_t irq)
+{
+    if (irq != 7 && irq != 15) return 0;
+    uint16_t port = (irq == 7) ? PIC1_CMD : PIC2_CMD;
+    outb(port, OCW3_ISR);
+    if (inb(port) & 0x80) return 0;
+    /* a spurious IRQ15 still needs the master's cascade acknowledged */
+    if (irq == 15) outb(PIC1_CMD, PIC_EOI);
+    return 1;
+}
@@ -0,0 +1,13 @@
+/* pic.h  –  8259A programmable interrupt controller pair */
+#ifndef PIC_H
+#define PIC_H
+
+#include <stdint.h>
+
+void pic_remap(uint8_t master_base, uint8_t slave_base); /* all lines masked */
+void pic_unmask(uint8_t irq);
+void pic_mask(uint8_t irq);
+void pic_eoi(uint8_t irq);
+int  pic_is_spurious(uint8_t irq);  /* IRQ7/15 with no ISR bit set */
+
+#endif /* PIC_H */
@@ -17,4 +17,44 @@ uint8_t inb(uint16_t port)
                   : "Nd"(port)
                   : "memory");
     return ret;
+}
+
+void outw(uint16_t port, uint16_t val)
+{
+    asm volatile ("outw %0, %1" : : "a"(val), "Nd"(port) : "memory");
+}
+
+uint16_t inw(uint16_t port)
+{
+    uint16_t ret;
+    asm volatile ("inw %1, %0" : "=a"(ret) : "Nd"(port) : "memory");
+    return ret;
+}
+
+void outl(uint16_t port, uint32_t val)
+{
+    asm volatile ("outl %0, %1" : : "a"(val), "Nd"(port) : "memory");
+}
+
+uint32_t inl(uint16_t port)
+{
+    uint32_t ret;
+    asm volatile ("inl %1, %0" : "=a"(ret) : "Nd"(port) : "memory");
+    return ret;
+}
+
+void insw(uint16_t port, void *dst, uint32_t count)
+{
+    asm volatile ("cld; rep insw"
+                  : "+D"(dst), "+c"(count)
+                  : "d"(port)
+                  : "memory");
+}
+
+void outsw(uint16_t port, const void *src, uint32_t count)
+{
+    asm volatile ("cld; rep outsw"
+                  : "+S"(src), "+c"(count)
+                  : "d"(port)
+                  : "memory");
 }
\ No newline at end of file
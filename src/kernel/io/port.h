@@ -6,5 +6,13 @@
 
 void outb(uint16_t port, uint8_t val);
 uint8_t inb(uint16_t port);
+void outw(uint16_t port, uint16_t val);
+uint16_t inw(uint16_t port);
+void outl(uint16_t port, uint32_t val);
+uint32_t inl(uint16_t port);
+
+/* count 16-bit words between a port and memory (rep insw / rep outsw) */
+void insw(uint16_t port, void *dst, uint32_t count);
+void outsw(uint16_t port, const void *src, uint32_t count);
 
 #endif /* PORT_H */
\ No newline at end of file
@@ -0,0 +1,233 @@
+/* serial.c  –  16550 on COM1: a TX ring drained 16 bytes per IRQ
+ *
+ * Writers only copy into the ring.  Whenever the transmitter is empty
+ * the FIFO is filled in one burst and the THR-empty interrupt is armed;
+ * IRQ4 then refills it until the ring runs dry.  Received bytes are
+ * turned into keys (VT100 arrows included) and go into the keyboard's
+ * queue, so a terminal on the other end drives the shell like a PS/2
+ * keyboard does.
+ */
+#include "serial.h"
+#include "port.h"
+#include "keyboard.h"
+#include "../core/idt.h"
+
+#define COM1        0x3F8
+#define SERIAL_IRQ  4
+#define FIFO_SIZE   16
+
+#define THR         (COM1 + 0)      /* DLAB = 0 */
+#define RBR         (COM1 + 0)
+#define IER         (COM1 + 1)
+#define DLL         (COM1 + 0)      /* DLAB = 1 */
+#define DLM         (COM1 + 1)
+#define IIR         (COM1 + 2)
+#define FCR         (COM1 + 2)
+#define LCR         (COM1 + 3)
+#define MCR         (COM1 + 4)
+#define LSR         (COM1 + 5)
+#define MSR         (COM1 + 6)
+
+#define IER_RX      0x01
+#define IER_TX      0x02            /* THR empty */
+#define FCR_ENABLE  0xC7            /* on, both cleared, RX trigger at 14 */
+#define IIR_NONE    0x01            /* nothing pending */
+#define IIR_CAUSE   0x0E
+#define IIR_MODEM   0x00
+#define IIR_TX      0x02
+#define IIR_RX      0x04
+#define IIR_LINE    0x06
+#define IIR_TIMEOUT 0x0C            /* bytes below the trigger level, gone quiet */
+#define IIR_FIFO    0xC0            /* set when the FIFOs really are on */
+#define LCR_8N1     0x03
+#define LCR_DLAB    0x80
+#define MCR_DTR_RTS 0x03
+#define MCR_OUT2    0x08            /* gates the UART's IRQ line on a PC */
+#define MCR_LOOP    0x10
+#define LSR_DR      0x01
+#define LSR_THRE    0x20            /* FIFO empty */
+
+static char tx_buf[SERIAL_TX_BUF];
+static uint32_t tx_head, tx_tail;   /* free-running, masked on use */
+static bool present, irq_on;
+static struct serial_stats stats;
+
+/* escape sequence state: ESC, ESC [, ESC [ digit */
+static enum { RX_PLAIN, RX_ESC, RX_CSI, RX_NUM } rx_state;
+static char rx_num;
+
+static uint32_t irq_save(void)
+{
+    uint32_t flags;
+    asm volatile ("pushf\n pop %0\n cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static void irq_restore(uint32_t flags)
+{
+    if (flags & 0x200) asm volatile ("sti" : : : "memory");
+}
+
+/* ---------- transmit ---------- */
+/* one FIFO's worth, if the last one is gone; with interrupts off */
+static void tx_fill(void)
+{
+    if (!(inb(LSR) & LSR_THRE)) return;     /* busy: IRQ4 comes when done */
+    for (int i = 0; i < FIFO_SIZE && tx_tail != tx_head; ++i)
+        outb(THR, tx_buf[tx_tail++ & (SERIAL_TX_BUF - 1)]);
+    if (irq_on)
+        outb(IER, tx_tail != tx_head ? IER_RX | IER_TX : IER_RX);
+}
+
+static void tx_put(char c)
+{
+    if (tx_head - tx_tail == SERIAL_TX_BUF) {
+        /* full: drain by polling, still a FIFO at a time */
+        stats.tx_waits++;
+        while (tx_head - tx_tail == SERIAL_TX_BUF) {
+            while (!(inb(LSR) & LSR_THRE))
+                asm volatile ("pause");
+            tx_fill();
+        }
+    }
+    tx_buf[tx_head++ & (SERIAL_TX_BUF - 1)] = c;
+}
+
+void serial_write(const char *s, size_t n)
+{
+    if (!present) return;
+    uint32_t flags = irq_save();
+    for (size_t i = 0; i < n; ++i) {
+        if (s[i] == '\n') tx_put('\r');
+        tx_put(s[i]);
+    }
+    stats.tx_bytes += n;
+    tx_fill();
+    irq_restore(flags);
+}
+
+/* ---------- receive ---------- */
+/* a byte from the terminal as the key the PS/2 driver would give */
+static char rx_key(char c)
+{
+    switch (rx_state) {
+    case RX_PLAIN:
+        if (c == 0x1B) {
+            rx_state = RX_ESC;
+            return 0;
+        }
+        if (c == '\r') return '\n';
+        if (c == 0x7F) return '\b';
+        return c;
+    case RX_ESC:
+        rx_state = c == '[' ? RX_CSI : RX_PLAIN;
+        return 0;
+    case RX_CSI:
+        rx_state = RX_PLAIN;
+        switch (c) {
+        case 'A': return KEY_UP;
+        case 'B': return KEY_DOWN;
+        case 'C': return KEY_RIGHT;
+        case 'D': return KEY_LEFT;
+        case 'H': return KEY_HOME;
+        case 'F': return KEY_END;
+        }
+        if (c >= '0' && c <= '9') {
+            rx_num = c;
+            rx_state = RX_NUM;
+        }
+        return 0;
+    case RX_NUM:                    /* ESC [ n ~ */
+        rx_state = RX_PLAIN;
+        if (c != '~') return 0;
+        switch (rx_num) {
+        case '1': return KEY_HOME;
+        case '3': return KEY_DELETE;
+        case '4': return KEY_END;
+        case '5': return KEY_PGUP;
+        case '6': return KEY_PGDN;
+        }
+        return 0;
+    }
+    return 0;
+}
+
+static void serial_irq(struct regs *r)
+{
+    (void)r;
+    /* until nothing is pending: the PIC only sees edges, so a cause
+       left behind would keep the line high and IRQ4 silent for good */
+    uint8_t iir;
+    while (!((iir = inb(IIR)) & IIR_NONE)) {
+        switch (iir & IIR_CAUSE) {
+        case IIR_RX:
+        case IIR_TIMEOUT:
+            while (inb(LSR) & LSR_DR) {
+                stats.rx_bytes++;
+                char c = rx_key(inb(RBR));
+                if (c) keyboard_push(c);
+            }
+            break;
+        case IIR_TX:
+            stats.tx_irqs++;
+            tx_fill();
+            break;
+        case IIR_LINE:
+            inb(LSR);
+            break;
+        case IIR_MODEM:
+            inb(MSR);
+            break;
+        }
+    }
+}
+
+/* ---------- setup ---------- */
+bool serial_init(void)
+{
+    outb(IER, 0);
+    outb(LCR, LCR_DLAB);
+    uint16_t div = 115200 / SERIAL_BAUD;
+    outb(DLL, div & 0xFF);
+    outb(DLM, div >> 8);
+    outb(LCR, LCR_8N1);
+    outb(FCR, FCR_ENABLE);
+
+    /* loopback: a byte sent must come straight back */
+    outb(MCR, MCR_LOOP | MCR_OUT2 | MCR_DTR_RTS);
+    outb(THR, 0xAE);
+    for (int i = 0; i < 1000 && !(inb(LSR) & LSR_DR); ++i)
+        ;
+    if (!(inb(LSR) & LSR_DR) || inb(RBR) != 0xAE) return false;
+    /* an 8250 or 16450 has no FIFO, and we want one */
+    if ((inb(IIR) & IIR_FIFO) != IIR_FIFO) return false;
+
+    outb(MCR, MCR_OUT2 | MCR_DTR_RTS);
+    present = true;
+    return true;
+}
+
+void serial_start(void)
+{
+    if (!present) return;
+    uint32_t flags = irq_save();
+    irq_install(SERIAL_IRQ, serial_irq);
+    irq_on = true;
+    while (inb(LSR) & LSR_DR)       /* whatever came in while we booted */
+        inb(RBR);
+    outb(IER, IER_RX);
+    tx_fill();                      /* arms IER_TX if the boot log waits */
+    irq_restore(flags);
+}
+
+bool serial_present(void)
+{
+    return present;
+}
+
+void serial_get_stats(struct serial_stats *st)
+{
+    uint32_t flags = irq_save();
+    *st = stats;
+    irq_restore(flags);
+}
@@ -0,0 +1,30 @@
+/* serial.h  –  COM1 console: 16550 FIFOs, interrupt-driven transmit */
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SERIAL_BAUD     115200
+#define SERIAL_TX_BUF   4096        /* power of two */
+
+struct serial_stats {
+    uint32_t tx_bytes, rx_bytes;
+    uint32_t tx_irqs;               /* FIFO refills from IRQ4 */
+    uint32_t tx_waits;              /* writes that found the buffer full */
+};
+
+/* program the UART and keep output in the buffer until IRQ4 is on; false
+   if there is no 16550 (or it fails the loopback test).  First thing at
+   boot, so the whole log reaches the serial line. */
+bool serial_init(void);
+/* hook IRQ4; after init_idt */
+void serial_start(void);
+bool serial_present(void);
+
+/* queue bytes, "\n" as "\r\n"; returns at once unless the buffer is full */
+void serial_write(const char *s, size_t n);
+void serial_get_stats(struct serial_stats *st);
+
+#endif /* SERIAL_H */
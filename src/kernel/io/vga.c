@@ -2,21 +2,54 @@
 #include "../io/vga.h"
 #include "../lib/string.h"
 #include "../io/port.h"
+#include "../io/serial.h"
+#include "../core/thread.h"
 
-#define VGA_WIDTH   80
-#define VGA_HEIGHT  25
 #define VGA_MEM     0xB8000
+#define VRAM_ROWS   (0x4000 / VGA_WIDTH)    /* 32 KB text window = 204 rows */
 
 static uint16_t *const BUFFER = (uint16_t *)VGA_MEM;
 
+/* RAM copy of the screen: output is composed here and only rows marked
+   in dirty_rows are copied to VRAM by terminal_flush().  The shadow is a
+   ring of rows starting at shadow_top so scrolling it copies nothing. */
+static uint16_t shadow[VGA_WIDTH * VGA_HEIGHT];
+static size_t   shadow_top;
+static uint32_t dirty_rows;             /* bit n = screen row n changed */
+
+/* the visible screen starts at VRAM row vram_top (CRTC start address);
+   scrolling moves the window down the 32 KB text memory */
+static size_t   vram_top;
+static size_t   crtc_top = (size_t)-1;  /* last value sent to the CRTC */
+
 static size_t  term_row;
 static size_t  term_col;
 static uint8_t term_color;
+static bool    term_autoflush = true;
+static uint16_t cursor_pos = 0xFFFF;    /* last value sent to the CRTC */
+
+static uint16_t *shadow_row(size_t y)
+{
+    size_t r = shadow_top + y;
+    if (r >= VGA_HEIGHT) r -= VGA_HEIGHT;
+    return shadow + r * VGA_WIDTH;
+}
+
+/* ---------- CRTC helpers ---------- */
+static void update_start(void)
+{
+    if (vram_top == crtc_top) return;
+    crtc_top = vram_top;
+    uint16_t start = vram_top * VGA_WIDTH;
+    outb(0x3D4, 0x0C); outb(0x3D5, (start >> 8) & 0xFF);
+    outb(0x3D4, 0x0D); outb(0x3D5, start & 0xFF);
+}
 
-/* ---------- cursor helpers ---------- */
 static void update_cursor(void)
 {
-    uint16_t pos = term_row * VGA_WIDTH + term_col;
+    uint16_t pos = (vram_top + term_row) * VGA_WIDTH + term_col;
+    if (pos == cursor_pos) return;      /* skip the 4 port writes */
+    cursor_pos = pos;
     outb(0x3D4, 0x0F); outb(0x3D5, pos & 0xFF);
     outb(0x3D4, 0x0E); outb(0x3D5, (pos >> 8) & 0xFF);
 }
@@ -24,26 +57,65 @@ static void update_cursor(void)
 /* ---------- scroll one line up ---------- */
 static void scroll(void)
 {
-    memmove(BUFFER,
-            BUFFER + VGA_WIDTH,
-            (VGA_HEIGHT - 1) * VGA_WIDTH * sizeof(uint16_t));
-    /* clear bottom line */
+    /* the old top row becomes the new (blank) bottom row */
+    uint16_t *bottom = shadow_row(0);
+    if (++shadow_top == VGA_HEIGHT) shadow_top = 0;
     uint16_t blank = vga_entry(' ', term_color);
     for (size_t x = 0; x < VGA_WIDTH; ++x)
-        BUFFER[(VGA_HEIGHT - 1) * VGA_WIDTH + x] = blank;
+        bottom[x] = blank;
+
+    if (vram_top + VGA_HEIGHT < VRAM_ROWS) {
+        /* rows already in VRAM move up with the window */
+        ++vram_top;
+        dirty_rows = (dirty_rows >> 1) | (1U << (VGA_HEIGHT - 1));
+    } else {
+        /* window hit the end of text memory: restart at 0, copy all */
+        vram_top = 0;
+        dirty_rows = (1U << VGA_HEIGHT) - 1;
+    }
 }
 
-/* ---------- public API ---------- */
+/* ---------- compose one character into the shadow buffer ---------- */
+static void put_raw(char c)
+{
+    if (c == '\n') {
+        term_col = 0;
+        ++term_row;
+    } else {
+        shadow_row(term_row)[term_col] = vga_entry(c, term_color);
+        dirty_rows |= 1U << term_row;
+        if (++term_col == VGA_WIDTH) {
+            term_col = 0;
+            ++term_row;
+        }
+    }
+    if (term_row == VGA_HEIGHT) {
+        scroll();
+        --term_row;
+    }
+}
+
+/* ---------- public API ----------
+   Every thread writes to the one screen: calls that touch the shadow or
+   the cursor run with preemption off, so a switch never lands halfway.
+   The character stream (not the full-screen calls) also goes to the
+   serial console. */
 void terminal_initialize(void)
 {
+    preempt_disable();
     term_row   = 0;
     term_col   = 0;
     term_color = vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK);
 
+    shadow_top = 0;
+    vram_top   = 0;
+
     uint16_t blank = vga_entry(' ', term_color);
     for (size_t i = 0; i < VGA_WIDTH * VGA_HEIGHT; ++i)
-        BUFFER[i] = blank;
-    update_cursor();
+        shadow[i] = blank;
+    dirty_rows = (1U << VGA_HEIGHT) - 1;
+    terminal_flush();
+    preempt_enable();
 }
 
 void terminal_setcolor(uint8_t color)
@@ -51,32 +123,86 @@ void terminal_setcolor(uint8_t color)
     term_color = color;
 }
 
-void terminal_putchar(char c)
+uint8_t terminal_getcolor(void)
 {
-    if (c == '\n') {
-        term_col = 0;
-        ++term_row;
-    } else {
-        BUFFER[term_row * VGA_WIDTH + term_col] = vga_entry(c, term_color);
-        if (++term_col == VGA_WIDTH) {
-            term_col = 0;
-            ++term_row;
-        }
-    }
-    if (term_row == VGA_HEIGHT) {
-        scroll();
-        --term_row;
+    return term_color;
+}
+
+void terminal_flush(void)
+{
+    preempt_disable();
+    uint32_t d = dirty_rows;
+    dirty_rows = 0;
+    for (size_t y = 0; d; ++y, d >>= 1) {
+        if (d & 1)
+            memcpy(BUFFER + (vram_top + y) * VGA_WIDTH, shadow_row(y),
+                   VGA_WIDTH * sizeof(uint16_t));
     }
+    update_start();
     update_cursor();
+    preempt_enable();
+}
+
+void terminal_set_autoflush(bool on)
+{
+    term_autoflush = on;
+    if (on) terminal_flush();
+}
+
+bool terminal_get_autoflush(void)
+{
+    return term_autoflush;
+}
+
+void terminal_putchar(char c)
+{
+    preempt_disable();
+    put_raw(c);
+    serial_write(&c, 1);
+    if (term_autoflush) terminal_flush();
+    preempt_enable();
 }
 
 void terminal_write(const char *data, size_t size)
 {
+    preempt_disable();
     for (size_t i = 0; i < size; ++i)
-        terminal_putchar(data[i]);
+        put_raw(data[i]);
+    serial_write(data, size);
+    if (term_autoflush) terminal_flush();
+    preempt_enable();
 }
 
 void terminal_writestring(const char *str)
 {
     terminal_write(str, strlen(str));
 }
+
+void terminal_putentryat(char c, uint8_t color, size_t x, size_t y)
+{
+    uint16_t e = vga_entry(c, color);
+    preempt_disable();
+    uint16_t *cell = shadow_row(y) + x;
+    if (*cell != e) {                   /* unchanged: row stays clean */
+        *cell = e;
+        dirty_rows |= 1U << y;
+        if (term_autoflush) terminal_flush();
+    }
+    preempt_enable();
+}
+
+void terminal_scroll(void)
+{
+    preempt_disable();
+    scroll();
+    preempt_enable();
+}
+
+void terminal_setcursor(size_t x, size_t y)
+{
+    preempt_disable();
+    term_col = x;
+    term_row = y;
+    if (term_autoflush) terminal_flush();
+    preempt_enable();
+}
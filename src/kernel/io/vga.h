@@ -1,9 +1,13 @@
 #ifndef VGA_H
 #define VGA_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+#define VGA_WIDTH   80
+#define VGA_HEIGHT  25
+
 enum vga_color {
     VGA_COLOR_BLACK         = 0,
     VGA_COLOR_BLUE          = 1,
@@ -33,8 +37,22 @@ static inline uint16_t vga_entry(unsigned char c, uint8_t color) {
 
 void terminal_initialize(void);
 void terminal_setcolor(uint8_t color);
+uint8_t terminal_getcolor(void);
 void terminal_putchar(char c);
 void terminal_write(const char *data, size_t size);
 void terminal_writestring(const char *data);
 
+/* full-screen apps: draw a cell without moving the cursor, then place it */
+void terminal_putentryat(char c, uint8_t color, size_t x, size_t y);
+void terminal_setcursor(size_t x, size_t y);
+/* move the text up a line, cursor row unchanged; reaches VRAM on flush */
+void terminal_scroll(void);
+
+/* output is composed in a RAM shadow buffer; changed rows reach VRAM on
+   flush.  With autoflush on (default) every call above flushes itself,
+   interpreters turn it off while running and flush explicitly. */
+void terminal_flush(void);
+void terminal_set_autoflush(bool on);
+bool terminal_get_autoflush(void);
+
 #endif /* VGA_H */
\ No newline at end of file
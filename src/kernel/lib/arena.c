@@ -0,0 +1,131 @@
+#include "../lib/arena.h"
+#include "../lib/string.h"
+#include "../core/heap.h"
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;                /* payload bytes */
+    size_t pad[2];              /* payload stays 16-byte aligned */
+    unsigned char data[];
+};
+
+static size_t align_up(size_t n)
+{
+    return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+void arena_init(struct arena *a, size_t chunk_size)
+{
+    a->head = a->cur = NULL;
+    a->used = 0;
+    a->chunk_size = chunk_size;
+    a->allocated = a->peak = 0;
+}
+
+/* move on to a chunk with room for size: the next one if it fits,
+   otherwise a new one linked in right after cur */
+static int next_chunk(struct arena *a, size_t size)
+{
+    struct arena_chunk *next = a->cur ? a->cur->next : a->head;
+    if (!next || next->size < size) {
+        size_t payload = size > a->chunk_size ? size : a->chunk_size;
+        struct arena_chunk *c = kmalloc(sizeof(*c) + payload);
+        if (!c) return 0;
+        c->size = payload;
+        c->next = next;
+        if (a->cur) a->cur->next = c;
+        else a->head = c;
+        next = c;
+    }
+    a->cur = next;
+    a->used = 0;
+    return 1;
+}
+
+void *arena_alloc(struct arena *a, size_t size)
+{
+    size = align_up(size ? size : 1);
+    if (!a->cur || a->cur->size - a->used < size) {
+        if (!next_chunk(a, size)) return NULL;
+    }
+    void *p = a->cur->data + a->used;
+    a->used += size;
+    a->allocated += size;
+    if (a->allocated > a->peak) a->peak = a->allocated;
+    return p;
+}
+
+void *arena_zalloc(struct arena *a, size_t size)
+{
+    void *p = arena_alloc(a, size);
+    if (p) memset(p, 0, size);
+    return p;
+}
+
+char *arena_strdup(struct arena *a, const char *s)
+{
+    size_t n = strlen(s) + 1;
+    char *p = arena_alloc(a, n);
+    if (p) memcpy(p, s, n);
+    return p;
+}
+
+void *arena_realloc(struct arena *a, void *p, size_t old, size_t size)
+{
+    if (!p) return arena_alloc(a, size);
+    old = align_up(old);
+    size = align_up(size ? size : 1);
+
+    /* newest block: just move the bump pointer */
+    if (a->cur && (unsigned char *)p + old == a->cur->data + a->used &&
+        a->cur->size - a->used + old >= size) {
+        a->used = a->used - old + size;
+        a->allocated = a->allocated - old + size;
+        if (a->allocated > a->peak) a->peak = a->allocated;
+        return p;
+    }
+    if (size <= old) return p;
+
+    void *q = arena_alloc(a, size);
+    if (q) memcpy(q, p, old);
+    return q;
+}
+
+struct arena_mark arena_mark(const struct arena *a)
+{
+    struct arena_mark m = { a->cur, a->used, a->allocated };
+    return m;
+}
+
+void arena_release(struct arena *a, struct arena_mark m)
+{
+    a->cur = m.chunk;
+    a->used = m.used;
+    a->allocated = m.allocated;
+}
+
+void arena_reset(struct arena *a)
+{
+    a->cur = NULL;              /* the next alloc starts over at head */
+    a->used = 0;
+    a->allocated = a->peak = 0;
+}
+
+void arena_free(struct arena *a)
+{
+    struct arena_chunk *c = a->head;
+    while (c) {
+        struct arena_chunk *next = c->next;
+        kfree(c);
+        c = next;
+    }
+    arena_init(a, a->chunk_size);
+}
+
+size_t arena_capacity(const struct arena *a)
+{
+    size_t n = 0;
+    for (const struct arena_chunk *c = a->head; c; c = c->next)
+        n += c->size;
+    return n;
+}
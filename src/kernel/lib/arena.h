@@ -0,0 +1,47 @@
+#ifndef KERNEL_LIB_ARENA_H
+#define KERNEL_LIB_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* ---------- bump-pointer arena ----------
+   Allocation is a pointer bump inside a chunk; nothing is freed on its
+   own.  arena_release() rolls back to a mark, arena_reset() to empty,
+   both without touching the chunks, which stay for the next round.
+   Chunks come from kmalloc and go back only in arena_free(). */
+
+struct arena_chunk;
+
+struct arena {
+    struct arena_chunk *head;   /* first chunk, NULL until the first alloc */
+    struct arena_chunk *cur;    /* chunk being bumped */
+    size_t used;                /* bytes taken in cur */
+    size_t chunk_size;          /* default payload of a new chunk */
+    size_t allocated;           /* bytes handed out since the last reset */
+    size_t peak;                /* high-water mark since the last reset */
+};
+
+struct arena_mark {
+    struct arena_chunk *chunk;
+    size_t used, allocated;
+};
+
+#define ARENA_ALIGN 8
+
+void  arena_init(struct arena *a, size_t chunk_size);
+void *arena_alloc(struct arena *a, size_t size);        /* NULL when out */
+void *arena_zalloc(struct arena *a, size_t size);
+char *arena_strdup(struct arena *a, const char *s);
+
+/* grows in place when p is the newest allocation, else copies;
+   p may be NULL.  The old block is left as is on failure. */
+void *arena_realloc(struct arena *a, void *p, size_t old, size_t size);
+
+struct arena_mark arena_mark(const struct arena *a);
+void arena_release(struct arena *a, struct arena_mark m);
+void arena_reset(struct arena *a);                      /* O(1) */
+void arena_free(struct arena *a);                       /* chunks to the heap */
+
+size_t arena_capacity(const struct arena *a);           /* bytes in chunks */
+
+#endif
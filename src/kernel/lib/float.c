@@ -3,150 +3,229 @@
 #include "../lib/int.h"
 #include <stdbool.h>
 
+#define SIGN    0x80000000U
+#define ONE     0x3F800000U             /* 1.0 */
+#define HALF    0x3F000000U             /* 0.5 */
+
 /* ---------- helpers ---------- */
-static inline int32_t clamp_shift(int32_t s) { return (s < -150) ? -150 : (s > 150) ? 150 : s; }
+static bool is_zero(float32 a) { return !(a.u & ~SIGN); }
+static bool is_nan(float32 a)  { return (a.u & ~SIGN) > 0x7F800000U; }
+static float32 negate(float32 a) { return FLOAT32(a.u ^ SIGN); }
 
-static uint32_t u32_div_u32(uint32_t num, uint32_t den)   /* bit-by-bit, 32→32 */
-{
-    if (den == 0) return 0xFFFFFFFFU;
-    uint32_t quo = 0;
-    for (int bit = 31; bit >= 0; --bit) {
-        uint32_t sh = 1U << bit;
-        if (num >= (den << bit)) { num -= den << bit; quo |= sh; }
-    }
-    return quo;
-}
+/* ================== soft-float backend ==================
+   integer instructions only: this is what runs when there is no FPU */
 
 /* ---------- add / sub ---------- */
-float32 float32_add(float32 a, float32 b)
+static float32 soft_add(float32 a, float32 b)
 {
-    union float32_bits ua = { .f = a }, ub = { .f = b };
-    uint32_t sa = ua.u & 0x80000000U, sb = ub.u & 0x80000000U;
-    uint32_t ea = (ua.u >> 23) & 0xFFU, eb = (ub.u >> 23) & 0xFFU;
-    uint32_t ma = (ua.u & 0x007FFFFFU) | ((ea == 0) ? 0 : 0x00800000U);
-    uint32_t mb = (ub.u & 0x007FFFFFU) | ((eb == 0) ? 0 : 0x00800000U);
+    uint32_t sa = a.u & SIGN, sb = b.u & SIGN;
+    uint32_t ea = (a.u >> 23) & 0xFFU, eb = (b.u >> 23) & 0xFFU;
+    uint32_t ma = (a.u & 0x007FFFFFU) | ((ea == 0) ? 0 : 0x00800000U);
+    uint32_t mb = (b.u & 0x007FFFFFU) | ((eb == 0) ? 0 : 0x00800000U);
 
     if (ea == 0xFFU || eb == 0xFFU) return (ea == 0xFFU) ? a : b; /* NaN / inf */
-    if (sa != sb) return float32_sub(a, -b);                      /* different sign → sub */
+    if (sa != sb) {
+        /* different sign → subtract the smaller magnitude from the larger */
+        if ((a.u & ~SIGN) < (b.u & ~SIGN)) {
+            uint32_t t;
+            t = sa; sa = sb; sb = t;
+            t = ea; ea = eb; eb = t;
+            t = ma; ma = mb; mb = t;
+        }
+        if (ea == 0) ea = 1;                /* denormals scale like e=1 */
+        if (eb == 0) eb = 1;
+        uint32_t shift = ea - eb;
+        ma <<= 3; mb <<= 3;                 /* 3 guard bits */
+        mb = (shift < 27) ? (mb >> shift) : 0;
+        uint32_t res_m = ma - mb;
+        if (res_m == 0) return FLOAT32(0);
+        while (!(res_m & (0x00800000U << 3)) && ea > 1) { res_m <<= 1; ea--; }
+        if (!(res_m & (0x00800000U << 3))) ea = 0;   /* denormal */
+        res_m >>= 3;
+        return FLOAT32(sa | (ea << 23) | (res_m & 0x007FFFFFU));
+    }
 
     /* align mantissas */
     int32_t shift = (int32_t)ea - (int32_t)eb;
     if (shift > 0) mb = (shift < 24) ? (mb >> shift) : 0;
     if (shift < 0) { shift = -shift; ma = (shift < 24) ? (ma >> shift) : 0; }
     uint32_t res_m = ma + mb;
-    uint32_t res_e = (shift > 0) ? ea : eb;
+    uint32_t res_e = (ea > eb) ? ea : eb;
 
     /* carry? */
     if (res_m & 0x01000000U) { res_m >>= 1; res_e += 1; }
     if (res_e >= 0xFFU) { res_e = 0xFFU; res_m = 0; } /* overflow → inf */
 
-    union float32_bits ur = { .u = (sa | (res_e << 23) | (res_m & 0x007FFFFFU)) };
-    return ur.f;
+    return FLOAT32(sa | (res_e << 23) | (res_m & 0x007FFFFFU));
 }
 
-float32 float32_sub(float32 a, float32 b) { return float32_add(a, -b); }
-/* ---------- 32×32→HI/LO multiply (bit-by-bit, no 64-bit intermediate) ---------- */
-static void u32_x_u32(uint32_t a, uint32_t b, uint32_t *lo, uint32_t *hi)
+static float32 soft_sub(float32 a, float32 b) { return soft_add(a, negate(b)); }
+/* ---------- multiply / divide ----------
+   normal numbers only: denormal results flush to zero; the 24-bit
+   mantissas meet in one 32x32->64 multiply or a 64/32 divide */
+static float32 pack(uint32_t sign, int32_t exp, uint32_t mant)
 {
-    uint32_t l = 0, h = 0;
-    for (int bit = 0; bit < 32; ++bit) {
-        if (b & (1U << bit)) {
-            uint32_t addl = a << bit;
-            uint32_t addh = (bit == 0) ? 0 : (a >> (32 - bit));
-            l += addl;
-            if (l < addl) h++;          /* carry */
-            h += addh;
-        }
-    }
-    *lo = l; *hi = h;
+    if (mant == 0x01000000U) { mant >>= 1; exp++; }  /* rounding carried */
+    if (exp >= 255) return FLOAT32(sign | 0x7F800000U); /* overflow → inf */
+    if (exp <= 0) return FLOAT32(sign);                 /* underflow → 0 */
+    return FLOAT32(sign | ((uint32_t)exp << 23) | (mant & 0x007FFFFFU));
 }
 
-/* ---------- multiply (rewritten, 64-bit free) ---------- */
-float32 float32_mul(float32 a, float32 b)
+static float32 soft_mul(float32 a, float32 b)
 {
-    union float32_bits ua = { .f = a }, ub = { .f = b };
-    uint32_t sa = ua.u >> 31, sb = ub.u >> 31;
-    int32_t  ea = (int32_t)((ua.u >> 23) & 0xFFU) - 127;
-    int32_t  eb = (int32_t)((ub.u >> 23) & 0xFFU) - 127;
-    uint32_t ma = (ua.u & 0x007FFFFFU) | 0x00800000U;
-    uint32_t mb = (ub.u & 0x007FFFFFU) | 0x00800000U;
-
-    if (ea == 128 || eb == 128) return (ea == 128) ? a : b; /* NaN / inf */
+    uint32_t sign = (a.u ^ b.u) & SIGN;
+    int32_t  ea = (a.u >> 23) & 0xFFU, eb = (b.u >> 23) & 0xFFU;
 
-    uint32_t lo, hi;
-    u32_x_u32(ma, mb, &lo, &hi);              /* 48-bit product in hi:lo */
-    uint32_t prod = (hi << 8) | (lo >> 24);   /* keep top 24 bits */
-    int32_t  exp  = ea + eb + 23;
-    if (prod & 0x01000000U) { prod >>= 1; exp++; } /* carry */
-    if (exp >= 127)  { exp = 127;  prod = 0; }     /* overflow → inf */
-    if (exp < -126)  { exp = -126; }                 /* underflow → denorm */
+    if (is_nan(a) || is_nan(b)) return is_nan(a) ? a : b;
+    if (ea == 0xFF || eb == 0xFF)                       /* inf × 0 is NaN */
+        return (is_zero(a) || is_zero(b)) ? FLOAT32(0x7FC00000U) : FLOAT32(sign | 0x7F800000U);
+    if (ea == 0 || eb == 0) return FLOAT32(sign);       /* zero or denormal */
 
-    uint32_t res_e = (uint32_t)(exp + 127);
-    union float32_bits ur = { .u = ((sa ^ sb) << 31) | (res_e << 23) | (prod & 0x007FFFFFU) };
-    return ur.f;
+    uint64_t p = (uint64_t)((a.u & 0x007FFFFFU) | 0x00800000U) *
+                 ((b.u & 0x007FFFFFU) | 0x00800000U);   /* 2^46 .. 2^48 */
+    int32_t exp = ea + eb - 127;
+    uint32_t s = 23;
+    if (p >> 47) { s = 24; exp++; }
+    return pack(sign, exp, (uint32_t)((p + ((uint64_t)1 << (s - 1))) >> s));
 }
-/* ---------- divide ---------- */
-float32 float32_div(float32 a, float32 b)
+
+static float32 soft_div(float32 a, float32 b)
 {
-    union float32_bits ua = { .f = a }, ub = { .f = b };
-    uint32_t sa = ua.u >> 31, sb = ub.u >> 31;
-    int32_t  ea = (int32_t)((ua.u >> 23) & 0xFFU) - 127;
-    int32_t  eb = (int32_t)((ub.u >> 23) & 0xFFU) - 127;
-    uint32_t ma = (ua.u & 0x007FFFFFU) | 0x00800000U;
-    uint32_t mb = (ub.u & 0x007FFFFFU) | 0x00800000U;
+    uint32_t sign = (a.u ^ b.u) & SIGN;
+    int32_t  ea = (a.u >> 23) & 0xFFU, eb = (b.u >> 23) & 0xFFU;
+
+    if (is_nan(a) || is_nan(b)) return is_nan(a) ? a : b;
+    if (ea == 0xFF) return eb == 0xFF ? FLOAT32(0x7FC00000U) : FLOAT32(sign | 0x7F800000U);
+    if (eb == 0xFF) return FLOAT32(sign);
+    if (eb == 0)                                        /* x / 0 */
+        return ea == 0 ? FLOAT32(0x7FC00000U) : FLOAT32(sign | 0x7F800000U);
+    if (ea == 0) return FLOAT32(sign);
 
-    if (eb == 128 || mb == 0) return (eb == 128) ? b : a; /* div-by-zero / NaN */
-    uint32_t quo_m = u32_div_u32(ma << 8, mb);            /* 24Q8 → 24-bit quotient */
-    int32_t  exp   = ea - eb;
-    if (quo_m & 0x01000000U) { quo_m >>= 1; exp++; }      /* carry */
-    exp = clamp_shift(exp);
-    uint32_t res_e = (uint32_t)(exp + 127);
-    union float32_bits ur = { .u = ((sa ^ sb) << 31) | (res_e << 23) | (quo_m & 0x007FFFFFU) };
-    return ur.f;
+    /* ma / mb is 0.5 .. 2: 25 or 26 quotient bits, one past the mantissa */
+    uint64_t num = (uint64_t)((a.u & 0x007FFFFFU) | 0x00800000U) << 25;
+    uint32_t q = (uint32_t)uint64_divmod32(num, (b.u & 0x007FFFFFU) | 0x00800000U, NULL);
+    int32_t exp = ea - eb + 127;
+    if (q >> 25) return pack(sign, exp, (q + 2) >> 2);
+    return pack(sign, exp - 1, (q + 1) >> 1);
 }
 
 /* ---------- fabs ---------- */
-float32 float32_fabs(float32 x) { union float32_bits u = { .f = x }; u.u &= 0x7FFFFFFFU; return u.f; }
+float32 float32_fabs(float32 x) { return FLOAT32(x.u & ~SIGN); }
 
 /* ---------- comparisons ---------- */
-int float32_eq(float32 a, float32 b) { union float32_bits ua = { .f = a }, ub = { .f = b }; return ua.u == ub.u; }
-int float32_lt(float32 a, float32 b) { return (a < b) && !float32_eq(a, b); }
-int float32_le(float32 a, float32 b) { return (a < b) || float32_eq(a, b); }
+/* the bits as an unsigned number that sorts like the values do */
+static uint32_t order(float32 a) { return (a.u & SIGN) ? ~a.u : a.u | SIGN; }
+
+int float32_eq(float32 a, float32 b)
+{
+    if (is_nan(a) || is_nan(b)) return 0;
+    return a.u == b.u || (is_zero(a) && is_zero(b));    /* -0 == +0 */
+}
+int float32_lt(float32 a, float32 b)
+{
+    if (is_nan(a) || is_nan(b) || float32_eq(a, b)) return 0;
+    return order(a) < order(b);
+}
+int float32_le(float32 a, float32 b) { return float32_lt(a, b) || float32_eq(a, b); }
 
 /* ---------- floor / ceil ---------- */
 float32 float32_floor(float32 x)
 {
-    union float32_bits u = { .f = x };
-    int32_t e = (int32_t)((u.u >> 23) & 0xFFU) - 127;
-    if (e < 0) return (x >= 0.0f) ? 0.0f : -1.0f;
-    if (e >= 23) return x;                 /* integer part only */
-    uint32_t mask = 0x007FFFFFU >> (e + 1);
-    u.u &= ~mask;
-    return u.f;
+    int32_t e = (int32_t)((x.u >> 23) & 0xFFU) - 127;
+    if (e >= 23) return x;                  /* whole already, or inf / NaN */
+    if (e < 0)                              /* |x| < 1 */
+        return is_zero(x) ? x : FLOAT32((x.u & SIGN) ? (SIGN | ONE) : 0);
+    uint32_t mask = 0x007FFFFFU >> e;       /* the fraction bits */
+    if (!(x.u & mask)) return x;
+    float32 t = FLOAT32(x.u & ~mask);       /* toward zero ... */
+    return (x.u & SIGN) ? float32_sub(t, FLOAT32(ONE)) : t;    /* ... then down */
 }
-float32 float32_ceil(float32 x) { return -float32_floor(-x); }
+float32 float32_ceil(float32 x) { return negate(float32_floor(negate(x))); }
 
 /* ---------- fmod ---------- */
 float32 float32_fmod(float32 x, float32 y)
 {
-    if (y == 0.0f) return x;
+    if (is_zero(y)) return x;
     uint32_t count = 0;
-    while (x >= y && count++ < 100) x = float32_sub(x, y); /* lazy loop */
+    while (float32_le(y, x) && count++ < 100) x = float32_sub(x, y); /* lazy loop */
     return x;
 }
 
 /* ---------- sqrt (Newton, 4 iterations) ---------- */
-float32 float32_sqrt(float32 x)
+static float32 soft_sqrt(float32 x)
 {
-    if (x <= 0.0f) return 0.0f;
-    union float32_bits u = { .f = x };
-    /* first guess: 1.0f */
-    float32 g = 1.0f;
+    if (is_zero(x) || (x.u & SIGN)) return FLOAT32(0);
+    if (((x.u >> 23) & 0xFFU) == 0xFF) return x;       /* inf, NaN */
+    /* first guess: halve the exponent, then each step doubles the digits */
+    float32 g = FLOAT32((x.u >> 1) + 0x1FC00000U);
     for (int i = 0; i < 4; ++i)
-        g = float32_mul(0.5f, float32_add(g, float32_div(x, g)));
+        g = soft_mul(FLOAT32(HALF), soft_add(g, soft_div(x, g)));
     return g;
 }
 
+/* ================== x87 backend ==================
+   operands are loaded from memory and the result stored back, so a
+   float32 never sits in an FPU register outside these functions */
+static float32 x87_add(float32 a, float32 b)
+{
+    asm ("flds %1\n fadds %2\n fstps %0" : "=m"(a) : "m"(a), "m"(b));
+    return a;
+}
+
+static float32 x87_sub(float32 a, float32 b)
+{
+    asm ("flds %1\n fsubs %2\n fstps %0" : "=m"(a) : "m"(a), "m"(b));
+    return a;
+}
+
+static float32 x87_mul(float32 a, float32 b)
+{
+    asm ("flds %1\n fmuls %2\n fstps %0" : "=m"(a) : "m"(a), "m"(b));
+    return a;
+}
+
+static float32 x87_div(float32 a, float32 b)
+{
+    asm ("flds %1\n fdivs %2\n fstps %0" : "=m"(a) : "m"(a), "m"(b));
+    return a;
+}
+
+static float32 x87_sqrt(float32 x)
+{
+    if (is_zero(x) || (x.u & SIGN)) return FLOAT32(0);
+    asm ("flds %1\n fsqrt\n fstps %0" : "=m"(x) : "m"(x));
+    return x;
+}
+
+/* ================== backend selection ================== */
+struct float32_ops {
+    float32 (*add)(float32, float32);
+    float32 (*sub)(float32, float32);
+    float32 (*mul)(float32, float32);
+    float32 (*div)(float32, float32);
+    float32 (*sqrt)(float32);
+};
+
+static const struct float32_ops soft_ops = { soft_add, soft_sub, soft_mul, soft_div, soft_sqrt };
+static const struct float32_ops x87_ops  = { x87_add,  x87_sub,  x87_mul,  x87_div,  x87_sqrt  };
+
+static const struct float32_ops *ops = &soft_ops;
+static enum float32_backend backend = FLOAT32_SOFT;
+
+void float32_init(enum float32_backend b)
+{
+    backend = b;
+    ops = (b == FLOAT32_X87) ? &x87_ops : &soft_ops;
+}
+
+enum float32_backend float32_get_backend(void) { return backend; }
+
+float32 float32_add(float32 a, float32 b) { return ops->add(a, b); }
+float32 float32_sub(float32 a, float32 b) { return ops->sub(a, b); }
+float32 float32_mul(float32 a, float32 b) { return ops->mul(a, b); }
+float32 float32_div(float32 a, float32 b) { return ops->div(a, b); }
+float32 float32_sqrt(float32 x)           { return ops->sqrt(x); }
+
 /* ---------- string ←→ float32 ---------- */
 float32 float32_from_string(const char *s, char **end)
 {
@@ -160,18 +239,33 @@ float32 float32_from_string(const char *s, char **end)
         while (*p >= '0' && *p <= '9') { fracp = fracp * 10 + (*p - '0'); div *= 10; ++p; }
     }
     if (end) *end = (char *)p;
-    /* inside float32_from_string: remove / replace */
     float32 v = float32_add(int32_to_float(intp), float32_div(int32_to_float(fracp), int32_to_float(div)));
-    return neg ? float32_sub(0.0f, v) : v;
+    return neg ? negate(v) : v;
 }
 
+/* whole part and six rounded decimals, straight from the bits */
 void float32_to_string(float32 val, char *out, int max_len)
 {
     if (max_len <= 0) return;
-    bool neg = false;
-    if (val < 0) { neg = true; val = -val; }
-    uint32_t ip = (uint32_t)val;
-    uint32_t fp = (uint32_t)((val - ip) * 1e6f + 0.5f);
+    bool neg = (val.u & SIGN) && !is_zero(val);
+    int32_t e = (int32_t)((val.u >> 23) & 0xFFU) - 127;
+    uint32_t m = val.u & 0x007FFFFFU;
+    if (e == -127) e = -126;                /* denormal: no hidden bit */
+    else m |= 0x00800000U;
+
+    /* val = m * 2^(e - 23) */
+    uint32_t ip, fp = 0;
+    if (e >= 23) {
+        ip = (e > 31) ? 0xFFFFFFFFU : m << (e - 23);
+    } else {
+        uint32_t s = 23 - e;                /* fraction bits: 1 .. 149 */
+        ip = (s < 32) ? m >> s : 0;
+        uint64_t frac = (s < 32) ? (m & ((1U << s) - 1)) : m;
+        if (s < 64)
+            fp = (uint32_t)((frac * 1000000U + ((uint64_t)1 << (s - 1))) >> s);
+        if (fp == 1000000) { ip++; fp = 0; }
+    }
+
     char tmp[24], *p = tmp;
     do { *p++ = '0' + ip % 10; ip /= 10; } while (ip);
     if (neg) *p++ = '-';
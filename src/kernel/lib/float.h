@@ -3,9 +3,16 @@
 
 #include <stdint.h>
 
-/* ---- IEEE-754 single layout ---- */
-typedef float float32;
-union float32_bits { float32 f; uint32_t u; };
+/* ---- IEEE-754 single, carried as its bits ----
+   never a C float: the i386 ABI passes and returns those on the x87
+   stack, and the soft-float backend has to run with no FPU at all */
+typedef struct { uint32_t u; } float32;
+#define FLOAT32(bits) ((float32){ (bits) })
+
+/* ---- backend: soft-float until the FPU is up, then x87 ---- */
+enum float32_backend { FLOAT32_SOFT, FLOAT32_X87 };
+void float32_init(enum float32_backend b);
+enum float32_backend float32_get_backend(void);
 
 /* ---- basic arithmetic (no libgcc) ---- */
 float32 float32_add(float32 a, float32 b);
@@ -85,28 +85,45 @@ int32 int32_mod(int32 num, int32 den)
     return num - q * den;
 }
 
+/* ================== 64 / 32 ================== */
+/* schoolbook in base 2^32: the high half first, its remainder becomes
+   the top of the second dividend so the second divl cannot overflow */
+uint64 uint64_divmod32(uint64 num, uint32 den, uint32 *rem)
+{
+    if (den == 0) {
+        if (rem) *rem = 0;
+        return 0xFFFFFFFFFFFFFFFFULL;
+    }
+    uint32 hi = (uint32)(num >> 32);
+    uint32 lo = (uint32)num;
+    uint32 qhi = hi / den;
+    uint32 r = hi % den;
+    uint32 qlo;
+    asm ("divl %4" : "=a"(qlo), "=d"(r) : "a"(lo), "d"(r), "rm"(den));
+    if (rem) *rem = r;
+    return ((uint64)qhi << 32) | qlo;
+}
+
 /* ================== saturated add ================== */
 uint8 sadd8(uint8 a, uint8 b)  { uint16 t = (uint16)a + b; return t > 0xFF ? 0xFF : (uint8)t; }
 uint16 sadd16(uint16 a, uint16 b) { uint32 t = (uint32)a + b; return t > 0xFFFF ? 0xFFFF : (uint16)t; }
 uint32 sadd32(uint32 a, uint32 b) { return a + b; } /* 32-bit wrap is natural */
 
 /* ================== int → IEEE-754 single ================== */
-static float u32_to_float(uint32 abs, int sign)
+static float32 u32_to_float(uint32 abs, int sign)
 {
-    union { float f; uint32 u; } u;
-    if (abs == 0) { u.u = 0; return u.f; }
+    if (abs == 0) return FLOAT32(0);
     int expo = 31;
     while ((abs >> expo) == 0) --expo;
     int shift = expo - 23;
     uint32 mant = (shift >= 0) ? (abs >> shift) : (abs << -shift);
     mant &= 0x007FFFFF;
-    u.u = (sign ? 0x80000000 : 0) | ((uint32)(expo + 127) << 23) | mant;
-    return u.f;
+    return FLOAT32((sign ? 0x80000000 : 0) | ((uint32)(expo + 127) << 23) | mant);
 }
 
-float int32_to_float(int32 v) { return u32_to_float((v < 0) ? -v : v, v < 0); }
-float int16_to_float(int16 v) { return int32_to_float((int32)v); }
-float int8_to_float(int8 v)   { return int32_to_float((int32)v); }
+float32 int32_to_float(int32 v) { return u32_to_float((v < 0) ? -(uint32)v : (uint32)v, v < 0); }
+float32 int16_to_float(int16 v) { return int32_to_float((int32)v); }
+float32 int8_to_float(int8 v)   { return int32_to_float((int32)v); }
 
 /* ---- deliberate stubs: if these are called the link fails ---- */
 void __divdi3(void) { asm volatile ("ud2"); }
@@ -2,6 +2,7 @@
 #define KERNEL_LIB_INT_H
 
 #include <stdint.h>
+#include "float.h"
 
 /* exact-width names */
 typedef int8_t   int8;
@@ -10,6 +11,7 @@ typedef int16_t  int16;
 typedef uint16_t uint16;
 typedef int32_t  int32;
 typedef uint32_t uint32;
+typedef uint64_t uint64;
 
 /* ---------- unsigned helpers (base for signed) ---------- */
 uint8  uint8_div (uint8 num, uint8 den);
@@ -27,14 +29,17 @@ int16 int16_mod(int16 num, int16 den);
 int32 int32_div(int32 num, int32 den);
 int32 int32_mod(int32 num, int32 den);
 
+/* ---------- 64 / 32 with two divl: no libgcc __udivdi3 ---------- */
+uint64 uint64_divmod32(uint64 num, uint32 den, uint32 *rem);   /* rem may be NULL */
+
 /* ---------- saturated add (optional but handy) ---------- */
 uint8 sadd8(uint8 a, uint8 b);
 uint16 sadd16(uint16 a, uint16 b);
 uint32 sadd32(uint32 a, uint32 b);
 
 /* ---------- int → float (IEEE-754 single) ---------- */
-float int32_to_float(int32 v);
-float int16_to_float(int16 v);
-float int8_to_float(int8 v);
+float32 int32_to_float(int32 v);
+float32 int16_to_float(int16 v);
+float32 int8_to_float(int8 v);
 
 #endif
\ No newline at end of file
@@ -1,6 +1,105 @@
 // src/kernel/lib/string.c
 #include <stddef.h>
+#include <stdint.h>
 
+/* word access to byte buffers; may_alias keeps the compiler honest */
+typedef uint32_t __attribute__((may_alias)) word_t;
+
+#define ONES   0x01010101U
+#define HIGHS  0x80808080U
+/* non-zero iff some byte of w is 0 */
+#define HAS_ZERO(w) (((w) - ONES) & ~(w) & HIGHS)
+
+#define SSE2_MIN 256            /* below this rep movsd/stosd wins */
+
+static int use_sse2;
+
+void string_init(int sse2)
+{
+    use_sse2 = sse2;
+}
+
+/* ---------- copy / fill primitives ---------- */
+static inline void copy_fwd(unsigned char *d, const unsigned char *s, size_t n)
+{
+    size_t dw = n >> 2;
+    asm volatile ("rep movsl\n"
+                  "mov %3, %%ecx\n"
+                  "rep movsb\n"
+                  : "+D"(d), "+S"(s), "+c"(dw)
+                  : "r"(n & 3)
+                  : "memory");
+}
+
+/* n bytes ending at d+n / s+n, copied from the top down */
+static inline void copy_bwd(unsigned char *d, const unsigned char *s, size_t n)
+{
+    d += n; s += n;
+    for (size_t tail = n & 3; tail; --tail)
+        *--d = *--s;
+    size_t dw = n >> 2;
+    if (!dw) return;
+    d -= 4; s -= 4;
+    asm volatile ("std\n"
+                  "rep movsl\n"
+                  "cld\n"
+                  : "+D"(d), "+S"(s), "+c"(dw)
+                  :
+                  : "memory");
+}
+
+static inline void fill(unsigned char *p, uint32_t v, size_t n)
+{
+    size_t dw = n >> 2;
+    asm volatile ("rep stosl\n"
+                  "mov %3, %%ecx\n"
+                  "rep stosb\n"
+                  : "+D"(p), "+c"(dw)
+                  : "a"(v), "r"(n & 3)
+                  : "memory");
+}
+
+/* 64-byte blocks, d 16-byte aligned; only called when use_sse2 */
+__attribute__((target("sse2")))
+static void copy_sse2(unsigned char *d, const unsigned char *s, size_t blocks)
+{
+    asm volatile ("1:\n"
+                  "movdqu   (%1), %%xmm0\n"
+                  "movdqu 16(%1), %%xmm1\n"
+                  "movdqu 32(%1), %%xmm2\n"
+                  "movdqu 48(%1), %%xmm3\n"
+                  "movdqa %%xmm0,   (%0)\n"
+                  "movdqa %%xmm1, 16(%0)\n"
+                  "movdqa %%xmm2, 32(%0)\n"
+                  "movdqa %%xmm3, 48(%0)\n"
+                  "add $64, %1\n"
+                  "add $64, %0\n"
+                  "dec %2\n"
+                  "jnz 1b\n"
+                  : "+r"(d), "+r"(s), "+r"(blocks)
+                  :
+                  : "xmm0", "xmm1", "xmm2", "xmm3", "memory");
+}
+
+__attribute__((target("sse2")))
+static void fill_sse2(unsigned char *p, uint32_t v, size_t blocks)
+{
+    asm volatile ("movd %2, %%xmm0\n"
+                  "pshufd $0, %%xmm0, %%xmm0\n"
+                  "1:\n"
+                  "movdqa %%xmm0,   (%0)\n"
+                  "movdqa %%xmm0, 16(%0)\n"
+                  "movdqa %%xmm0, 32(%0)\n"
+                  "movdqa %%xmm0, 48(%0)\n"
+                  "add $64, %0\n"
+                  "dec %1\n"
+                  "jnz 1b\n"
+                  : "+r"(p), "+r"(blocks)
+                  : "r"(v)
+                  : "xmm0", "memory");
+}
+
+/* ---------- string functions ---------- */
 char* strcpy(char* restrict dst, const char* restrict src)
 {
     char *d = dst;
@@ -10,54 +109,81 @@ char* strcpy(char* restrict dst, const char* restrict src)
 
 int strcmp(const char* a, const char* b)
 {
+    /* same alignment: compare a word at a time until a word differs or
+       holds the terminator, then finish that word bytewise.  Aligned
+       word reads never cross into the next page. */
+    if ((((uintptr_t)a ^ (uintptr_t)b) & 3) == 0) {
+        while (((uintptr_t)a & 3) && *a && *a == *b) { ++a; ++b; }
+        if (((uintptr_t)a & 3) == 0) {
+            for (;;) {
+                uint32_t wa = *(const word_t *)a;
+                if (wa != *(const word_t *)b || HAS_ZERO(wa)) break;
+                a += 4; b += 4;
+            }
+        }
+    }
     while (*a && *a == *b) { ++a; ++b; }
     return *(unsigned char*)a - *(unsigned char*)b;
 }
 
 
 size_t strlen(const char* str) {
-    size_t len = 0;
-    while (str[len]) {
-        len++;
+    const char *p = str;
+    while ((uintptr_t)p & 3) {
+        if (!*p) return p - str;
+        p++;
     }
-    return len;
+    while (!HAS_ZERO(*(const word_t *)p))
+        p += 4;
+    while (*p) p++;
+    return p - str;
 }
 
+/* ---------- memory functions ---------- */
 void* memset(void* ptr, int value, size_t num) {
     unsigned char* p = ptr;
-    while (num--) {
-        *p++ = (unsigned char)value;
+    uint32_t v = (unsigned char)value * ONES;
+
+    if (use_sse2 && num >= SSE2_MIN) {
+        while ((uintptr_t)p & 15) { *p++ = (unsigned char)value; num--; }
+        fill_sse2(p, v, num >> 6);
+        p += num & ~(size_t)63;
+        num &= 63;
+    } else {
+        while (num && ((uintptr_t)p & 3)) { *p++ = (unsigned char)value; num--; }
     }
+    fill(p, v, num);
     return ptr;
 }
 
 void* memcpy(void* dest, const void* src, size_t n) {
     unsigned char* d = dest;
     const unsigned char* s = src;
-    while (n--) {
-        *d++ = *s++;
+
+    if (use_sse2 && n >= SSE2_MIN) {
+        size_t head = (16 - ((uintptr_t)d & 15)) & 15;
+        copy_fwd(d, s, head);
+        d += head; s += head; n -= head;
+        copy_sse2(d, s, n >> 6);
+        d += n & ~(size_t)63;
+        s += n & ~(size_t)63;
+        n &= 63;
     }
+    copy_fwd(d, s, n);
     return dest;
 }
 
 void* memmove(void* dest, const void* src, size_t n) {
-    // Convert pointers to char pointers for byte-wise copying
     unsigned char* d = (unsigned char*)dest;
     const unsigned char* s = (const unsigned char*)src;
 
-    // Check for overlap and copy accordingly
-    if (d < s) {
-        // Non-overlapping or destination is before source
-        while (n--) {
-            *d++ = *s++;
-        }
+    // A forward copy is safe whenever the destination starts below the
+    // source: every word is read before anything overwrites it
+    if (d < s || d >= s + n) {
+        memcpy(d, s, n);
     } else if (d > s) {
         // Overlapping case: copy from the end to avoid corruption
-        d += n;
-        s += n;
-        while (n--) {
-            *(--d) = *(--s);
-        }
+        copy_bwd(d, s, n);
     }
 
     // Return the destination pointer
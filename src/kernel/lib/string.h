@@ -11,4 +11,7 @@ size_t strlen(const char* str);
 char* strcpy(char* restrict dst, const char* restrict src);
 int   strcmp(const char* a, const char* b);
 int strncmp(const char* a, const char* b, size_t n);
+
+/* pick the copy/fill path once at boot: sse2 = CPUID SSE2 and CR4 ready */
+void string_init(int sse2);
 #endif /* STRING_H */
\ No newline at end of file
@@ -0,0 +1,18 @@
+# gensyms.awk  –  `nm -n kernel.elf` -> ksyms.c (code symbols, address order)
+# Empty input gives an empty table, used for the first link pass.
+BEGIN {
+    print "/* generated by tools/gensyms.awk from kernel.elf - do not edit */"
+    print "#include \"ksyms.h\""
+    print ""
+    print "const struct ksym ksyms[] = {"
+    n = 0
+}
+$2 ~ /^[tT]$/ && $3 !~ /^\./ {
+    printf "    {0x%s, \"%s\"},\n", $1, $3
+    n++
+}
+END {
+    print "    {0xFFFFFFFF, \"\"}     /* end */"
+    print "};"
+    print "const unsigned ksyms_count = " n ";"
+}